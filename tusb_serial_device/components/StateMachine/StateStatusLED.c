@@ -1,79 +1,208 @@
+/*
+ * StateStatusLED.c
+ *
+ * State LED and bar display. See StateStatusLED.h.
+ */
+
+#include <string.h>
+#include <limits.h>
 #include "StateStatusLED.h"
+#include "stateMachine.h"
+#include "led_strip.h"
+#include "pc_command.h"
+#include "esp_private/esp_clk.h"
 
 #define BLINK_GPIO               48 /* GPIO 48 for ESP32-S3 built-in addressable LED */
 #define BLINK_LED_RMT_CHANNEL    0
-#define BLINK_PERIOD             1000
+#define BAR_LED_RMT_CHANNEL      1  /* A long bar also takes the memory of channel 2 */
+#define BAR_BRIGHTNESS           32 /* Of 255, a full strip at 255 draws about 60 mA per LED */
+
+_Static_assert(sizeof(led_report_t) <= PC_CMD_REPLY_MAX, "LED report does not fit a reply");
+
+typedef struct {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint16_t blink_ms;          // Blink period, 0 for steady.
+} led_pattern_t;
+
+static const led_pattern_t led_patterns[] = {
+    [powerUp]      = {255, 0,   0,   0},       // Red
+    [enabled]      = {0,   0,   255, 0},       // Blue
+    [initialising] = {0,   0,   255, 500},     // Blue, flashing
+    [ready]        = {0,   255, 0,   0},       // Green
+    [run]          = {0,   255, 0,   500},     // Green, flashing
+    [estop]        = {16,  16,  16,  250},     // White, flashing fast
+    [wifiConfig]   = {128, 0,   128, 1000},    // Purple, flashing slowly
+    [devMatching]  = {0,   0,   255, 0},       // Blue
+};
 
-static const char *TAG = "blinkStateStatus";
-static uint8_t s_led_state = 0;
 static led_strip_t *pStrip_a;
+static volatile enum state_codes led_cur_state = powerUp;
+static uint32_t status_shown = UINT32_MAX;
+
+#if LED_BAR_LEN > 0
+static led_strip_t *bar_strip;
+static int bar_shown = INT_MIN;
+#endif
 
 void led_init()
 {
     pStrip_a = led_strip_init(BLINK_LED_RMT_CHANNEL, BLINK_GPIO, 1); /* LED strip initialization with the GPIO and pixels number*/
-    // pStrip_a->set_pixel(pStrip_a, 0, 16, 16, 16);
-    // pStrip_a->refresh(pStrip_a, 4);
+#if LED_BAR_LEN > 0
+    bar_strip = led_strip_init(BAR_LED_RMT_CHANNEL, CONFIG_TR_LED_BAR_GPIO, LED_BAR_LEN);
+#endif
     return;
 }
-//enum state_codes cur_state = powerUp;
-// enum state_codes cur_state;
 
+/**
+ * @brief Show the state machine state. Called from the control loop, only
+ *        records the state for led_task.
+ */
 void led_state(enum state_codes cur_state)
 {
-    if (cur_state == powerUp)                                           //上电：红色
+    led_cur_state = cur_state;
+}
+
+static void led_render_status(TickType_t now)
+{
+    enum state_codes state = led_cur_state;
+    const led_pattern_t *pattern = &led_patterns[state < sizeof(led_patterns) / sizeof(led_patterns[0]) ? state : powerUp];
+    bool on = pattern->blink_ms == 0 || ((now * portTICK_PERIOD_MS) % pattern->blink_ms) < pattern->blink_ms / 2;
+    uint32_t colour = on ? ((uint32_t)pattern->red << 16) | ((uint32_t)pattern->green << 8) | pattern->blue : 0;
+
+    // A frame only when the colour changes. If the strip is still busy, the next frame retries.
+    if (colour != status_shown)
+    {
+        pStrip_a->set_pixel(pStrip_a, 0, colour >> 16, (colour >> 8) & 0xFF, colour & 0xFF);
+        if (pStrip_a->refresh_async(pStrip_a, NULL, NULL) == ESP_OK)
         {
-            // if (未连接)
-            // {
-            //     红闪
-            // }
-            pStrip_a->set_pixel(pStrip_a, 0, 255, 0, 0);                  
-            //ESP_LOGI(TAG, "Current state: powerUp");
-            pStrip_a->refresh(pStrip_a, 40);
+            status_shown = colour;
+        }
+    }
+}
 
+#if LED_BAR_LEN > 0
+/**
+ * @brief Signed reading on the bar, in LEDs from the middle of the strip.
+ */
+static int led_bar_level(void)
+{
+#ifdef CONFIG_TR_LED_BAR_FORCE
+    int value = inter_force;
+    int full_scale = CONFIG_TR_LED_BAR_FORCE_FULL_SCALE;
+#else
+    // Centre to either limit switch, once both have been passed.
+    int value = linear_position;
+    int full_scale = abs(far_ls_position - motor_ls_position) / 2;
+    if (far_ls_position == 0 || motor_ls_position == 0 || full_scale == 0)
+    {
+        return 0;
+    }
+#endif
+    int half = LED_BAR_LEN / 2;
+    int level = (int)(((int64_t)value * half + (value < 0 ? -full_scale : full_scale) / 2) / full_scale);
+    return level > half ? half : (level < -half ? -half : level);
+}
+
+static void led_render_bar(void)
+{
+    int level = led_bar_level();
+    if (level == bar_shown)
+    {
+        return;
+    }
+
+    int half = LED_BAR_LEN / 2;
+    int magnitude = abs(level);
+    for (int i = 0; i < LED_BAR_LEN; i++)
+    {
+        int step = (level >= 0) ? i - half + 1 : half - i; // 1 for the first LED lit on that side.
+        if (step < 1 || step > magnitude)
+        {
+            bar_strip->set_pixel(bar_strip, i, 0, 0, 0);
         }
-        else if (cur_state == enabled)                                      //使能：蓝色
+#ifdef CONFIG_TR_LED_BAR_FORCE
+        else if (step * 5 > half * 4)
         {
-            pStrip_a->set_pixel(pStrip_a, 0, 0, 0, 255);                    
-            //ESP_LOGI(TAG, "Current state: enabled");
-            pStrip_a->refresh(pStrip_a, 40);
-
+            bar_strip->set_pixel(bar_strip, i, BAR_BRIGHTNESS, 0, 0);                     // Over 80 %: red
         }
-        else if (cur_state == initialising)                                  //初始化：蓝闪
+        else if (step * 2 > half)
         {
-            pStrip_a->clear(pStrip_a, 40);
-
-            pStrip_a->set_pixel(pStrip_a, 0, 0, 0, 255);
-            //ESP_LOGI(TAG, "Current state: initialising");
-
-            pStrip_a->refresh(pStrip_a, 80);
+            bar_strip->set_pixel(bar_strip, i, BAR_BRIGHTNESS, BAR_BRIGHTNESS / 2, 0);    // Over 50 %: amber
         }
-        else if (cur_state == ready)                                         //就绪：绿色
+        else
         {
-            pStrip_a->set_pixel(pStrip_a, 0, 0, 255, 0);
-            //ESP_LOGI(TAG, "Current state: ready");
-            pStrip_a->refresh(pStrip_a, 40);
+            bar_strip->set_pixel(bar_strip, i, 0, BAR_BRIGHTNESS, 0);
         }
-        else if (cur_state == run)                                          //使用：绿闪
+#else
+        else
         {
-            pStrip_a->clear(pStrip_a, 40);
-            pStrip_a->set_pixel(pStrip_a, 0, 0, 255, 0);
-            //ESP_LOGI(TAG, "Current state: run");
-            pStrip_a->refresh(pStrip_a, 80);
+            bar_strip->set_pixel(bar_strip, i, 0, 0, BAR_BRIGHTNESS);
         }
-        else if (cur_state == estop)                                        //estop:红蓝绿闪
+#endif
+    }
+    if (bar_strip->refresh_async(bar_strip, NULL, NULL) == ESP_OK)
+    {
+        bar_shown = level;
+    }
+}
+#endif /* LED_BAR_LEN > 0 */
+
+/**
+ * @brief Render the state LED and the bar display every LED_FRAME_MS. Lowest
+ *        priority; frames go out in the background on the RMT.
+ */
+void led_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+
+    for (;;)
+    {
+        if (pStrip_a != NULL)
+        {
+            led_render_status(last_wake);
+        }
+#if LED_BAR_LEN > 0
+        if (bar_strip != NULL)
         {
-            pStrip_a->clear(pStrip_a, 40);
-            pStrip_a->set_pixel(pStrip_a, 0, 16, 16, 16);
-            pStrip_a->refresh(pStrip_a, 80);
+            led_render_bar();
+        }
+#endif
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(LED_FRAME_MS));
+    }
+}
 
-            // pStrip_a->clear(pStrip_a, 40);
-            // pStrip_a->set_pixel(pStrip_a, 0, 0, 0, 255);
-            // pStrip_a->refresh(pStrip_a, 80);
+static void led_strip_report(led_strip_t *strip, led_strip_report_t *report)
+{
+    led_strip_stats_t stats;
+    uint32_t cycles_per_us = esp_clk_cpu_freq() / 1000000;
 
-            // pStrip_a->clear(pStrip_a, 40);
-            // pStrip_a->set_pixel(pStrip_a, 0, 0, 255, 0);
-            // pStrip_a->refresh(pStrip_a, 80);
+    strip->get_stats(strip, &stats);
+    report->frames = stats.frames;
+    report->busy = stats.busy;
+    report->last_cpu_us = (uint16_t)(stats.last_cycles / cycles_per_us);
+    report->max_cpu_us = (uint16_t)(stats.max_cycles / cycles_per_us);
+    report->wire_us = (uint16_t)stats.last_wire_us;
+}
 
-        }
-        return;
-}
\ No newline at end of file
+uint8_t led_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    led_report_t report;
+
+    memset(&report, 0, sizeof(report));
+    if (pStrip_a != NULL)
+    {
+        led_strip_report(pStrip_a, &report.status);
+    }
+#if LED_BAR_LEN > 0
+    if (bar_strip != NULL)
+    {
+        led_strip_report(bar_strip, &report.bar);
+    }
+#endif
+
+    memcpy(reply, &report, sizeof(report));
+    *reply_len = sizeof(report);
+    return PC_CMD_OK;
+}
@@ -1,24 +1,51 @@
+/*
+ * StateStatusLED.h
+ *
+ * State machine state on the on-board LED, and an optional bar display of
+ * the interaction force or the handle position on a second strip. The state
+ * machine only records the state with led_state(); led_task renders both
+ * strips every LED_FRAME_MS at the lowest priority and starts the frames
+ * without waiting for them, so the LEDs never hold up the control loop.
+ * Colours and blink rates are in led_patterns[].
+ */
+
 #ifndef LED_STATE_H_
 #define LED_STATE_H_
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
-#include "led_strip.h"
 #include "sdkconfig.h"
 
 enum state_codes { powerUp, enabled, initialising, ready, run, estop, wifiConfig, devMatching};
 //enum state_codes cur_state;
-static const char *TAG;
-static uint8_t s_led_state;
-static led_strip_t *pStrip_a;
+
+#define LED_FRAME_MS            CONFIG_TR_LED_FRAME_MS
+#define LED_BAR_LEN             CONFIG_TR_LED_BAR_LEN
+
+typedef struct __attribute__((packed)) {
+    uint32_t frames;            // Frames sent.
+    uint32_t busy;              // Frames skipped because the previous one was still being sent.
+    uint16_t last_cpu_us;       // CPU time translating the last frame.
+    uint16_t max_cpu_us;
+    uint16_t wire_us;           // Time on the wire of the last frame.
+} led_strip_report_t;
+
+typedef struct __attribute__((packed)) {
+    led_strip_report_t status;
+    led_strip_report_t bar;     // All 0 without a bar display.
+} led_report_t;
 
 void led_init();
 void led_state(enum state_codes cur_state);
+void led_task(void *arg);
 
+uint8_t led_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
 
 #endif /* MAIN_TEST_HEADER_H_ */
@@ -0,0 +1,141 @@
+/*
+ * boot_profile.c
+ *
+ * Boot time profile. See boot_profile.h.
+ */
+
+#include <string.h>
+#include "boot_profile.h"
+#include "pc_command.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_private/esp_clk.h"
+
+static const char *TAG = "boot";
+
+_Static_assert(sizeof(boot_report_t) <= PC_CMD_REPLY_MAX, "Boot report does not fit a reply");
+
+typedef struct {
+    const char *name;
+    int64_t start_us;
+    int64_t end_us;
+    uint8_t core;
+} boot_phase_t;
+
+static const char *const mark_names[BOOT_MARK_COUNT] = {
+    "startup done", "tasks started", "motor enabled", "first cycle",
+};
+
+// Steps run on both cores during startup.
+static portMUX_TYPE boot_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t app_start_us;
+static bool from_power_on;
+static boot_phase_t phases[BOOT_PROFILE_MAX_PHASES];
+static uint8_t phase_count;
+static int64_t marks[BOOT_MARK_COUNT];
+
+/**
+ * @brief Take the time spent before the app from the RTC timer. Call first
+ *        in app_main. The RTC timer only restarts on a power-on reset, after
+ *        other resets the profile counts from the start of the app.
+ */
+void boot_profile_init(void)
+{
+    from_power_on = (esp_reset_reason() == ESP_RST_POWERON);
+    app_start_us = from_power_on ? (int64_t)esp_clk_rtc_time() - esp_timer_get_time() : 0;
+}
+
+int64_t boot_profile_now_us(void)
+{
+    return app_start_us + esp_timer_get_time();
+}
+
+/**
+ * @brief Record a startup step that ran from start_us to end_us on the
+ *        calling core. Steps beyond BOOT_PROFILE_MAX_PHASES are not recorded.
+ */
+void boot_profile_phase(const char *name, int64_t start_us, int64_t end_us)
+{
+    portENTER_CRITICAL(&boot_lock);
+    if (phase_count < BOOT_PROFILE_MAX_PHASES)
+    {
+        phases[phase_count].name = name;
+        phases[phase_count].start_us = start_us;
+        phases[phase_count].end_us = end_us;
+        phases[phase_count].core = (uint8_t)xPortGetCoreID();
+        phase_count++;
+    }
+    portEXIT_CRITICAL(&boot_lock);
+}
+
+/**
+ * @brief Record the first time a milestone is reached. Cheap enough for the
+ *        control path, later calls do nothing.
+ */
+void boot_profile_mark(boot_mark_t mark)
+{
+    if (marks[mark] == 0)
+    {
+        marks[mark] = boot_profile_now_us();
+    }
+}
+
+/**
+ * @brief Print the steps, in order of start, and the milestones reached so far.
+ */
+void boot_profile_log(void)
+{
+    boot_phase_t sorted[BOOT_PROFILE_MAX_PHASES];
+    uint8_t count;
+
+    portENTER_CRITICAL(&boot_lock);
+    count = phase_count;
+    memcpy(sorted, phases, count * sizeof(boot_phase_t));
+    portEXIT_CRITICAL(&boot_lock);
+
+    for (uint8_t i = 1; i < count; i++)
+    {
+        boot_phase_t phase = sorted[i];
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1].start_us > phase.start_us; j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = phase;
+    }
+
+    ESP_LOGI(TAG, "Times in ms since %s", from_power_on ? "power-on" : "app start");
+    ESP_LOGI(TAG, "%-16s %8.1f", "app start", app_start_us / 1000.0);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        ESP_LOGI(TAG, "%-16s %8.1f %8.1f  core %u", sorted[i].name, sorted[i].start_us / 1000.0,
+                 sorted[i].end_us / 1000.0, sorted[i].core);
+    }
+    for (int m = 0; m < BOOT_MARK_COUNT; m++)
+    {
+        if (marks[m] != 0)
+        {
+            ESP_LOGI(TAG, "%-16s %8.1f", mark_names[m], marks[m] / 1000.0);
+        }
+    }
+}
+
+uint8_t boot_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    boot_report_t report = {
+        .app_start_us = (uint32_t)app_start_us,
+        .from_power_on = from_power_on,
+        .phases = phase_count,
+    };
+    for (int m = 0; m < BOOT_MARK_COUNT; m++)
+    {
+        report.mark_us[m] = (uint32_t)marks[m];
+    }
+
+    memcpy(reply, &report, sizeof(report));
+    *reply_len = sizeof(report);
+    return PC_CMD_OK;
+}
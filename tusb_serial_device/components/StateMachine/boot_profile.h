@@ -0,0 +1,45 @@
+/*
+ * boot_profile.h
+ *
+ * Boot time profile. The startup steps (startup.h) record when they ran and
+ * on which core, and a few milestones are marked on the way to the first
+ * control cycle. Times are in us since power-on: after a power-on reset the
+ * time spent in the ROM and the bootloader is taken from the RTC timer, after
+ * any other reset they count from the start of the app.
+ *
+ * The profile is printed on the console when the motor is enabled and read
+ * from the PC with PC_CMD_BOOT_GET.
+ */
+
+#ifndef BOOT_PROFILE_H_
+#define BOOT_PROFILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BOOT_PROFILE_MAX_PHASES     16
+
+typedef enum {
+    BOOT_MARK_STARTUP_DONE = 0, // All startup steps finished.
+    BOOT_MARK_TASKS_STARTED,    // Every task in rtos_objects.h created.
+    BOOT_MARK_MOTOR_ENABLED,    // Drive answered the enable sequence, state machine may leave powerUp.
+    BOOT_MARK_FIRST_CYCLE,      // First TPDO processed by main_fsm_function.
+    BOOT_MARK_COUNT
+} boot_mark_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t app_start_us;      // ROM and bootloader, 0 if not a power-on reset.
+    uint32_t mark_us[BOOT_MARK_COUNT]; // 0 when not reached yet.
+    uint8_t from_power_on;      // 1 if the times include the bootloader.
+    uint8_t phases;             // Steps recorded.
+} boot_report_t;
+
+void boot_profile_init(void);
+int64_t boot_profile_now_us(void);
+void boot_profile_phase(const char *name, int64_t start_us, int64_t end_us);
+void boot_profile_mark(boot_mark_t mark);
+void boot_profile_log(void);
+
+uint8_t boot_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+#endif /* BOOT_PROFILE_H_ */
@@ -8,6 +8,12 @@
  */
 
 #include "can_open_comm.h"
+#include "trace.h"
+
+// The frames of a cycle have to fit on the bus, see control_rate.h.
+_Static_assert((int64_t)CONTROL_CAN_BITS_PER_CYCLE * CONTROL_RATE_HZ * 100 <=
+                   (int64_t)CONFIG_TR_CAN_BITRATE * CONTROL_CAN_MAX_LOAD_PCT,
+               "The control rate needs a faster CAN bitrate");
 
 // 
 
@@ -25,13 +31,12 @@ void processRxMsg(twai_message_t *can_rx_msg, motor_status_t *motor_status )
     // 功能码
     uint8_t function_code = can_rx_msg->identifier >> 7 ; 
 
-    bytes_int_conv byte_converter; 
-    byte_converter.value = 0 ; 
     sdo_msg_t sdo_msg; 
 
     switch (function_code)
     {
     case 3:  //TPDO1
+        TRACE_EVENT(TRACE_EV_TPDO_RX, can_rx_msg->identifier);
         // memset(byte_converter.value, 0, sizeof(int)); 
         // memcpy(byte_converter.input, can_rx_msg->data, 2*sizeof(uint8_t) ); 
         
@@ -42,6 +47,9 @@ void processRxMsg(twai_message_t *can_rx_msg, motor_status_t *motor_status )
         // motor_status->position_inc = byte_converter.value; 
 
        
+        // TPDO1 is the first PDO the drive sends after SYNC. Its reception time is the time of the cycle.
+        motor_status->sample_time_us = esp_timer_get_time(); 
+
         memcpy(&motor_status->status_word, can_rx_msg->data, 2*sizeof(uint8_t) ); 
         
         memcpy( &motor_status->position_inc, &can_rx_msg->data[2], 4); 
@@ -55,6 +63,7 @@ void processRxMsg(twai_message_t *can_rx_msg, motor_status_t *motor_status )
 
 
     case 5:  //TPDO2
+        TRACE_EVENT(TRACE_EV_TPDO_RX, can_rx_msg->identifier);
         // memset(byte_converter.value, 0, sizeof(int)); 
         // memcpy(byte_converter.input, can_rx_msg->data, 4 ); 
         
@@ -77,6 +86,7 @@ void processRxMsg(twai_message_t *can_rx_msg, motor_status_t *motor_status )
         break;
 
      case 7:  //TPDO3
+        TRACE_EVENT(TRACE_EV_TPDO_RX, can_rx_msg->identifier);
         // memset(byte_converter.value, 0, sizeof(int)); 
         // memcpy(byte_converter.input, can_rx_msg->data, 2 ); 
         
@@ -214,6 +224,47 @@ void sendSDO(uint8_t node_id, uint8_t command_code, uint16_t index, uint8_t sub_
 
 }
 
+/**
+ * @brief Read an object of the drive with an expedited SDO upload. Answers to
+ *        other requests still in the queue are skipped.
+ *
+ * @param node_id: drive node.
+ * @param index, sub_index: the object.
+ * @param value: set to the value, zero extended, on success.
+ * @return true if the drive answered with the value, false on an abort or after 100 ms.
+ */
+bool readSDO(uint8_t node_id, uint16_t index, uint8_t sub_index, uint32_t *value)
+{
+    twai_message_t can_message_to_send = {.identifier = 0x600 + node_id, .data_length_code = 8};
+
+    can_message_to_send.data[0] = 0x40;
+    memcpy(&can_message_to_send.data[1], &index, 2);
+    can_message_to_send.data[3] = sub_index;
+    ESP_ERROR_CHECK(twai_transmit(&can_message_to_send, portMAX_DELAY));
+
+    sdo_msg_t sdo_msg;
+    while (xQueueReceive(can_sdo_rx_queue, &sdo_msg, 100 / portTICK_PERIOD_MS) == pdPASS)
+    {
+        if (sdo_msg.command_code == 0x80 && sdo_msg.index == index && sdo_msg.sub_index == sub_index)
+        {
+            return false; // Abort
+        }
+        if ((sdo_msg.command_code & 0xE0) != 0x40 || sdo_msg.index != index || sdo_msg.sub_index != sub_index)
+        {
+            continue;
+        }
+        if ((sdo_msg.command_code & 0x03) != 0x03)
+        {
+            return false; // Only expedited uploads with the size given.
+        }
+        // Bits 2..3: bytes of the 4 that hold no data.
+        *value = sdo_msg.data.data_value & (0xFFFFFFFF >> (8 * ((sdo_msg.command_code >> 2) & 3)));
+        processSDOMsg(sdo_msg);
+        return true;
+    }
+    return false;
+}
+
 /**
  * @brief 处理SDO msg, 特别是读取的信息。 
  *
@@ -14,6 +14,8 @@
 #include "esp_log.h"
 #include "driver/twai.h"
 #include "stateMachine.h"
+#include "control_rate.h"
+#include "sdkconfig.h"
 
 //Example Configuration
 // #define PING_PERIOD_MS          250
@@ -40,14 +42,21 @@ static const twai_message_t ping_message = {.identifier = ID_MASTER_PING, .data_
                                            .ss = 1, .data = {0, 0 , 0 , 0 ,0 ,0 ,0 ,0}};
 
 
+#if CONFIG_TR_CAN_BITRATE == 1000000
+static const twai_timing_config_t t_config = TWAI_TIMING_CONFIG_1MBITS();
+#elif CONFIG_TR_CAN_BITRATE == 500000
+static const twai_timing_config_t t_config = TWAI_TIMING_CONFIG_500KBITS();
+#else
 static const twai_timing_config_t t_config = TWAI_TIMING_CONFIG_250KBITS();
+#endif
 static const twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
 static const twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(TX_GPIO_NUM, RX_GPIO_NUM, TWAI_MODE_NORMAL);
 
 // static motor_status_t motor_status; 
 
-QueueHandle_t can_sdo_rx_queue; 
-QueueHandle_t motor_status_queue; 
+// Created from static storage in rtos_objects.c.
+extern QueueHandle_t can_sdo_rx_queue; 
+extern QueueHandle_t motor_status_queue; 
 
 // Define the struct type for sdo message. 
 typedef struct {
@@ -63,7 +72,7 @@ typedef struct {
 } sdo_msg_t; 
 
 bool motor_enabled_flag ;
-static SemaphoreHandle_t sem_motor_enabled; 
+extern SemaphoreHandle_t sem_motor_enabled; 
 
 
 // These flags are used for sync for the processing task.
@@ -81,4 +90,5 @@ void sendSDO(uint8_t node_id, uint8_t command_code, uint16_t index, uint8_t sub_
 
 void processRxMsg(twai_message_t *can_rx_msg, motor_status_t *motor_status);
 void sendGenCan(uint32_t id, uint8_t data_length, uint8_t* data_msg) ;
-void processSDOMsg(sdo_msg_t sdo_msg); 
\ No newline at end of file
+void processSDOMsg(sdo_msg_t sdo_msg); 
+bool readSDO(uint8_t node_id, uint16_t index, uint8_t sub_index, uint32_t *value);
\ No newline at end of file
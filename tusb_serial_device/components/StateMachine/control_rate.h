@@ -0,0 +1,30 @@
+/*
+ * control_rate.h
+ *
+ * Control rate, CONFIG_TR_CONTROL_RATE_HZ: 250, 500 or 1000 SYNCs per
+ * second. Filters and debounces that count cycles are sized from a time span
+ * with CONTROL_CYCLES(), so they keep their time constants at any rate; at
+ * 250 Hz they come out as the counts the firmware always used.
+ *
+ * A cycle puts the SYNC, TPDO1..3 and RPDO1..2 on the bus;
+ * CONTROL_CAN_BITS_PER_CYCLE has to fit in CONTROL_CAN_MAX_LOAD_PCT of the
+ * period at the TWAI bitrate (checked in can_open_comm.c).
+ */
+
+#ifndef CONTROL_RATE_H_
+#define CONTROL_RATE_H_
+
+#include <sys/param.h>
+#include "sdkconfig.h"
+
+#define CONTROL_RATE_HZ             CONFIG_TR_CONTROL_RATE_HZ
+#define CONTROL_PERIOD_US           (1000000 / CONTROL_RATE_HZ)
+
+// Cycles in a time span, rounded, at least 1.
+#define CONTROL_CYCLES(us)          MAX(1, ((us) + CONTROL_PERIOD_US / 2) / CONTROL_PERIOD_US)
+
+// SYNC, TPDO1..3 with 6, 6 and 4 bytes, RPDO1..2 with 7: 47 bits plus 8 per byte each, plus 20 % stuffing.
+#define CONTROL_CAN_BITS_PER_CYCLE  630
+#define CONTROL_CAN_MAX_LOAD_PCT    75
+
+#endif /* CONTROL_RATE_H_ */
@@ -0,0 +1,176 @@
+/*
+ * deadline_monitor.c
+ *
+ * Control cycle deadline accounting and degradation. See deadline_monitor.h.
+ */
+
+#include "deadline_monitor.h"
+#include "pc_command.h"
+#include "trace.h"
+#include "stateMachine.h"
+
+static const char *TAG = "deadline";
+
+_Static_assert(DEADLINE_WINDOW <= 64, "The miss window is a 64 bit mask");
+
+// Cycle start from the SYNC task, output from the RPDO task.
+static portMUX_TYPE deadline_lock = portMUX_INITIALIZER_UNLOCKED;
+static deadline_stats_t stats;
+static int64_t cycle_start_us;
+static bool cycle_done = true;
+static uint64_t window_bits;
+static uint32_t cycles_at_level;
+static uint32_t clean_cycles;
+
+static inline uint8_t deadline_window_misses(void)
+{
+    return (uint8_t)__builtin_popcountll(window_bits);
+}
+
+void deadline_monitor_init(void)
+{
+    portENTER_CRITICAL(&deadline_lock);
+    memset(&stats, 0, sizeof(stats));
+    stats.period_us = DEADLINE_PERIOD_US;
+    cycle_start_us = 0;
+    cycle_done = true;
+    window_bits = 0;
+    cycles_at_level = 0;
+    clean_cycles = 0;
+    portEXIT_CRITICAL(&deadline_lock);
+}
+
+// Called with the lock held, once per cycle.
+static bool deadline_update_level(void)
+{
+    uint8_t misses = deadline_window_misses();
+    deadline_level_t level = stats.level;
+
+    cycles_at_level++;
+    clean_cycles = (window_bits & 1) ? 0 : clean_cycles + 1;
+
+    if (misses >= DEADLINE_ESCALATE_MISSES && cycles_at_level >= DEADLINE_WINDOW && level < DEADLINE_MAX_LEVEL)
+    {
+        level++;
+    }
+    else if (level != DEADLINE_LEVEL_NORMAL && level != DEADLINE_LEVEL_SAFE && clean_cycles >= DEADLINE_RECOVER_CYCLES)
+    {
+        level--;
+    }
+
+    if (level == stats.level)
+    {
+        return false;
+    }
+
+    stats.level = level;
+    stats.period_us = (level >= DEADLINE_LEVEL_SLOW_SYNC) ? 2 * DEADLINE_PERIOD_US : DEADLINE_PERIOD_US;
+    // The new level gets a whole window before it is judged.
+    window_bits = 0;
+    cycles_at_level = 0;
+    clean_cycles = 0;
+    return true;
+}
+
+/**
+ * @brief A SYNC has been sent. Closes the previous cycle.
+ */
+void deadline_cycle_start(int64_t now_us)
+{
+    bool missed;
+    bool level_changed = false;
+
+    portENTER_CRITICAL(&deadline_lock);
+    missed = (cycle_start_us != 0 && !cycle_done);
+    if (cycle_start_us != 0)
+    {
+        stats.cycles++;
+        stats.missed += missed;
+        window_bits = (window_bits << 1) | missed;
+#if DEADLINE_WINDOW < 64
+        window_bits &= (1ULL << DEADLINE_WINDOW) - 1;
+#endif
+        level_changed = deadline_update_level();
+        stats.window_misses = deadline_window_misses();
+    }
+    cycle_start_us = now_us;
+    cycle_done = false;
+    deadline_level_t level = stats.level;
+    portEXIT_CRITICAL(&deadline_lock);
+
+    if (missed)
+    {
+        trace_trigger(TRACE_TRIG_DEADLINE);
+    }
+    if (level_changed)
+    {
+        ESP_LOGW(TAG, "Degradation level %d", level);
+    }
+}
+
+/**
+ * @brief The RPDOs of a cycle have been sent.
+ *
+ * @param input_us: reception time of the TPDO1 the output was computed from.
+ * @param now_us: time the RPDOs went out.
+ */
+void deadline_cycle_output(int64_t input_us, int64_t now_us)
+{
+    portENTER_CRITICAL(&deadline_lock);
+    if (input_us < cycle_start_us)
+    {
+        // Computed from the TPDOs of an earlier cycle, already counted as missed.
+        stats.late++;
+    }
+    else if (!cycle_done)
+    {
+        cycle_done = true;
+        stats.max_cycle_latency_us = MAX(stats.max_cycle_latency_us, (uint32_t)(now_us - cycle_start_us));
+    }
+    stats.last_io_latency_us = (uint32_t)(now_us - input_us);
+    stats.max_io_latency_us = MAX(stats.max_io_latency_us, stats.last_io_latency_us);
+    portEXIT_CRITICAL(&deadline_lock);
+}
+
+deadline_level_t deadline_level(void)
+{
+    return (deadline_level_t)stats.level;
+}
+
+uint32_t deadline_sync_period_us(void)
+{
+    return stats.period_us;
+}
+
+void deadline_get_stats(deadline_stats_t *out)
+{
+    portENTER_CRITICAL(&deadline_lock);
+    memcpy(out, &stats, sizeof(deadline_stats_t));
+    portEXIT_CRITICAL(&deadline_lock);
+}
+
+uint8_t deadline_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    deadline_get_stats((deadline_stats_t *)reply);
+    *reply_len = sizeof(deadline_stats_t);
+    return PC_CMD_OK;
+}
+
+/**
+ * @brief Leave the degraded levels, including the latched zero torque, and
+ *        clear the maxima. The counters keep running.
+ */
+uint8_t deadline_cmd_reset(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    portENTER_CRITICAL(&deadline_lock);
+    stats.level = DEADLINE_LEVEL_NORMAL;
+    stats.period_us = DEADLINE_PERIOD_US;
+    stats.max_io_latency_us = 0;
+    stats.max_cycle_latency_us = 0;
+    window_bits = 0;
+    cycles_at_level = 0;
+    clean_cycles = 0;
+    portEXIT_CRITICAL(&deadline_lock);
+    ESP_LOGI(TAG, "Reset to normal");
+    return PC_CMD_OK;
+}
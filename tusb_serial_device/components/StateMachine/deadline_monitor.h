@@ -0,0 +1,61 @@
+/*
+ * deadline_monitor.h
+ *
+ * Control cycle deadline monitor. A cycle starts with the SYNC and ends when
+ * the RPDOs computed from its TPDOs are on the bus. A cycle without output
+ * before the next SYNC is missed; an output that only comes after the next
+ * SYNC is also counted late. When misses pile up, the degradation level goes
+ * up one step at a time, each step enabled up to CONFIG_TR_DEADLINE_MAX_LEVEL:
+ *   DEADLINE_LEVEL_NO_TELEMETRY  only every DEADLINE_TELEMETRY_DECIMATION'th frame to the PC
+ *   DEADLINE_LEVEL_SLOW_SYNC     SYNC period doubled
+ *   DEADLINE_LEVEL_SAFE          zero torque, latched until PC_CMD_DEADLINE_RESET
+ * A clean window lowers the level again, except from SAFE.
+ */
+
+#ifndef DEADLINE_MONITOR_H_
+#define DEADLINE_MONITOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "control_rate.h"
+
+#define DEADLINE_PERIOD_US              CONTROL_PERIOD_US
+// Cycles over which misses are counted, at most 64.
+#define DEADLINE_WINDOW                 64
+#define DEADLINE_ESCALATE_MISSES        CONFIG_TR_DEADLINE_ESCALATE_MISSES
+// Clean cycles before the level is lowered by one.
+#define DEADLINE_RECOVER_CYCLES         CONFIG_TR_DEADLINE_RECOVER_CYCLES
+#define DEADLINE_MAX_LEVEL              CONFIG_TR_DEADLINE_MAX_LEVEL
+#define DEADLINE_TELEMETRY_DECIMATION   10
+
+typedef enum {
+    DEADLINE_LEVEL_NORMAL = 0,
+    DEADLINE_LEVEL_NO_TELEMETRY,
+    DEADLINE_LEVEL_SLOW_SYNC,
+    DEADLINE_LEVEL_SAFE,
+} deadline_level_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t cycles;
+    uint32_t missed;            // Cycles without output before the next SYNC.
+    uint32_t late;              // Outputs sent after the next SYNC.
+    uint32_t last_io_latency_us;    // TPDO1 reception to RPDOs sent.
+    uint32_t max_io_latency_us;
+    uint32_t max_cycle_latency_us;  // SYNC to RPDOs sent.
+    uint32_t period_us;         // Current SYNC period.
+    uint8_t window_misses;      // Misses in the last DEADLINE_WINDOW cycles.
+    uint8_t level;              // deadline_level_t.
+} deadline_stats_t;
+
+void deadline_monitor_init(void);
+void deadline_cycle_start(int64_t now_us);
+void deadline_cycle_output(int64_t input_us, int64_t now_us);
+deadline_level_t deadline_level(void);
+uint32_t deadline_sync_period_us(void);
+void deadline_get_stats(deadline_stats_t *stats);
+
+uint8_t deadline_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+uint8_t deadline_cmd_reset(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+#endif /* DEADLINE_MONITOR_H_ */
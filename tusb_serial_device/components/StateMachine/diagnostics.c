@@ -0,0 +1,151 @@
+/*
+ * diagnostics.c
+ *
+ * Runtime telemetry task. See diagnostics.h.
+ */
+
+#include "diagnostics.h"
+#include "pc_command.h"
+#include "pc_link.h"
+#include "deadline_monitor.h"
+#include "heartbeat.h"
+#include "stateMachine.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "diagnostics";
+
+#ifdef CONFIG_FREERTOS_USE_TRACE_FACILITY
+static TaskStatus_t task_status[DIAG_MAX_TASKS];
+
+// Run time counters of the previous report, to turn totals into shares of the period.
+static struct {
+    TaskHandle_t handle;
+    uint32_t run_time;
+} previous[DIAG_MAX_TASKS];
+static uint32_t previous_count;
+static uint32_t previous_total;
+
+static uint32_t diag_previous_run_time(TaskHandle_t handle, bool *found)
+{
+    for (uint32_t i = 0; i < previous_count; i++)
+    {
+        if (previous[i].handle == handle)
+        {
+            *found = true;
+            return previous[i].run_time;
+        }
+    }
+    *found = false;
+    return 0;
+}
+#endif
+
+static void diag_send_heap(void)
+{
+    diag_heap_report_t report = {
+        .uptime_ms = (uint32_t)(esp_timer_get_time() / 1000),
+        .free_8bit = heap_caps_get_free_size(MALLOC_CAP_8BIT),
+        .min_free_8bit = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+        .free_internal = heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+        .min_free_internal = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+        .largest_internal = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+        .free_spiram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+        .min_free_spiram = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM),
+    };
+
+    pc_link_send_service(PC_REPORT_DIAG_HEAP, (const uint8_t *)&report, sizeof(report));
+
+#ifdef CONFIG_TR_DIAG_LOG_CONSOLE
+    ESP_LOGI(TAG, "heap free %u (min %u), internal %u (min %u, largest %u)", report.free_8bit,
+             report.min_free_8bit, report.free_internal, report.min_free_internal, report.largest_internal);
+#endif
+}
+
+#ifdef CONFIG_FREERTOS_USE_TRACE_FACILITY
+static void diag_send_tasks(void)
+{
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(task_status, DIAG_MAX_TASKS, &total);
+    if (count == 0)
+    {
+        ESP_LOGW(TAG, "More than %d tasks, raise DIAG_MAX_TASKS", DIAG_MAX_TASKS);
+        return;
+    }
+
+    uint32_t period = total - previous_total;
+
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        const TaskStatus_t *status = &task_status[i];
+        diag_task_report_t report = {0};
+
+        strncpy(report.name, status->pcTaskName, DIAG_TASK_NAME_LEN);
+        report.stack_free_min = (uint16_t)MIN(status->usStackHighWaterMark, UINT16_MAX);
+        report.priority = (uint8_t)status->uxCurrentPriority;
+        report.state = (uint8_t)status->eCurrentState;
+        report.index = (uint8_t)i;
+        report.count = (uint8_t)count;
+#ifdef CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        report.core = (status->xCoreID == tskNO_AFFINITY) ? DIAG_CORE_ANY : (uint8_t)status->xCoreID;
+#else
+        report.core = DIAG_CORE_ANY;
+#endif
+
+        report.cpu_permille = UINT16_MAX;
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        bool found;
+        uint32_t last = diag_previous_run_time(status->xHandle, &found);
+        if (found && previous_total != 0 && period > 0)
+        {
+            uint64_t share = (uint64_t)(status->ulRunTimeCounter - last) * 1000 / period;
+            report.cpu_permille = (uint16_t)MIN(share, 1000);
+        }
+#endif
+
+        pc_link_send_service(PC_REPORT_DIAG_TASK, (const uint8_t *)&report, sizeof(report));
+
+#ifdef CONFIG_TR_DIAG_LOG_CONSOLE
+        ESP_LOGI(TAG, "%-16.16s core %3d prio %2d cpu %4d/1000 stack free %5d", report.name,
+                 report.core == DIAG_CORE_ANY ? -1 : report.core, report.priority,
+                 report.cpu_permille == UINT16_MAX ? -1 : report.cpu_permille, report.stack_free_min);
+#endif
+    }
+
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        previous[i].handle = task_status[i].xHandle;
+        previous[i].run_time = task_status[i].ulRunTimeCounter;
+    }
+    previous_count = count;
+    previous_total = total;
+}
+#endif
+
+/**
+ * @brief Collects and sends the telemetry every DIAG_PERIOD_MS. Runs at the
+ *        lowest priority; it only reads the scheduler state and writes to the
+ *        PC link TX ring buffer.
+ */
+void diagnostics_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+
+    while (1)
+    {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(DIAG_PERIOD_MS));
+
+        diag_send_heap();
+
+        deadline_stats_t deadline;
+        deadline_get_stats(&deadline);
+        pc_link_send_service(PC_REPORT_DIAG_DEADLINE, (const uint8_t *)&deadline, sizeof(deadline));
+#ifdef CONFIG_TR_HEARTBEAT
+        heartbeat_stats_t heartbeat;
+        heartbeat_get_stats(&heartbeat);
+        pc_link_send_service(PC_REPORT_DIAG_HEARTBEAT, (const uint8_t *)&heartbeat, sizeof(heartbeat));
+#endif
+#ifdef CONFIG_FREERTOS_USE_TRACE_FACILITY
+        diag_send_tasks();
+#endif
+    }
+}
@@ -0,0 +1,46 @@
+/*
+ * diagnostics.h
+ *
+ * Low rate runtime telemetry: CPU share, stack high water mark and core of
+ * every task, and free/minimum free heap, streamed to the PC as service
+ * frames (PC_REPORT_DIAG_*). CPU shares need the FreeRTOS trace facility and
+ * run time stats (sdkconfig.defaults); without them only the stack and heap
+ * figures are sent.
+ */
+
+#ifndef DIAGNOSTICS_H_
+#define DIAGNOSTICS_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#define DIAG_PERIOD_MS          CONFIG_TR_DIAG_PERIOD_MS
+#define DIAG_MAX_TASKS          24
+#define DIAG_TASK_NAME_LEN      16
+#define DIAG_CORE_ANY           0xFF
+
+typedef struct __attribute__((packed)) {
+    uint32_t uptime_ms;
+    uint32_t free_8bit;
+    uint32_t min_free_8bit;
+    uint32_t free_internal;
+    uint32_t min_free_internal;
+    uint32_t largest_internal;  // Largest free internal block, shows fragmentation.
+    uint32_t free_spiram;       // 0 without PSRAM.
+    uint32_t min_free_spiram;
+} diag_heap_report_t;
+
+typedef struct __attribute__((packed)) {
+    char name[DIAG_TASK_NAME_LEN]; // Not terminated when it uses all 16 bytes.
+    uint16_t cpu_permille;      // Share of one core over the last period, 0xFFFF if unknown.
+    uint16_t stack_free_min;    // High water mark, bytes never used.
+    uint8_t core;               // 0, 1 or DIAG_CORE_ANY.
+    uint8_t priority;
+    uint8_t state;              // eTaskState.
+    uint8_t index;              // Position in this report.
+    uint8_t count;              // Tasks in this report.
+} diag_task_report_t;
+
+void diagnostics_task(void *arg);
+
+#endif /* DIAGNOSTICS_H_ */
@@ -0,0 +1,117 @@
+/*
+ * drive_pdo.c
+ *
+ * Drive PDO communication parameters for the control rate. See drive_pdo.h.
+ */
+
+#include <string.h>
+#include "drive_pdo.h"
+#include "pc_command.h"
+#include "can_open_comm.h"
+#include "control_rate.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+static const char *TAG = "drive_pdo";
+
+_Static_assert(sizeof(drive_pdo_report_t) <= PC_CMD_REPLY_MAX, "drive_pdo_report_t does not fit a reply");
+
+#define DRIVE_PDO_TYPE_SYNC         1           // Every SYNC.
+#define DRIVE_PDO_TYPE_EVENT        0xFF        // Manufacturer specific, on reception for the Kinco.
+#define DRIVE_PDO_COB_INVALID       0x80000000  // COB-ID bit 31: PDO does not exist.
+
+// Written by driver_init_task, read by the PC task.
+static portMUX_TYPE drive_pdo_lock = portMUX_INITIALIZER_UNLOCKED;
+static drive_pdo_report_t report = {.rate_hz = CONTROL_RATE_HZ};
+
+// Read a parameter back and compare it. value is set to what was read, 0 if nothing was.
+static bool drive_pdo_check(uint8_t node_id, uint16_t index, uint8_t sub_index, uint32_t expected, uint32_t *value)
+{
+    *value = 0;
+    if (!readSDO(node_id, index, sub_index, value))
+    {
+        ESP_LOGE(TAG, "%04x sub %d: no answer", index, sub_index);
+        return false;
+    }
+    if (*value != expected)
+    {
+        ESP_LOGE(TAG, "%04x sub %d: reads 0x%x, written 0x%x", index, sub_index, *value, expected);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Set and read back the PDO communication parameters. The drive has to
+ *        be pre-operational.
+ *
+ * @param node_id: drive node.
+ * @return true if every parameter reads back as written.
+ */
+bool drive_pdo_configure(uint8_t node_id)
+{
+    drive_pdo_report_t result = {.rate_hz = CONTROL_RATE_HZ};
+    int mismatches = 0;
+
+    for (int i = 0; i < DRIVE_PDO_TPDOS + DRIVE_PDO_RPDOS; i++)
+    {
+        bool tpdo = i < DRIVE_PDO_TPDOS;
+        uint16_t index = tpdo ? 0x1800 + i : 0x1400 + (i - DRIVE_PDO_TPDOS);
+        uint8_t type = tpdo ? DRIVE_PDO_TYPE_SYNC : DRIVE_PDO_TYPE_EVENT;
+        uint32_t cob_id, value;
+
+        if (!readSDO(node_id, index, 1, &cob_id))
+        {
+            ESP_LOGE(TAG, "%04x: no COB-ID", index);
+            mismatches++;
+            continue;
+        }
+        cob_id &= ~DRIVE_PDO_COB_INVALID;
+
+        // The inhibit time may only change while the PDO does not exist.
+        sendSDO(node_id, 0x23, index, 1, cob_id | DRIVE_PDO_COB_INVALID);
+        sendSDO(node_id, 0x2F, index, 2, type);
+        if (tpdo)
+        {
+            sendSDO(node_id, 0x2B, index, 3, 0); // Inhibit time: none, the SYNC paces the TPDOs.
+            sendSDO(node_id, 0x2B, index, 5, 0); // Event timer: off, nothing between SYNCs.
+        }
+        sendSDO(node_id, 0x23, index, 1, cob_id);
+
+        mismatches += !drive_pdo_check(node_id, index, 1, cob_id, &value);
+        mismatches += !drive_pdo_check(node_id, index, 2, type, &value);
+        if (tpdo)
+        {
+            result.tpdo_type[i] = (uint8_t)value;
+            mismatches += !drive_pdo_check(node_id, index, 3, 0, &value);
+            result.tpdo_inhibit[i] = (uint16_t)value;
+            mismatches += !drive_pdo_check(node_id, index, 5, 0, &value);
+            result.tpdo_event_ms[i] = (uint16_t)value;
+        }
+        else
+        {
+            result.rpdo_type[i - DRIVE_PDO_TPDOS] = (uint8_t)value;
+        }
+    }
+
+    result.mismatches = (uint8_t)mismatches;
+    result.configured = (mismatches == 0);
+    portENTER_CRITICAL(&drive_pdo_lock);
+    report = result;
+    portEXIT_CRITICAL(&drive_pdo_lock);
+
+    if (mismatches == 0)
+    {
+        ESP_LOGI(TAG, "PDOs set for %d Hz", CONTROL_RATE_HZ);
+    }
+    return mismatches == 0;
+}
+
+uint8_t drive_pdo_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    portENTER_CRITICAL(&drive_pdo_lock);
+    memcpy(reply, &report, sizeof(report));
+    portEXIT_CRITICAL(&drive_pdo_lock);
+    *reply_len = sizeof(report);
+    return PC_CMD_OK;
+}
@@ -0,0 +1,40 @@
+/*
+ * drive_pdo.h
+ *
+ * PDO communication parameters of the drive, set over SDO at bring-up so the
+ * cycle no longer depends on how the drive was configured by hand:
+ *   TPDO1..3 (0x1800..0x1802)  transmission type 1, sent on every SYNC;
+ *                              no inhibit time, event timer off
+ *   RPDO1..2 (0x1400..0x1401)  transmission type 0xFF, applied on reception:
+ *                              the RPDOs go out within the cycle, a synchronous
+ *                              RPDO would only act at the next SYNC
+ * Each PDO is made invalid while it is changed, then every parameter is read
+ * back. The mapping is left as it is. Nothing is stored in the drive; it is
+ * set again after every reset.
+ */
+
+#ifndef DRIVE_PDO_H_
+#define DRIVE_PDO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define DRIVE_PDO_TPDOS             3
+#define DRIVE_PDO_RPDOS             2
+
+typedef struct __attribute__((packed)) {
+    uint16_t rate_hz;           // CONTROL_RATE_HZ
+    uint8_t configured;         // 1 once every parameter read back as written.
+    uint8_t mismatches;         // Parameters that read back different, or could not be read.
+    uint8_t tpdo_type[DRIVE_PDO_TPDOS];     // Read back.
+    uint16_t tpdo_inhibit[DRIVE_PDO_TPDOS]; // 100 us
+    uint16_t tpdo_event_ms[DRIVE_PDO_TPDOS];
+    uint8_t rpdo_type[DRIVE_PDO_RPDOS];
+} drive_pdo_report_t;
+
+bool drive_pdo_configure(uint8_t node_id);
+
+uint8_t drive_pdo_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+#endif /* DRIVE_PDO_H_ */
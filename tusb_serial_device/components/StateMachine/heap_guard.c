@@ -0,0 +1,89 @@
+/*
+ * heap_guard.c
+ *
+ * Steady state allocation logger. See heap_guard.h.
+ */
+
+#include "heap_guard.h"
+
+#ifdef CONFIG_TR_HEAP_GUARD
+
+#include "stateMachine.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_trace.h"
+
+static const char *TAG = "heap_guard";
+
+static heap_trace_record_t trace_records[HEAP_GUARD_RECORDS];
+static uint32_t allocations;
+
+static void heap_guard_failed_alloc(size_t size, uint32_t caps, const char *function_name)
+{
+    // Runs in the context of the failed call, keep it to one line.
+    ESP_LOGE(TAG, "%s: %u bytes with caps 0x%x failed", function_name, size, caps);
+}
+
+static void heap_guard_log(const heap_trace_record_t *record)
+{
+    allocations++;
+    ESP_LOGW(TAG, "%u bytes at %p, %s, called from %p %p", record->size, record->address,
+             (record->freed_by[0] != NULL) ? "freed" : "held",
+             record->alloced_by[0], (CONFIG_HEAP_TRACING_STACK_DEPTH > 1) ? record->alloced_by[1] : NULL);
+}
+
+/**
+ * @brief Log the allocations recorded since the last poll. Tracing is stopped
+ *        while the records are read, so the logging itself is not recorded;
+ *        restarting clears the buffer. An allocation in that short window is
+ *        missed.
+ */
+static void heap_guard_poll(void)
+{
+    heap_trace_record_t record;
+
+    heap_trace_stop();
+    size_t count = heap_trace_get_count();
+    for (size_t i = 0; i < count; i++)
+    {
+        if (heap_trace_get(i, &record) == ESP_OK && record.address != NULL)
+        {
+            heap_guard_log(&record);
+        }
+    }
+    if (count == HEAP_GUARD_RECORDS)
+    {
+        // The buffer may have dropped the oldest records.
+        ESP_LOGW(TAG, "Record buffer full, raise TR_HEAP_GUARD_RECORDS");
+    }
+    if (count > 0)
+    {
+        ESP_LOGW(TAG, "%u allocations since startup", allocations);
+    }
+    ESP_ERROR_CHECK(heap_trace_start(HEAP_TRACE_ALL));
+}
+
+void heap_guard_task(void *arg)
+{
+    vTaskDelay(pdMS_TO_TICKS(HEAP_GUARD_SETTLE_MS));
+    ESP_LOGI(TAG, "Startup done, logging every allocation from now on");
+    ESP_ERROR_CHECK(heap_trace_start(HEAP_TRACE_ALL));
+
+    while (1)
+    {
+        vTaskDelay(pdMS_TO_TICKS(HEAP_GUARD_POLL_MS));
+        heap_guard_poll();
+    }
+}
+
+/**
+ * @brief Call before the tasks are started. heap_guard_task starts tracing
+ *        HEAP_GUARD_SETTLE_MS later, after the tasks have run their own
+ *        initialisation.
+ */
+void heap_guard_start(void)
+{
+    ESP_ERROR_CHECK(heap_caps_register_failed_alloc_callback(heap_guard_failed_alloc));
+    ESP_ERROR_CHECK(heap_trace_init_standalone(trace_records, HEAP_GUARD_RECORDS));
+}
+
+#endif /* CONFIG_TR_HEAP_GUARD */
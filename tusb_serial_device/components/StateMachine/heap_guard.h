@@ -0,0 +1,33 @@
+/*
+ * heap_guard.h
+ *
+ * Debug check that the steady state does not allocate. Once startup has
+ * settled, heap tracing (CONFIG_HEAP_TRACING_STANDALONE) records every
+ * allocation, and a low priority task logs each one with its size and the
+ * return addresses of its caller, which idf.py monitor decodes to
+ * file:line. Allocations that fail are logged whenever the guard is built in.
+ * Built only with CONFIG_TR_HEAP_GUARD; otherwise heap_guard_start()
+ * compiles to nothing.
+ */
+
+#ifndef HEAP_GUARD_H_
+#define HEAP_GUARD_H_
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_TR_HEAP_GUARD
+
+#define HEAP_GUARD_SETTLE_MS    CONFIG_TR_HEAP_GUARD_SETTLE_MS
+#define HEAP_GUARD_RECORDS      CONFIG_TR_HEAP_GUARD_RECORDS
+#define HEAP_GUARD_POLL_MS      1000
+
+void heap_guard_start(void);
+void heap_guard_task(void *arg);
+
+#else
+
+#define heap_guard_start()      ((void)0)
+
+#endif /* CONFIG_TR_HEAP_GUARD */
+
+#endif /* HEAP_GUARD_H_ */
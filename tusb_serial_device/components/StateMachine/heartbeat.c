@@ -0,0 +1,203 @@
+/*
+ * heartbeat.c
+ *
+ * PC command freshness and the local fallback controller. See heartbeat.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "heartbeat.h"
+#include "pc_command.h"
+
+_Static_assert(sizeof(heartbeat_stats_t) <= PC_CMD_REPLY_MAX, "heartbeat_stats_t does not fit a reply");
+
+#ifdef CONFIG_TR_HEARTBEAT
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "stateMachine.h"
+#include "deadline_monitor.h"
+
+static const char *TAG = "heartbeat";
+
+#define HEARTBEAT_RAMP_STEP         ((int32_t)((int64_t)HEARTBEAT_RAMP_PER_MS * DEADLINE_PERIOD_US / 1000))
+#define HEARTBEAT_RESUME_CYCLES     MAX(1, HEARTBEAT_RESUME_MS * 1000 / DEADLINE_PERIOD_US)
+// Running means over about 16 frames.
+#define HEARTBEAT_MEAN_SHIFT        4
+
+// Frames and cycles from the process task, the stats also from the PC and diagnostics tasks.
+static portMUX_TYPE heartbeat_lock = portMUX_INITIALIZER_UNLOCKED;
+static heartbeat_stats_t stats;
+
+// Process task only.
+static int64_t last_frame_us;
+static int64_t fallback_start_us;
+static int32_t last_current;        // Current sent in the previous cycle, drive frame.
+static int32_t hold_position;
+static int32_t resume_current;
+static int32_t resume_speed;
+static int32_t resume_position;
+static uint32_t resume_cycle;
+
+/**
+ * @brief A command frame has come in from the PC.
+ */
+void heartbeat_pc_frame(int64_t now_us)
+{
+    portENTER_CRITICAL(&heartbeat_lock);
+    if (stats.frames > 0)
+    {
+        uint32_t gap = (uint32_t)MIN(now_us - last_frame_us, (int64_t)UINT32_MAX);
+        int32_t deviation = (int32_t)(gap - stats.mean_gap_us);
+
+        stats.gaps += (stats.frames > 1 && gap > 2 * stats.mean_gap_us);
+        stats.max_gap_us = MAX(stats.max_gap_us, gap);
+        if (stats.frames == 1)
+        {
+            stats.mean_gap_us = gap;
+        }
+        else
+        {
+            stats.mean_gap_us += deviation >> HEARTBEAT_MEAN_SHIFT;
+            stats.jitter_us += ((int32_t)abs(deviation) - (int32_t)stats.jitter_us) >> HEARTBEAT_MEAN_SHIFT;
+        }
+    }
+    stats.frames++;
+    portEXIT_CRITICAL(&heartbeat_lock);
+    last_frame_us = now_us;
+}
+
+static void heartbeat_set_mode(heartbeat_mode_t mode, int64_t now_us)
+{
+    portENTER_CRITICAL(&heartbeat_lock);
+    if (stats.mode == HEARTBEAT_FALLBACK)
+    {
+        stats.fallback_ms += (uint32_t)((now_us - fallback_start_us) / 1000);
+    }
+    if (mode == HEARTBEAT_FALLBACK)
+    {
+        stats.timeouts++;
+        fallback_start_us = now_us;
+    }
+    stats.mode = mode;
+    portEXIT_CRITICAL(&heartbeat_lock);
+}
+
+// Ramp to zero or spring and damper, reached from the last current at most HEARTBEAT_RAMP_STEP per cycle.
+static void heartbeat_fallback(target_motor_para_t *target, int32_t position, int32_t speed)
+{
+    int32_t goal = 0;
+
+#ifdef CONFIG_TR_HEARTBEAT_FALLBACK_HOLD
+    int64_t hold = -(int64_t)HEARTBEAT_HOLD_STIFFNESS * (position - hold_position) / 1000 -
+                   (int64_t)HEARTBEAT_HOLD_DAMPING * speed / (100 * DRIVE_SPEED_PER_MM_S);
+    goal = (int32_t)MAX(-HEARTBEAT_HOLD_MAX_CURRENT, MIN(hold, HEARTBEAT_HOLD_MAX_CURRENT));
+#endif
+
+    target->control_mode = DRIVE_MODE_TORQUE;
+    target->desired_speed_inc = 0;
+    target->desired_torque = (short)MAX(last_current - HEARTBEAT_RAMP_STEP,
+                                        MIN(goal, last_current + HEARTBEAT_RAMP_STEP));
+}
+
+static inline int32_t heartbeat_blend(int32_t from, int32_t to)
+{
+    return from + (int32_t)(((int64_t)to - from) * resume_cycle / HEARTBEAT_RESUME_CYCLES);
+}
+
+/**
+ * @brief Check the command freshness once per cycle, after main_fsm_function.
+ *        Replaces or blends outputs.target_motor_paras as needed.
+ *
+ * @param state: cur_state after the step.
+ * @param now_us: esp_timer time.
+ * @return true while the local controller is in charge.
+ */
+bool heartbeat_update(enum state_codes state, int64_t now_us)
+{
+    target_motor_para_t *target = &outputs.target_motor_paras;
+    // Drive frame, as the targets: position increments, and the FSM's averaged speed back in the drive's sign.
+    int32_t position = inputs.motor_data.position_inc;
+    int32_t speed = -inputs.motor_data.speed_inc;
+    bool stale = now_us - last_frame_us > HEARTBEAT_TIMEOUT_MS * 1000LL;
+    heartbeat_mode_t mode = stats.mode;
+
+    if (state != run)
+    {
+        mode = HEARTBEAT_FRESH;
+    }
+    else if (stale && mode != HEARTBEAT_FALLBACK)
+    {
+        mode = HEARTBEAT_FALLBACK;
+        hold_position = position;
+        ESP_LOGW(TAG, "No PC command for %d ms, local controller in charge", HEARTBEAT_TIMEOUT_MS);
+    }
+    else if (!stale && mode == HEARTBEAT_FALLBACK)
+    {
+        mode = HEARTBEAT_RESUMING;
+        resume_cycle = 0;
+        resume_current = last_current;
+        resume_speed = speed;
+        resume_position = position;
+        ESP_LOGI(TAG, "PC commands back, resuming");
+    }
+    else if (mode == HEARTBEAT_RESUMING && resume_cycle >= HEARTBEAT_RESUME_CYCLES)
+    {
+        mode = HEARTBEAT_FRESH;
+    }
+
+    if (mode != stats.mode)
+    {
+        heartbeat_set_mode(mode, now_us);
+    }
+
+    if (mode == HEARTBEAT_FALLBACK)
+    {
+        heartbeat_fallback(target, position, speed);
+    }
+    else if (mode == HEARTBEAT_RESUMING)
+    {
+        // From where the fallback left the drive to the state machine's targets.
+        resume_cycle++;
+        if (target->control_mode == DRIVE_MODE_TORQUE)
+        {
+            target->desired_torque = (short)heartbeat_blend(resume_current, target->desired_torque);
+        }
+        else if (target->control_mode == DRIVE_MODE_SPEED)
+        {
+            target->desired_speed_inc = heartbeat_blend(resume_speed, target->desired_speed_inc);
+        }
+        else if (target->control_mode == DRIVE_MODE_POSITION)
+        {
+            target->desired_position_inc = heartbeat_blend(resume_position, target->desired_position_inc);
+        }
+    }
+
+    last_current = (target->control_mode == DRIVE_MODE_TORQUE) ? target->desired_torque
+                                                                   : inputs.motor_data.actual_current;
+    return mode == HEARTBEAT_FALLBACK;
+}
+
+void heartbeat_get_stats(heartbeat_stats_t *report)
+{
+    portENTER_CRITICAL(&heartbeat_lock);
+    *report = stats;
+    portEXIT_CRITICAL(&heartbeat_lock);
+}
+
+uint8_t heartbeat_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    heartbeat_get_stats((heartbeat_stats_t *)reply);
+    *reply_len = sizeof(heartbeat_stats_t);
+    return PC_CMD_OK;
+}
+
+#else
+
+uint8_t heartbeat_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    return PC_CMD_ERR_UNKNOWN;
+}
+
+#endif /* CONFIG_TR_HEARTBEAT */
@@ -0,0 +1,74 @@
+/*
+ * heartbeat.h
+ *
+ * PC command freshness. Every command frame from the PC is a heartbeat; the
+ * gaps between them are measured all the time. In run, when no frame has
+ * come for HEARTBEAT_TIMEOUT_MS, inputs.pc_msg is stale and the targets of
+ * the state machine are replaced by a local controller, in torque mode:
+ *   ramp   the current goes to zero at HEARTBEAT_RAMP_PER_MS
+ *   hold   a spring and damper on the position where the link was lost
+ * When frames come back the state machine's targets are blended in again
+ * over HEARTBEAT_RESUME_MS, starting from the fallback current, or from
+ * the drive's actual speed or position in the other modes.
+ *
+ * Link statistics (heartbeat_stats_t) are read with PC_CMD_HEARTBEAT_GET
+ * and sent with the diagnostics report. Jitter is the running mean of the
+ * deviation of each gap from the mean gap, as the RFC 3550 interarrival
+ * jitter, with the robot's clock only.
+ *
+ * Built only with CONFIG_TR_HEARTBEAT; otherwise the calls compile to
+ * nothing and a stale command is applied as it is, up to the safety
+ * supervisor's PC timeout.
+ */
+
+#ifndef HEARTBEAT_H_
+#define HEARTBEAT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "StateStatusLED.h"
+
+typedef enum {
+    HEARTBEAT_FRESH = 0,
+    HEARTBEAT_FALLBACK,         // Local controller in charge.
+    HEARTBEAT_RESUMING,         // Blending back to the state machine's targets.
+} heartbeat_mode_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t frames;            // Command frames from the PC.
+    uint32_t gaps;              // Gaps longer than twice the mean.
+    uint32_t timeouts;          // Times the fallback took over.
+    uint32_t mean_gap_us;       // Running mean of the time between frames.
+    uint32_t jitter_us;
+    uint32_t max_gap_us;
+    uint32_t fallback_ms;       // Time under the local controller.
+    uint8_t mode;               // heartbeat_mode_t
+} heartbeat_stats_t;
+
+#ifdef CONFIG_TR_HEARTBEAT
+
+#define HEARTBEAT_TIMEOUT_MS        CONFIG_TR_HEARTBEAT_TIMEOUT_MS
+#define HEARTBEAT_RESUME_MS         CONFIG_TR_HEARTBEAT_RESUME_MS
+#define HEARTBEAT_RAMP_PER_MS       CONFIG_TR_HEARTBEAT_RAMP_PER_MS
+#ifdef CONFIG_TR_HEARTBEAT_FALLBACK_HOLD
+#define HEARTBEAT_HOLD_STIFFNESS    CONFIG_TR_HEARTBEAT_HOLD_STIFFNESS  // Current per 1000 inc.
+#define HEARTBEAT_HOLD_DAMPING      CONFIG_TR_HEARTBEAT_HOLD_DAMPING    // Current per 100 mm/s.
+#define HEARTBEAT_HOLD_MAX_CURRENT  CONFIG_TR_HEARTBEAT_HOLD_MAX_CURRENT
+#endif
+
+void heartbeat_pc_frame(int64_t now_us);
+bool heartbeat_update(enum state_codes state, int64_t now_us);
+void heartbeat_get_stats(heartbeat_stats_t *stats);
+
+#else
+
+#define heartbeat_pc_frame(now_us)          ((void)0)
+#define heartbeat_update(state, now_us)     (false)
+
+#endif /* CONFIG_TR_HEARTBEAT */
+
+uint8_t heartbeat_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+#endif /* HEARTBEAT_H_ */
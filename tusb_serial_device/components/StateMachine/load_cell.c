@@ -0,0 +1,316 @@
+/*
+ * load_cell.c
+ *
+ * Load cell acquisition as a slave of the RS485 bus. Replaces the old
+ * tx_task/rx_task pair, which only sent a new request after a 2 s read timeout.
+ */
+
+#include "load_cell.h"
+#include "rs485_bus.h"
+#include "trace.h"
+#include "stateMachine.h"
+
+static const char *TAG = "load_cell";
+
+// Read request for the amplifier at address 1.
+static const uint8_t lc_request[LC_REQUEST_LEN] = {0xFE, 0x1, 0x7, 0x0, 0x1, 0x2, 0x0, 0x1, 0xCF, 0xFC, 0xCC, 0xFF};
+
+static const uint8_t lc_frame_tail[4] = {0xCF, 0xFC, 0xCC, 0xFF};
+
+static lc_parser_t lc_parser;
+static load_cell_stats_t lc_stats;
+
+// Written by the acquisition task, read by the process task on the other core.
+static lc_sample_t lc_history[LC_HISTORY_LEN];
+static uint32_t lc_history_count;
+static portMUX_TYPE lc_history_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t lc_byte_time_us;
+static uint32_t samples_this_second;
+static int64_t rate_window_start_us;
+
+#define LC_RING_MASK (LC_RING_SIZE - 1)
+
+static inline uint32_t lc_ring_count(const lc_parser_t *parser)
+{
+    return parser->head - parser->tail;
+}
+
+static inline uint8_t lc_ring_peek(const lc_parser_t *parser, uint32_t offset)
+{
+    return parser->ring[(parser->tail + offset) & LC_RING_MASK];
+}
+
+void lc_parser_reset(lc_parser_t *parser)
+{
+    memset(parser, 0, sizeof(lc_parser_t));
+}
+
+/**
+ * @brief Append received bytes to the parser ring.
+ *
+ * @return number of bytes taken. Less than len only if the ring is full,
+ *         which means lc_parser_next() is not being called.
+ */
+size_t lc_parser_push(lc_parser_t *parser, const uint8_t *data, size_t len)
+{
+    size_t i;
+    for (i = 0; i < len && lc_ring_count(parser) < LC_RING_SIZE; i++)
+    {
+        parser->ring[parser->head & LC_RING_MASK] = data[i];
+        parser->head++;
+    }
+    parser->overruns += len - i;
+    return i;
+}
+
+// Drop one byte from the front while looking for a frame start.
+static void lc_parser_skip(lc_parser_t *parser)
+{
+    if (parser->in_sync)
+    {
+        parser->resyncs++;
+        parser->in_sync = false;
+    }
+    parser->dropped_bytes++;
+    parser->tail++;
+}
+
+/**
+ * @brief Extract the next valid frame from the ring.
+ *
+ * Scans for FE 01 50, then checks the end of frame marker at the fixed length
+ * and the checksum. A header whose frame does not validate is skipped by one
+ * byte only, so a real frame starting inside it is still found.
+ *
+ * @param[out] value: load cell reading of the frame.
+ * @return true if a frame was extracted.
+ */
+bool lc_parser_next(lc_parser_t *parser, int32_t *value)
+{
+    while (lc_ring_count(parser) >= 3)
+    {
+        if (lc_ring_peek(parser, 0) != LC_FRAME_HEAD ||
+            lc_ring_peek(parser, 1) != LC_FRAME_ADDR ||
+            lc_ring_peek(parser, 2) != LC_FRAME_FUNC_READ)
+        {
+            lc_parser_skip(parser);
+            continue;
+        }
+
+        if (lc_ring_count(parser) < LC_RESPONSE_LEN)
+        {
+            return false; // Wait for the rest of the frame.
+        }
+
+        bool tail_ok = true;
+        for (size_t i = 0; i < sizeof(lc_frame_tail); i++)
+        {
+            tail_ok &= lc_ring_peek(parser, LC_FRAME_TAIL_POS + i) == lc_frame_tail[i];
+        }
+        if (!tail_ok)
+        {
+            parser->rejected_frames++;
+            lc_parser_skip(parser);
+            continue;
+        }
+
+#ifdef CONFIG_TR_LOAD_CELL_VERIFY_CHECKSUM
+        uint16_t sum = 0;
+        for (int i = 1; i < LC_FRAME_CHECKSUM_POS; i++)
+        {
+            sum += lc_ring_peek(parser, i);
+        }
+        uint16_t frame_sum = (lc_ring_peek(parser, LC_FRAME_CHECKSUM_POS) << 8) | lc_ring_peek(parser, LC_FRAME_CHECKSUM_POS + 1);
+        if (sum != frame_sum)
+        {
+            parser->checksum_errors++;
+            lc_parser_skip(parser);
+            continue;
+        }
+#endif
+
+        *value = (int32_t)(((uint32_t)lc_ring_peek(parser, 4) << 24) | ((uint32_t)lc_ring_peek(parser, 5) << 16) |
+                           ((uint32_t)lc_ring_peek(parser, 6) << 8) | (uint32_t)lc_ring_peek(parser, 7));
+        parser->tail += LC_RESPONSE_LEN;
+        parser->in_sync = true;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Bytes still missing for the frame at the front of the ring, at least 1.
+ */
+size_t lc_parser_bytes_needed(const lc_parser_t *parser)
+{
+    uint32_t count = lc_ring_count(parser);
+    return (count < LC_RESPONSE_LEN) ? LC_RESPONSE_LEN - count : 1;
+}
+
+static void load_cell_publish(int32_t value, int64_t time_us)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&lc_history_lock);
+    lc_history[lc_history_count & (LC_HISTORY_LEN - 1)] = (lc_sample_t){.time_us = time_us, .value = value};
+    lc_history_count++;
+    portEXIT_CRITICAL(&lc_history_lock);
+
+    TRACE_EVENT(TRACE_EV_LC_SAMPLE, value);
+    lc_stats.samples++;
+    lc_stats.last_sample_us = time_us;
+
+    samples_this_second++;
+    if (now - rate_window_start_us >= 1000000)
+    {
+        lc_stats.rate_hz = samples_this_second;
+        samples_this_second = 0;
+        rate_window_start_us = now;
+    }
+}
+
+static size_t lc_bytes_needed(void *ctx)
+{
+    return lc_parser_bytes_needed(&lc_parser);
+}
+
+/**
+ * @brief Response bytes from the bus. Every byte goes through the streaming
+ *        parser, whatever the read boundaries are.
+ */
+static bool lc_on_rx(void *ctx, const uint8_t *data, size_t len, int64_t rx_time_us)
+{
+    int32_t value;
+    bool got_sample = false;
+
+    lc_parser_push(&lc_parser, data, len);
+    // In continuous mode several frames may be waiting, take all of them.
+    while (lc_parser_next(&lc_parser, &value))
+    {
+        // The bytes still in the ring arrived after the end of this frame.
+        int64_t frame_time = rx_time_us - (int64_t)(lc_parser.head - lc_parser.tail) * lc_byte_time_us;
+        load_cell_publish(value, frame_time);
+        got_sample = true;
+    }
+    return got_sample;
+}
+
+static void lc_on_timeout(void *ctx)
+{
+    // No response. Keep whatever is in the ring, the next poll asks again.
+    lc_stats.timeouts++;
+}
+
+static rs485_slave_t lc_slave = {
+    .name = "load_cell",
+#ifndef CONFIG_TR_LOAD_CELL_CONTINUOUS
+    .request = lc_request,
+    .request_len = LC_REQUEST_LEN,
+#endif
+    .period_us = CONFIG_TR_LOAD_CELL_POLL_PERIOD_US,
+    .timeout_us = LC_RESPONSE_TIMEOUT_MS * 1000,
+    .turnaround_us = CONFIG_TR_RS485_TURNAROUND_US,
+    .bytes_needed = lc_bytes_needed,
+    .on_rx = lc_on_rx,
+    .on_timeout = lc_on_timeout,
+};
+
+/**
+ * @brief Register the load cell amplifier on the RS485 bus. In polled mode a
+ *        period of 0 sends the next request as soon as the previous response
+ *        has been parsed. rs485_bus_init() must have been called.
+ */
+esp_err_t load_cell_init(void)
+{
+    lc_parser_reset(&lc_parser);
+    lc_byte_time_us = rs485_bus_byte_time_us();
+    rate_window_start_us = esp_timer_get_time();
+    return rs485_bus_add_slave(&lc_slave);
+}
+
+void load_cell_get_stats(load_cell_stats_t *stats)
+{
+    memcpy(stats, &lc_stats, sizeof(load_cell_stats_t));
+    stats->resyncs = lc_parser.resyncs;
+    stats->dropped_bytes = lc_parser.dropped_bytes;
+    stats->rejected_frames = lc_parser.rejected_frames;
+    stats->checksum_errors = lc_parser.checksum_errors;
+
+    stats->last_sample_age_us = (stats->last_sample_us == 0) ? -1 : esp_timer_get_time() - stats->last_sample_us;
+    // No sample for more than two rate windows: the last rate is stale.
+    if (stats->last_sample_age_us < 0 || stats->last_sample_age_us > 2000000)
+    {
+        stats->rate_hz = 0;
+    }
+}
+
+/**
+ * @brief Resample the load cell to a control cycle time, e.g. the reception
+ *        time of the TPDOs of the cycle.
+ *
+ * Between two samples the value is interpolated. Past the newest sample it is
+ * extrapolated from the newest two for at most LC_MAX_EXTRAPOLATION_US, then
+ * held. The confidence drops linearly with the distance to the newest sample.
+ *
+ * @param time_us: esp_timer time to resample at.
+ * @param[out] force: resampled value with its age and confidence.
+ */
+void load_cell_force_at(int64_t time_us, lc_aligned_force_t *force)
+{
+    lc_sample_t history[LC_HISTORY_LEN];
+    uint32_t count;
+
+    portENTER_CRITICAL(&lc_history_lock);
+    count = lc_history_count;
+    memcpy(history, lc_history, sizeof(history));
+    portEXIT_CRITICAL(&lc_history_lock);
+
+    if (count == 0)
+    {
+        force->value = 0;
+        force->age_us = LC_STALE_US;
+        force->confidence = 0;
+        return;
+    }
+
+    uint32_t available = MIN(count, LC_HISTORY_LEN);
+    const lc_sample_t *newest = &history[(count - 1) & (LC_HISTORY_LEN - 1)];
+    int64_t age = time_us - newest->time_us;
+
+    force->age_us = (int32_t)MAX(MIN(age, INT32_MAX), INT32_MIN);
+
+    if (age <= 0)
+    {
+        // Walk back to the pair that brackets the cycle time.
+        for (uint32_t i = 1; i < available; i++)
+        {
+            const lc_sample_t *s1 = &history[(count - i) & (LC_HISTORY_LEN - 1)];
+            const lc_sample_t *s0 = &history[(count - i - 1) & (LC_HISTORY_LEN - 1)];
+            if (s0->time_us <= time_us)
+            {
+                int64_t span = s1->time_us - s0->time_us;
+                force->value = (span > 0) ? s0->value + (int32_t)((int64_t)(s1->value - s0->value) * (time_us - s0->time_us) / span)
+                                          : s1->value;
+                force->confidence = 100;
+                return;
+            }
+        }
+        // Older than the whole history. Should not happen for a cycle time.
+        force->value = history[(count - available) & (LC_HISTORY_LEN - 1)].value;
+        force->confidence = 50;
+        return;
+    }
+
+    force->value = newest->value;
+    if (available >= 2)
+    {
+        const lc_sample_t *previous = &history[(count - 2) & (LC_HISTORY_LEN - 1)];
+        int64_t span = newest->time_us - previous->time_us;
+        if (span > 0)
+        {
+            int64_t horizon = MIN(age, LC_MAX_EXTRAPOLATION_US);
+            force->value += (int32_t)((int64_t)(newest->value - previous->value) * horizon / span);
+        }
+    }
+    force->confidence = (age >= LC_STALE_US) ? 0 : (uint8_t)(100 - age * 100 / LC_STALE_US);
+}
@@ -0,0 +1,107 @@
+/*
+ * load_cell.h
+ *
+ * Acquisition of the interaction force load cell, a slave on the RS485 bus
+ * (rs485_bus.h). In polled mode with a 0 period the next request goes out as
+ * soon as the previous response is in, so the sample rate is set by the baud
+ * rate and the amplifier turnaround. In continuous mode the amplifier streams
+ * on its own and we only listen; it then has to be alone on the bus. Every sample is timestamped at reception and kept in a short
+ * history, so the control cycle can resample the force to its own time.
+ */
+
+#ifndef LOAD_CELL_H_
+#define LOAD_CELL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#define LC_REQUEST_LEN          12
+
+/*
+ * Response frame, 14 bytes:
+ *   [0]     0xFE head
+ *   [1]     amplifier address
+ *   [2]     0x50 read response
+ *   [3]     status
+ *   [4..7]  value, big endian, signed
+ *   [8..9]  checksum: 16 bit sum of bytes 1..7, big endian
+ *   [10..13] 0xCF 0xFC 0xCC 0xFF end of frame
+ */
+#define LC_RESPONSE_LEN         14
+#define LC_FRAME_HEAD           0xFE
+#define LC_FRAME_ADDR           0x01
+#define LC_FRAME_FUNC_READ      0x50
+#define LC_FRAME_CHECKSUM_POS   8
+#define LC_FRAME_TAIL_POS       10
+
+// Power of two. Holds a few frames so nothing is lost while a frame is completed.
+#define LC_RING_SIZE            64
+
+// Response wait before the request is repeated.
+#define LC_RESPONSE_TIMEOUT_MS  10
+
+// Timestamped samples kept for alignment with the control cycle. Power of two.
+#define LC_HISTORY_LEN          8
+// Extrapolation past the newest sample is limited to this, after that the
+// newest value is held.
+#define LC_MAX_EXTRAPOLATION_US 5000
+// Age at which the confidence of the aligned force has dropped to 0.
+#define LC_STALE_US             50000
+
+/**
+ * @brief Streaming parser for the response frames. Bytes are pushed into a
+ *        ring buffer and frames are extracted wherever they start, so a lost
+ *        or extra byte only costs the frame it hits.
+ */
+typedef struct {
+    uint8_t ring[LC_RING_SIZE];
+    uint32_t head;              // Write index, free running.
+    uint32_t tail;              // Read index, free running.
+    bool in_sync;
+
+    uint32_t resyncs;           // Times the parser lost the frame start and scanned for it.
+    uint32_t dropped_bytes;     // Bytes skipped while scanning for a header.
+    uint32_t rejected_frames;   // Header found but end of frame missing.
+    uint32_t checksum_errors;   // Complete frame with a wrong checksum.
+    uint32_t overruns;          // Bytes lost because the ring was full.
+} lc_parser_t;
+
+typedef struct {
+    uint32_t samples;           // Valid samples since boot.
+    uint32_t timeouts;          // Requests without a response.
+    uint32_t resyncs;
+    uint32_t dropped_bytes;
+    uint32_t rejected_frames;
+    uint32_t checksum_errors;
+    uint32_t rate_hz;           // Samples in the last full second.
+    int64_t last_sample_us;     // esp_timer time of the latest sample, 0 if none.
+    int64_t last_sample_age_us; // Age of the latest sample when the stats were read.
+} load_cell_stats_t;
+
+typedef struct {
+    int64_t time_us;            // Reception time of the last byte of the frame.
+    int32_t value;
+} lc_sample_t;
+
+/**
+ * @brief Load cell value resampled to a control cycle time.
+ */
+typedef struct {
+    int32_t value;
+    int32_t age_us;             // Cycle time minus newest sample time. Negative if the sample is newer.
+    uint8_t confidence;         // 100: interpolated between two samples, falls to 0 at LC_STALE_US.
+} lc_aligned_force_t;
+
+void lc_parser_reset(lc_parser_t *parser);
+size_t lc_parser_push(lc_parser_t *parser, const uint8_t *data, size_t len);
+bool lc_parser_next(lc_parser_t *parser, int32_t *value);
+size_t lc_parser_bytes_needed(const lc_parser_t *parser);
+
+esp_err_t load_cell_init(void);
+void load_cell_get_stats(load_cell_stats_t *stats);
+void load_cell_force_at(int64_t time_us, lc_aligned_force_t *force);
+
+#endif /* LOAD_CELL_H_ */
@@ -0,0 +1,394 @@
+/*
+ * load_cell_cal.c
+ *
+ * Load cell zero, scale and drift compensation. See load_cell_cal.h.
+ */
+
+#include "load_cell_cal.h"
+#include "pc_command.h"
+#include "stateMachine.h"
+
+static const char *TAG = "lc_cal";
+
+typedef enum {
+    LC_CAPTURE_NONE = 0,
+    LC_CAPTURE_AUTO_TARE,
+    LC_CAPTURE_TARE,
+    LC_CAPTURE_POINT,
+} lc_capture_mode_t;
+
+// Shared with the command handlers, under lc_cal_lock.
+static lc_calibration_t lc_cal = {LC_CAL_MAGIC, 0.0f, 1.0f};
+static bool lc_cal_stored;
+static lc_capture_mode_t capture_pending;
+static lc_capture_mode_t capture_mode;
+static uint8_t capture_point;
+static int32_t capture_force_dn;
+static bool point_valid[2];
+static lc_cal_report_t lc_report;
+static portMUX_TYPE lc_cal_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Owned by lc_cal_process().
+static int64_t capture_sum;
+static uint32_t capture_count;
+static float point_raw[2];
+static int32_t point_force_dn[2];
+static int64_t rest_since_us;
+static bool rest_tared;         // Tare or point capture done in the current rest period.
+static bool zero_valid;         // Zero from NVS or from a tare since boot.
+static int last_force_dn;
+static uint32_t hold_cycles;
+
+/**
+ * @brief Load the stored calibration. Without one the force stays in raw
+ *        counts (offset 0, scale 1) until the first tare, which matches the
+ *        tuning of Compensation().
+ */
+void lc_cal_init(void)
+{
+    nvs_handle_t handle;
+    lc_calibration_t stored;
+    size_t size = sizeof(stored);
+
+    esp_err_t err = nvs_open(LC_CAL_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_get_blob(handle, LC_CAL_NVS_KEY, &stored, &size);
+        nvs_close(handle);
+    }
+
+    if (err == ESP_OK && size == sizeof(stored) && stored.magic == LC_CAL_MAGIC &&
+        isfinite(stored.offset) && isfinite(stored.scale) && stored.scale != 0.0f)
+    {
+        portENTER_CRITICAL(&lc_cal_lock);
+        lc_cal = stored;
+        lc_cal_stored = true;
+        zero_valid = true;
+        portEXIT_CRITICAL(&lc_cal_lock);
+        ESP_LOGI(TAG, "Calibration loaded: offset %.1f, scale %.4f", stored.offset, stored.scale);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "No stored calibration (%s), using raw counts", esp_err_to_name(err));
+    }
+}
+
+void lc_cal_get(lc_calibration_t *cal)
+{
+    portENTER_CRITICAL(&lc_cal_lock);
+    *cal = lc_cal;
+    portEXIT_CRITICAL(&lc_cal_lock);
+}
+
+// Called with the mean raw value of a finished capture.
+static void lc_cal_capture_done(lc_capture_mode_t mode, float mean)
+{
+    portENTER_CRITICAL(&lc_cal_lock);
+    float offset = lc_cal.offset;
+    float scale = lc_cal.scale;
+    uint8_t point = capture_point;
+    int32_t force_dn = capture_force_dn;
+    portEXIT_CRITICAL(&lc_cal_lock);
+
+    switch (mode)
+    {
+    case LC_CAPTURE_AUTO_TARE:
+        rest_tared = true;
+        // The first zero after boot without a stored calibration is taken as it is.
+        if (zero_valid && fabsf((mean - offset) * scale) > LC_CAL_AUTO_TARE_MAX_DN)
+        {
+            lc_report.refused_tares++;
+            ESP_LOGW(TAG, "Auto tare refused, %.1f counts from zero", mean - offset);
+            break;
+        }
+        offset = mean;
+        zero_valid = true;
+        lc_report.auto_tares++;
+        break;
+
+    case LC_CAPTURE_TARE:
+        rest_tared = true;
+        offset = mean;
+        zero_valid = true;
+        ESP_LOGI(TAG, "Tare at %.1f counts", mean);
+        break;
+
+    case LC_CAPTURE_POINT:
+        // The calibration weight may still hang on the handle: no automatic tare over it.
+        rest_tared = true;
+        point_raw[point] = mean;
+        point_force_dn[point] = force_dn;
+        point_valid[point] = true;
+        ESP_LOGI(TAG, "Point %d: %.1f counts = %d dN", point, mean, force_dn);
+
+        if (point_valid[0] && point_valid[1])
+        {
+            float span = point_raw[1] - point_raw[0];
+            if (fabsf(span) < LC_CAL_MIN_SPAN_COUNTS || point_force_dn[1] == point_force_dn[0])
+            {
+                ESP_LOGW(TAG, "Calibration points too close, discarded");
+            }
+            else
+            {
+                scale = (float)(point_force_dn[1] - point_force_dn[0]) / span;
+                offset = point_raw[0] - (float)point_force_dn[0] / scale;
+                zero_valid = true;
+                ESP_LOGI(TAG, "Calibrated: offset %.1f, scale %.4f", offset, scale);
+            }
+            point_valid[0] = false;
+            point_valid[1] = false;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    portENTER_CRITICAL(&lc_cal_lock);
+    if (offset != lc_cal.offset || scale != lc_cal.scale)
+    {
+        lc_cal.offset = offset;
+        lc_cal.scale = scale;
+        lc_cal_stored = false;
+    }
+    capture_mode = LC_CAPTURE_NONE;
+    portEXIT_CRITICAL(&lc_cal_lock);
+}
+
+/**
+ * @brief Calibrate one load cell sample. Runs once per control cycle.
+ *
+ * @param raw: load cell value aligned to the cycle, see load_cell_force_at().
+ * @param confidence: confidence of raw, 0 when the load cell has gone quiet.
+ * @param at_rest: handle released and robot standing still.
+ * @param now_us: cycle time.
+ * @return force in 0.1 N. Out of range samples hold the last good force for
+ *         LC_CAL_MAX_HOLD_CYCLES, then give 0.
+ */
+int lc_cal_process(int32_t raw, uint8_t confidence, bool at_rest, int64_t now_us)
+{
+    portENTER_CRITICAL(&lc_cal_lock);
+    if (capture_mode == LC_CAPTURE_NONE && capture_pending != LC_CAPTURE_NONE)
+    {
+        capture_mode = capture_pending;
+        capture_pending = LC_CAPTURE_NONE;
+        capture_sum = 0;
+        capture_count = 0;
+    }
+    lc_capture_mode_t mode = capture_mode;
+    float offset = lc_cal.offset;
+    float scale = lc_cal.scale;
+    portEXIT_CRITICAL(&lc_cal_lock);
+
+    if (!at_rest)
+    {
+        rest_since_us = 0;
+        rest_tared = false;
+        if (mode == LC_CAPTURE_AUTO_TARE)
+        {
+            // Handle grabbed or robot moved during the average.
+            portENTER_CRITICAL(&lc_cal_lock);
+            capture_mode = LC_CAPTURE_NONE;
+            portEXIT_CRITICAL(&lc_cal_lock);
+            mode = LC_CAPTURE_NONE;
+        }
+    }
+    else if (rest_since_us == 0)
+    {
+        rest_since_us = now_us;
+    }
+    else if (!rest_tared && mode == LC_CAPTURE_NONE && confidence > 0 &&
+             now_us - rest_since_us >= LC_CAL_REST_SETTLE_US)
+    {
+        // Not between the two points of a calibration either, a weight may be on for the second.
+        portENTER_CRITICAL(&lc_cal_lock);
+        if (capture_mode == LC_CAPTURE_NONE && capture_pending == LC_CAPTURE_NONE &&
+            point_valid[0] == point_valid[1])
+        {
+            capture_mode = LC_CAPTURE_AUTO_TARE;
+            mode = capture_mode;
+            capture_sum = 0;
+            capture_count = 0;
+        }
+        portEXIT_CRITICAL(&lc_cal_lock);
+    }
+
+    // Captures use the raw counts, a calibration weight may well be out of the current range.
+    if (mode != LC_CAPTURE_NONE && confidence > 0)
+    {
+        capture_sum += raw;
+        capture_count++;
+        if (capture_count == LC_CAL_AVG_SAMPLES)
+        {
+            lc_cal_capture_done(mode, (float)capture_sum / capture_count);
+            portENTER_CRITICAL(&lc_cal_lock);
+            offset = lc_cal.offset;
+            scale = lc_cal.scale;
+            portEXIT_CRITICAL(&lc_cal_lock);
+        }
+    }
+
+    int32_t force_dn = lroundf(((float)raw - offset) * scale);
+    bool in_range = force_dn <= LC_CAL_MAX_FORCE_DN && force_dn >= -LC_CAL_MAX_FORCE_DN;
+    if (confidence == 0 || !in_range)
+    {
+        if (!in_range)
+        {
+            lc_report.faults++;
+        }
+        if (hold_cycles < LC_CAL_MAX_HOLD_CYCLES)
+        {
+            hold_cycles++;
+        }
+        else
+        {
+            last_force_dn = 0;
+        }
+        return last_force_dn;
+    }
+    hold_cycles = 0;
+
+    // Zero drift, only once this rest period has been tared and the reading is near zero.
+    if (at_rest && rest_tared && mode == LC_CAPTURE_NONE &&
+        force_dn <= LC_CAL_DRIFT_WINDOW_DN && force_dn >= -LC_CAL_DRIFT_WINDOW_DN)
+    {
+        portENTER_CRITICAL(&lc_cal_lock);
+        lc_cal.offset += ((float)raw - lc_cal.offset) / LC_CAL_DRIFT_DIV;
+        portEXIT_CRITICAL(&lc_cal_lock);
+    }
+
+    last_force_dn = force_dn;
+    return force_dn;
+}
+
+// States with the motor off or idle. Tare, points, reset and save are refused in the others:
+// a step of the zero or scale jumps the force fed to Compensation() while the handle may be
+// loaded, and the NVS write stalls both cores with the flash cache off.
+static inline bool lc_cal_idle_state(void)
+{
+    enum state_codes state = cur_state;
+    return state == powerUp || state == enabled || state == wifiConfig || state == devMatching;
+}
+
+// The capture requests are taken by the next lc_cal_process() call.
+static uint8_t lc_cal_request_capture(lc_capture_mode_t mode, uint8_t point, int32_t force_dn)
+{
+    uint8_t status = PC_CMD_OK;
+
+    if (!lc_cal_idle_state())
+    {
+        return PC_CMD_ERR_BUSY;
+    }
+
+    portENTER_CRITICAL(&lc_cal_lock);
+    if (capture_pending != LC_CAPTURE_NONE ||
+        (capture_mode != LC_CAPTURE_NONE && capture_mode != LC_CAPTURE_AUTO_TARE))
+    {
+        status = PC_CMD_ERR_BUSY;
+    }
+    else
+    {
+        // A running automatic tare gives way to the requested capture.
+        capture_mode = LC_CAPTURE_NONE;
+        capture_pending = mode;
+        capture_point = point;
+        capture_force_dn = force_dn;
+    }
+    portEXIT_CRITICAL(&lc_cal_lock);
+    return status;
+}
+
+uint8_t lc_cal_cmd_tare(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    return lc_cal_request_capture(LC_CAPTURE_TARE, 0, 0);
+}
+
+uint8_t lc_cal_cmd_point(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    if (len != 5)
+    {
+        return PC_CMD_ERR_LENGTH;
+    }
+    if (payload[0] > 1)
+    {
+        return PC_CMD_ERR_ARG;
+    }
+
+    int32_t force_dn;
+    memcpy(&force_dn, &payload[1], sizeof(force_dn));
+    return lc_cal_request_capture(LC_CAPTURE_POINT, payload[0], force_dn);
+}
+
+uint8_t lc_cal_cmd_save(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    lc_calibration_t cal;
+
+    if (!lc_cal_idle_state())
+    {
+        return PC_CMD_ERR_BUSY;
+    }
+    lc_cal_get(&cal);
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(LC_CAL_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(handle, LC_CAL_NVS_KEY, &cal, sizeof(cal));
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Saving calibration failed: %s", esp_err_to_name(err));
+        return PC_CMD_ERR_STORAGE;
+    }
+
+    portENTER_CRITICAL(&lc_cal_lock);
+    lc_cal_stored = true;
+    portEXIT_CRITICAL(&lc_cal_lock);
+    ESP_LOGI(TAG, "Calibration saved: offset %.1f, scale %.4f", cal.offset, cal.scale);
+    return PC_CMD_OK;
+}
+
+uint8_t lc_cal_cmd_reset(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    if (!lc_cal_idle_state())
+    {
+        return PC_CMD_ERR_BUSY;
+    }
+
+    portENTER_CRITICAL(&lc_cal_lock);
+    lc_cal.offset = 0.0f;
+    lc_cal.scale = 1.0f;
+    lc_cal_stored = false;
+    zero_valid = false;
+    point_valid[0] = false;
+    point_valid[1] = false;
+    portEXIT_CRITICAL(&lc_cal_lock);
+    return PC_CMD_OK;
+}
+
+uint8_t lc_cal_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    lc_cal_report_t report;
+
+    portENTER_CRITICAL(&lc_cal_lock);
+    report = lc_report;
+    report.offset = lc_cal.offset;
+    report.scale = lc_cal.scale;
+    report.force_dn = last_force_dn;
+    report.flags = (rest_since_us != 0 ? LC_CAL_FLAG_AT_REST : 0) |
+                   (capture_mode != LC_CAPTURE_NONE || capture_pending != LC_CAPTURE_NONE ? LC_CAL_FLAG_CAPTURING : 0) |
+                   (point_valid[0] ? LC_CAL_FLAG_POINT0 : 0) |
+                   (point_valid[1] ? LC_CAL_FLAG_POINT1 : 0) |
+                   (lc_cal_stored ? LC_CAL_FLAG_STORED : 0);
+    portEXIT_CRITICAL(&lc_cal_lock);
+
+    memcpy(reply, &report, sizeof(report));
+    *reply_len = sizeof(report);
+    return PC_CMD_OK;
+}
@@ -0,0 +1,79 @@
+/*
+ * load_cell_cal.h
+ *
+ * Load cell calibration: zero offset, scale to 0.1 N, automatic tare while
+ * the handle is released and the robot stands still, slow tracking of the
+ * zero drift, two-point scale calibration from the PC and NVS storage.
+ * lc_cal_process() runs once per control cycle in the process task and is the
+ * only place the calibration is applied; the PC commands only post requests.
+ */
+
+#ifndef LOAD_CELL_CAL_H_
+#define LOAD_CELL_CAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "control_rate.h"
+
+#define LC_CAL_NVS_NAMESPACE    "lc_cal"
+#define LC_CAL_NVS_KEY          "cal"
+#define LC_CAL_MAGIC            0x4C43A001
+
+// Forces are in 0.1 N, the unit Compensation() expects.
+// Beyond this the sample is taken as a transmission or sensor fault.
+#define LC_CAL_MAX_FORCE_DN     1000
+// Cycles the last good force is held over faulty samples before it drops to 0: 12 ms.
+#define LC_CAL_MAX_HOLD_CYCLES  CONTROL_CYCLES(12000)
+
+// Below this speed (inc/s, 16384 per mm/s) the robot counts as standing still.
+#define LC_CAL_REST_SPEED_INC   16384
+// Rest time before the automatic tare starts averaging.
+#define LC_CAL_REST_SETTLE_US   500000
+// Samples averaged for a tare or a calibration point, one per cycle: 256 ms.
+#define LC_CAL_AVG_SAMPLES      CONTROL_CYCLES(256000)
+// Once a zero is known, an automatic tare further than this from it is
+// refused, something is probably resting on the handle.
+#define LC_CAL_AUTO_TARE_MAX_DN 100
+// Drift tracking: IIR weight 1/LC_CAL_DRIFT_DIV per cycle while at rest and
+// within LC_CAL_DRIFT_WINDOW_DN of zero; a time constant of about 16 s.
+#define LC_CAL_DRIFT_DIV        CONTROL_CYCLES(16384000)
+#define LC_CAL_DRIFT_WINDOW_DN  20
+// Minimum raw distance between the two calibration points.
+#define LC_CAL_MIN_SPAN_COUNTS  100
+
+typedef struct {
+    uint32_t magic;
+    float offset;               // Raw counts at zero force.
+    float scale;                // 0.1 N per raw count.
+} lc_calibration_t;
+
+// Reply of PC_CMD_LC_CAL_GET, little endian.
+typedef struct __attribute__((packed)) {
+    float offset;
+    float scale;
+    int32_t force_dn;           // Latest calibrated force.
+    uint8_t flags;              // LC_CAL_FLAG_*
+    uint32_t auto_tares;
+    uint32_t refused_tares;
+    uint32_t faults;            // Samples rejected as out of range.
+} lc_cal_report_t;
+
+#define LC_CAL_FLAG_AT_REST     (1 << 0)
+#define LC_CAL_FLAG_CAPTURING   (1 << 1)
+#define LC_CAL_FLAG_POINT0      (1 << 2)
+#define LC_CAL_FLAG_POINT1      (1 << 3)
+#define LC_CAL_FLAG_STORED      (1 << 4)   // Active calibration came from or went to NVS.
+
+void lc_cal_init(void);
+int lc_cal_process(int32_t raw, uint8_t confidence, bool at_rest, int64_t now_us);
+void lc_cal_get(lc_calibration_t *cal);
+
+uint8_t lc_cal_cmd_tare(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+uint8_t lc_cal_cmd_point(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+uint8_t lc_cal_cmd_save(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+uint8_t lc_cal_cmd_reset(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+uint8_t lc_cal_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+#endif /* LOAD_CELL_CAL_H_ */
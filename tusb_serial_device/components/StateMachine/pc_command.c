@@ -0,0 +1,89 @@
+/*
+ * pc_command.c
+ *
+ * Service command table and dispatch. New commands get an id in pc_command.h
+ * and a line in pc_commands[].
+ */
+
+#include "pc_command.h"
+#include "pc_link.h"
+#include "load_cell_cal.h"
+#include "trace.h"
+#include "deadline_monitor.h"
+#include "boot_profile.h"
+#include "power_mgmt.h"
+#include "recorder.h"
+#include "safety.h"
+#include "heartbeat.h"
+#include "drive_pdo.h"
+#include "setpoint_fifo.h"
+#include "time_sync.h"
+#include "StateStatusLED.h"
+#include "esp_log.h"
+
+static const char *TAG = "pc_command";
+
+typedef struct {
+    uint8_t id;
+    pc_command_fn_t fn;
+} pc_command_entry_t;
+
+static const pc_command_entry_t pc_commands[] = {
+    {PC_CMD_LC_TARE,      lc_cal_cmd_tare},
+    {PC_CMD_LC_CAL_POINT, lc_cal_cmd_point},
+    {PC_CMD_LC_CAL_SAVE,  lc_cal_cmd_save},
+    {PC_CMD_LC_CAL_RESET, lc_cal_cmd_reset},
+    {PC_CMD_LC_CAL_GET,   lc_cal_cmd_get},
+    {PC_CMD_TRACE_TRIGGER, trace_cmd_trigger},
+    {PC_CMD_TRACE_REARM,  trace_cmd_rearm},
+    {PC_CMD_DEADLINE_GET, deadline_cmd_get},
+    {PC_CMD_DEADLINE_RESET, deadline_cmd_reset},
+    {PC_CMD_BOOT_GET,     boot_cmd_get},
+    {PC_CMD_POWER_GET,    power_cmd_get},
+    {PC_CMD_LED_GET,      led_cmd_get},
+    {PC_CMD_REC_LIST,     recorder_cmd_list},
+    {PC_CMD_REC_READ,     recorder_cmd_read},
+    {PC_CMD_REC_STATUS,   recorder_cmd_status},
+    {PC_CMD_SAFETY_GET,   safety_cmd_get},
+    {PC_CMD_HEARTBEAT_GET, heartbeat_cmd_get},
+    {PC_CMD_DRIVE_PDO_GET, drive_pdo_cmd_get},
+    {PC_CMD_SETPOINT_BATCH, setpoint_cmd_batch},
+    {PC_CMD_SETPOINT_STATUS, setpoint_cmd_status},
+    {PC_CMD_TIME_SYNC,    time_sync_cmd},
+};
+
+/**
+ * @brief Run the handler of a checked service frame and send the reply.
+ *
+ * @param frame: service frame as delivered by pc_frame_parser_feed().
+ * @param writer: link the reply is written to, the one the request came from.
+ */
+void pc_command_dispatch(const uint8_t *frame, pc_reply_writer_t writer)
+{
+    uint8_t cmd = frame[2];
+    uint8_t reply[1 + PC_CMD_REPLY_MAX];
+    size_t reply_len = 0;
+
+    reply[0] = PC_CMD_ERR_UNKNOWN;
+    for (size_t i = 0; i < sizeof(pc_commands) / sizeof(pc_commands[0]); i++)
+    {
+        if (pc_commands[i].id == cmd)
+        {
+            reply[0] = pc_commands[i].fn(&frame[4], frame[3], &reply[1], &reply_len);
+            break;
+        }
+    }
+
+    if (reply[0] != PC_CMD_OK)
+    {
+        ESP_LOGW(TAG, "Command 0x%02x failed: %d", cmd, reply[0]);
+        reply_len = 0;
+    }
+
+    uint8_t out[PC_SERVICE_MAX_LEN];
+    size_t out_len = pc_service_frame_build(out, PC_UP_FRAME_HEAD, cmd, reply, 1 + reply_len);
+    if (out_len > 0 && writer != NULL)
+    {
+        writer(out, out_len);
+    }
+}
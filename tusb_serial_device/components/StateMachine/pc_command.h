@@ -0,0 +1,76 @@
+/*
+ * pc_command.h
+ *
+ * Service commands from the PC, carried in 0xAB 0xCD service frames (see
+ * pc_link.h). Each command is answered with a service frame carrying the same
+ * command byte, a status byte and the command specific reply. Handlers run in
+ * the receiving task and must not wait on the control loop; work for the
+ * loop is only requested here and picked up by the loop.
+ */
+
+#ifndef PC_COMMAND_H_
+#define PC_COMMAND_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+    PC_CMD_LC_TARE      = 0x10, // No payload. Tare on the next samples. 0x10..0x13 are busy unless idle.
+    PC_CMD_LC_CAL_POINT = 0x11, // [0] point 0/1, [1..4] int32 reference force in 0.1 N.
+    PC_CMD_LC_CAL_SAVE  = 0x12, // No payload. Store the active calibration in NVS.
+    PC_CMD_LC_CAL_RESET = 0x13, // No payload. Back to offset 0, scale 1.
+    PC_CMD_LC_CAL_GET   = 0x14, // Reply: lc_cal_report_t.
+    PC_CMD_TRACE_TRIGGER = 0x20, // No payload. Freeze the event trace as after a deadline miss.
+    PC_CMD_TRACE_REARM  = 0x21, // No payload. Clear the trace and record again.
+    PC_CMD_DEADLINE_GET = 0x22, // Reply: deadline_stats_t.
+    PC_CMD_DEADLINE_RESET = 0x23, // No payload. Back to normal operation after degradation.
+    PC_CMD_BOOT_GET     = 0x24, // Reply: boot_report_t.
+    PC_CMD_POWER_GET    = 0x25, // Reply: power_report_t.
+    PC_CMD_LED_GET      = 0x26, // Reply: led_report_t.
+    PC_CMD_REC_LIST     = 0x27, // [0] 0 for the newest session. Reply: rec_session_info_t.
+    PC_CMD_REC_READ     = 0x28, // [0..1] session. Reply: rec_session_info_t, then the blocks over USB.
+    PC_CMD_REC_STATUS   = 0x29, // Reply: rec_status_t.
+    PC_CMD_SAFETY_GET   = 0x2A, // Reply: safety_report_t.
+    PC_CMD_HEARTBEAT_GET = 0x2B, // Reply: heartbeat_stats_t.
+    PC_CMD_DRIVE_PDO_GET = 0x2C, // Reply: drive_pdo_report_t.
+    PC_CMD_SETPOINT_BATCH = 0x2D, // [0] mode, [1..2] sequence, [3..] int32 setpoints. Reply: setpoint_batch_ack_t.
+    PC_CMD_SETPOINT_STATUS = 0x2E, // Reply: setpoint_stats_t.
+    PC_CMD_TIME_SYNC    = 0x2F, // [0..7] PC time, echoed. Reply: time_sync_reply_t.
+} pc_command_id_t;
+
+// Unsolicited service frames from the robot. Same layout as a reply, without the status byte.
+typedef enum {
+    PC_REPORT_DIAG_HEAP = 0x80, // diag_heap_report_t, once per diagnostics period.
+    PC_REPORT_DIAG_TASK = 0x81, // diag_task_report_t, one frame per task.
+    PC_REPORT_DIAG_DEADLINE = 0x82, // deadline_stats_t.
+    PC_REPORT_DIAG_HEARTBEAT = 0x83, // heartbeat_stats_t.
+} pc_report_id_t;
+
+typedef enum {
+    PC_CMD_OK = 0,
+    PC_CMD_ERR_UNKNOWN,
+    PC_CMD_ERR_LENGTH,
+    PC_CMD_ERR_ARG,
+    PC_CMD_ERR_BUSY,
+    PC_CMD_ERR_STORAGE,
+} pc_command_status_t;
+
+// Reply payload space left after the status byte.
+#define PC_CMD_REPLY_MAX        31
+
+/**
+ * @brief Command handler.
+ *
+ * @param payload: request payload.
+ * @param len: request payload length.
+ * @param reply: buffer for the reply, PC_CMD_REPLY_MAX bytes.
+ * @param reply_len: set to the number of reply bytes written, 0 on entry.
+ * @return pc_command_status_t.
+ */
+typedef uint8_t (*pc_command_fn_t)(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+typedef int (*pc_reply_writer_t)(const uint8_t *data, size_t len);
+
+void pc_command_dispatch(const uint8_t *frame, pc_reply_writer_t writer);
+
+#endif /* PC_COMMAND_H_ */
@@ -0,0 +1,376 @@
+/*
+ * pc_link.c
+ *
+ * UART2 link to the PC. See pc_link.h and the "PC link over UART2" section
+ * of the README for the frame format and the throughput/latency figures.
+ */
+
+#include "pc_link.h"
+#include "pc_command.h"
+#include "trace.h"
+#include "stateMachine.h"
+
+static const char *TAG = "pc_link";
+
+static QueueHandle_t pc_link_event_queue;
+static pc_frame_parser_t uart_parser;
+static pc_link_stats_t link_stats;
+
+void pc_frame_parser_init(pc_frame_parser_t *parser, pc_frame_handler_t handler)
+{
+    memset(parser, 0, sizeof(pc_frame_parser_t));
+    parser->handler = handler;
+}
+
+void pc_frame_parser_reset(pc_frame_parser_t *parser)
+{
+    parser->len = 0;
+    parser->in_sync = false;
+}
+
+static uint8_t pc_service_checksum(const uint8_t *frame, size_t payload_len)
+{
+    uint8_t chk = 0;
+    for (size_t i = 2; i < 4 + payload_len; i++)
+    {
+        chk ^= frame[i];
+    }
+    return chk;
+}
+
+static void pc_frame_parser_drop(pc_frame_parser_t *parser, size_t count)
+{
+    if (parser->in_sync)
+    {
+        parser->resyncs++;
+        parser->in_sync = false;
+    }
+    parser->dropped_bytes += count;
+    parser->len = 0;
+}
+
+static inline bool pc_frame_head_ok(const uint8_t *head, size_t len)
+{
+    return head[0] == PC_FRAME_HEAD && (len < 2 || head[1] == PC_FRAME_HEAD || head[1] == PC_SERVICE_HEAD);
+}
+
+static void pc_frame_parser_deliver(pc_frame_parser_t *parser, size_t len)
+{
+    if (parser->frame[1] == PC_SERVICE_HEAD)
+    {
+        parser->service_frames++;
+    }
+    else
+    {
+        parser->frames++;
+    }
+
+    parser->in_sync = true;
+    if (parser->handler != NULL)
+    {
+        parser->handler(parser->frame, len);
+    }
+}
+
+// One byte into the frame in progress. True if the command frame found after a resync is not
+// followed by a header: it was cut out of the stream at the wrong place (a stray 0xAB before
+// 0xAB 0xAB looks like a frame shifted by one byte), and parser->frame still holds it.
+static bool pc_frame_parser_step(pc_frame_parser_t *parser, uint8_t byte)
+{
+    if ((parser->len == 0 && byte != PC_FRAME_HEAD) ||
+        (parser->len == 1 && byte != PC_FRAME_HEAD && byte != PC_SERVICE_HEAD))
+    {
+        pc_frame_parser_drop(parser, parser->len + 1);
+        return false;
+    }
+
+    parser->frame[parser->len++] = byte;
+
+    if (parser->len > PC_CMD_FRAME_LEN && parser->frame[1] == PC_FRAME_HEAD)
+    {
+        // A command frame waiting for the header after it.
+        if (!pc_frame_head_ok(&parser->frame[PC_CMD_FRAME_LEN], parser->len - PC_CMD_FRAME_LEN))
+        {
+            return true;
+        }
+        if (parser->len == PC_CMD_FRAME_LEN + 2)
+        {
+            pc_frame_parser_deliver(parser, PC_CMD_FRAME_LEN);
+            parser->frame[0] = parser->frame[PC_CMD_FRAME_LEN];
+            parser->frame[1] = parser->frame[PC_CMD_FRAME_LEN + 1];
+            parser->len = 2;
+            parser->expected = (parser->frame[1] == PC_SERVICE_HEAD) ? 4 : PC_CMD_FRAME_LEN;
+        }
+        return false;
+    }
+
+    if (parser->len == 2)
+    {
+        // Service frame length is only known once the length byte is in.
+        parser->expected = (byte == PC_SERVICE_HEAD) ? 4 : PC_CMD_FRAME_LEN;
+    }
+    else if (parser->len == 4 && parser->frame[1] == PC_SERVICE_HEAD)
+    {
+        if (byte > PC_SERVICE_MAX_PAYLOAD)
+        {
+            parser->service_errors++;
+            pc_frame_parser_drop(parser, parser->len);
+            return false;
+        }
+        parser->expected = PC_SERVICE_OVERHEAD + byte;
+    }
+
+    if (parser->len == parser->expected)
+    {
+        if (parser->frame[1] == PC_SERVICE_HEAD)
+        {
+            size_t payload_len = parser->frame[3];
+            if (pc_service_checksum(parser->frame, payload_len) != parser->frame[4 + payload_len])
+            {
+                parser->service_errors++;
+                pc_frame_parser_drop(parser, parser->len);
+                return false;
+            }
+        }
+        else if (!parser->in_sync)
+        {
+            return false;   // Confirmed by the next header, see above.
+        }
+
+        pc_frame_parser_deliver(parser, parser->len);
+        parser->len = 0;
+    }
+    return false;
+}
+
+/**
+ * @brief Feed received bytes to the parser. Complete command frames and
+ *        service frames with a good checksum are passed to the parser handler,
+ *        which tells them apart by frame[1]. Bytes before a 0xAB 0xAB or
+ *        0xAB 0xCD header are dropped, so the parser finds the next frame after
+ *        garbage or a lost byte. Command frames have no checksum: after a
+ *        resync the first one is only delivered once the next frame's header
+ *        follows it, and rejected otherwise.
+ *
+ * @param parser: parser state.
+ * @param data: received bytes, in any chunking.
+ * @param len: number of bytes in data.
+ */
+void pc_frame_parser_feed(pc_frame_parser_t *parser, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        // A rejected frame is searched again from its second byte, ahead of the bytes still to
+        // go. A rejected frame is at most 16 bytes including the byte just stepped, so rescan
+        // never holds more than 15.
+        uint8_t rescan[PC_CMD_FRAME_LEN + 2];
+        size_t count = 1;
+        size_t next = 0;
+
+        rescan[0] = data[i];
+        while (next < count)
+        {
+            if (pc_frame_parser_step(parser, rescan[next++]))
+            {
+                size_t back = parser->len - 1;
+                size_t left = count - next;
+
+                memmove(&rescan[back], &rescan[next], left);
+                memcpy(rescan, &parser->frame[1], back);
+                count = back + left;
+                next = 0;
+                parser->rejected++;
+                pc_frame_parser_drop(parser, 1);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Build a service frame into frame, which must hold
+ *        PC_SERVICE_OVERHEAD + len bytes.
+ *
+ * @param head: PC_FRAME_HEAD for frames to the robot, PC_UP_FRAME_HEAD for
+ *        frames to the PC.
+ * @return total frame length, 0 if the payload is too long.
+ */
+size_t pc_service_frame_build(uint8_t *frame, uint8_t head, uint8_t cmd, const uint8_t *payload, size_t len)
+{
+    if (len > PC_SERVICE_MAX_PAYLOAD)
+    {
+        return 0;
+    }
+
+    frame[0] = head;
+    frame[1] = PC_SERVICE_HEAD;
+    frame[2] = cmd;
+    frame[3] = (uint8_t)len;
+    if (len > 0)
+    {
+        memcpy(&frame[4], payload, len);
+    }
+    frame[4 + len] = pc_service_checksum(frame, len);
+    return PC_SERVICE_OVERHEAD + len;
+}
+
+// Command frames go to the main process task the same way the UDP frames did.
+// Service frames are answered from this task.
+static void uart_frame_handler(const uint8_t *frame, size_t len)
+{
+    TRACE_EVENT(TRACE_EV_PC_FRAME, frame[1]);
+
+    if (frame[1] == PC_SERVICE_HEAD)
+    {
+        pc_command_dispatch(frame, pc_link_write);
+        return;
+    }
+
+    queue_msg pc_rx_to_recv;
+    pc_rx_to_recv.sender_int = 1;
+    memcpy(pc_rx_to_recv.udp_recv_array, frame, PC_CMD_FRAME_LEN);
+
+    // Never block the receiver. A full queue means the process task is behind,
+    // and the next frame carries a newer command anyway.
+    if (xQueueSend(uart_queue, (void *)&pc_rx_to_recv, 0) != pdPASS)
+    {
+        link_stats.queue_drops++;
+    }
+}
+
+/**
+ * @brief Install the UART2 driver with an event queue and a TX ring buffer.
+ *
+ * @param baud_rate: link baud rate, up to 5 Mbaud.
+ */
+esp_err_t pc_link_init(uint32_t baud_rate)
+{
+    const uart_config_t uart_config = {
+        .baud_rate = baud_rate,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_APB,
+    };
+
+    ESP_ERROR_CHECK(uart_driver_install(PC_LINK_UART_NUM, PC_LINK_RX_BUF_SIZE, PC_LINK_TX_BUF_SIZE,
+                                        PC_LINK_EVENT_Q_LEN, &pc_link_event_queue, 0));
+    ESP_ERROR_CHECK(uart_param_config(PC_LINK_UART_NUM, &uart_config));
+    ESP_ERROR_CHECK(uart_set_pin(PC_LINK_UART_NUM, PC_LINK_TXD_PIN, PC_LINK_RXD_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+
+    ESP_ERROR_CHECK(uart_set_rx_full_threshold(PC_LINK_UART_NUM, PC_LINK_RX_FULL_THRESH));
+    ESP_ERROR_CHECK(uart_set_rx_timeout(PC_LINK_UART_NUM, CONFIG_TR_PC_LINK_RX_TIMEOUT_SYMBOLS));
+
+    pc_frame_parser_init(&uart_parser, uart_frame_handler);
+
+    uint32_t actual_baud = 0;
+    uart_get_baudrate(PC_LINK_UART_NUM, &actual_baud);
+    ESP_LOGI(TAG, "UART2 PC link at %u baud", actual_baud);
+    return ESP_OK;
+}
+
+/**
+ * @brief UART2 receive task. Wakes on driver events only: FIFO full threshold,
+ *        RX timeout, overflow and line errors.
+ */
+void pc_link_rx_task(void *arg)
+{
+    uart_event_t event;
+    static uint8_t rx_chunk[128];
+
+    while (1)
+    {
+        if (xQueueReceive(pc_link_event_queue, &event, portMAX_DELAY) != pdPASS)
+        {
+            continue;
+        }
+
+        switch (event.type)
+        {
+        case UART_DATA:
+        {
+            size_t remaining = event.size;
+            while (remaining > 0)
+            {
+                int rxBytes = uart_read_bytes(PC_LINK_UART_NUM, rx_chunk, MIN(remaining, sizeof(rx_chunk)), 0);
+                if (rxBytes <= 0)
+                {
+                    break;
+                }
+                link_stats.rx_bytes += rxBytes;
+                pc_frame_parser_feed(&uart_parser, rx_chunk, rxBytes);
+                remaining -= rxBytes;
+            }
+            break;
+        }
+
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            // Data has been lost, the frame in progress is broken.
+            link_stats.overflows++;
+            uart_flush_input(PC_LINK_UART_NUM);
+            xQueueReset(pc_link_event_queue);
+            pc_frame_parser_reset(&uart_parser);
+            ESP_LOGW(TAG, "RX overflow");
+            break;
+
+        case UART_FRAME_ERR:
+        case UART_PARITY_ERR:
+            link_stats.line_errors++;
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Send the robot frames queued by the process task to the PC. The
+ *        driver copies into its TX ring buffer, so this only blocks if the link
+ *        is slower than the frame rate.
+ */
+void pc_link_tx_task(void *arg)
+{
+    udp_send_msg udp_send_struct;
+
+    while (1)
+    {
+        if (xQueueReceive(udp_send_queue, &udp_send_struct, portMAX_DELAY) == pdPASS)
+        {
+            pc_link_write(udp_send_struct.udp_send_array, PC_UP_FRAME_LEN);
+            link_stats.tx_frames++;
+        }
+    }
+}
+
+int pc_link_write(const uint8_t *data, size_t len)
+{
+    return uart_write_bytes(PC_LINK_UART_NUM, (const char *)data, len);
+}
+
+/**
+ * @brief Send a service frame to the PC. uart_write_bytes holds the driver TX
+ *        lock for the whole frame, so this does not interleave with robot frames.
+ */
+int pc_link_send_service(uint8_t cmd, const uint8_t *payload, size_t len)
+{
+    uint8_t frame[PC_SERVICE_MAX_LEN];
+    size_t frame_len = pc_service_frame_build(frame, PC_UP_FRAME_HEAD, cmd, payload, len);
+    if (frame_len == 0)
+    {
+        return -1;
+    }
+    return pc_link_write(frame, frame_len);
+}
+
+void pc_link_get_stats(pc_link_stats_t *stats)
+{
+    memcpy(stats, &link_stats, sizeof(pc_link_stats_t));
+    stats->frames = uart_parser.frames;
+    stats->service_frames = uart_parser.service_frames;
+    stats->service_errors = uart_parser.service_errors;
+    stats->resyncs = uart_parser.resyncs;
+    stats->dropped_bytes = uart_parser.dropped_bytes;
+    stats->rejected = uart_parser.rejected;
+}
@@ -0,0 +1,102 @@
+/*
+ * pc_link.h
+ *
+ * UART2 link to the PC for deployments where USB is not available.
+ * Command frames from the PC start with 0xAB 0xAB and are 14 bytes long.
+ * Service frames start with 0xAB 0xCD and carry a variable payload:
+ *   [0..1]  0xAB 0xCD
+ *   [2]     command, see pc_command.h
+ *   [3]     payload length n, up to PC_SERVICE_MAX_PAYLOAD
+ *   [4..]   payload, little endian fields
+ *   [4+n]   XOR of bytes 2..3+n
+ * Replies use the same layout with 0x2A 0xCD as header, which cannot be
+ * mistaken for a 34 byte robot frame (byte 1 only carries switch bits there).
+ * The receiver is driven by the UART event queue and re-synchronises on
+ * the header after garbage; a command frame found that way only counts once
+ * the next header follows it. Robot frames for the PC are written through the
+ * UART driver TX ring buffer.
+ */
+
+#ifndef PC_LINK_H_
+#define PC_LINK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/uart.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#define PC_LINK_UART_NUM        UART_NUM_2
+// For PC: pin 36 for TX pin 35 for RX
+#define PC_LINK_TXD_PIN         (GPIO_NUM_36)
+#define PC_LINK_RXD_PIN         (GPIO_NUM_35)
+
+#define PC_LINK_BAUD_RATE       CONFIG_TR_PC_LINK_BAUD_RATE
+
+#define PC_FRAME_HEAD           0xAB
+#define PC_CMD_FRAME_LEN        14
+#define PC_UP_FRAME_LEN         34
+
+#define PC_SERVICE_HEAD         0xCD
+#define PC_UP_FRAME_HEAD        0x2A
+#define PC_SERVICE_OVERHEAD     5
+#define PC_SERVICE_MAX_PAYLOAD  32
+#define PC_SERVICE_MAX_LEN      (PC_SERVICE_OVERHEAD + PC_SERVICE_MAX_PAYLOAD)
+
+#define PC_LINK_RX_BUF_SIZE     1024
+#define PC_LINK_TX_BUF_SIZE     1024
+#define PC_LINK_EVENT_Q_LEN     20
+// One full command frame in the FIFO raises the RX interrupt straight away.
+#define PC_LINK_RX_FULL_THRESH  PC_CMD_FRAME_LEN
+
+typedef struct {
+    uint32_t rx_bytes;
+    uint32_t frames;        // Complete command frames delivered.
+    uint32_t service_frames; // Service frames with a good checksum.
+    uint32_t service_errors; // Service frames with a bad checksum or length.
+    uint32_t resyncs;       // Times the parser lost the header and searched again.
+    uint32_t dropped_bytes; // Bytes discarded while searching for the header.
+    uint32_t rejected;      // Command frames after a resync not followed by a header.
+    uint32_t queue_drops;   // Frames lost because the process queue was full.
+    uint32_t overflows;     // HW FIFO or driver ring buffer overflows.
+    uint32_t line_errors;   // Framing/parity errors.
+    uint32_t tx_frames;
+} pc_link_stats_t;
+
+typedef void (*pc_frame_handler_t)(const uint8_t *frame, size_t len);
+
+/**
+ * @brief Byte stream to frame parser state. Frames do not have to be aligned
+ *        with the reads that deliver them.
+ */
+typedef struct {
+    uint8_t frame[PC_SERVICE_MAX_LEN];
+    size_t len;
+    size_t expected;        // Length of the frame in progress, known after byte 1 (3 for service frames).
+    bool in_sync;
+    pc_frame_handler_t handler;
+
+    uint32_t frames;
+    uint32_t service_frames;
+    uint32_t service_errors;
+    uint32_t resyncs;
+    uint32_t dropped_bytes;
+    uint32_t rejected;
+} pc_frame_parser_t;
+
+void pc_frame_parser_init(pc_frame_parser_t *parser, pc_frame_handler_t handler);
+void pc_frame_parser_reset(pc_frame_parser_t *parser);
+void pc_frame_parser_feed(pc_frame_parser_t *parser, const uint8_t *data, size_t len);
+
+esp_err_t pc_link_init(uint32_t baud_rate);
+void pc_link_rx_task(void *arg);
+void pc_link_tx_task(void *arg);
+int pc_link_write(const uint8_t *data, size_t len);
+size_t pc_service_frame_build(uint8_t *frame, uint8_t head, uint8_t cmd, const uint8_t *payload, size_t len);
+int pc_link_send_service(uint8_t cmd, const uint8_t *payload, size_t len);
+void pc_link_get_stats(pc_link_stats_t *stats);
+
+#endif /* PC_LINK_H_ */
@@ -0,0 +1,151 @@
+/*
+ * power_mgmt.c
+ *
+ * esp_pm locks by state machine state. See power_mgmt.h.
+ */
+
+#include <string.h>
+#include <sys/param.h>
+#include "power_mgmt.h"
+#include "pc_command.h"
+
+#ifdef CONFIG_TR_POWER_MGMT
+
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "power";
+
+_Static_assert(sizeof(power_report_t) <= PC_CMD_REPLY_MAX, "Power report does not fit a reply");
+
+static esp_pm_lock_handle_t cpu_lock;
+static esp_pm_lock_handle_t apb_lock;
+static esp_pm_lock_handle_t sleep_lock;
+
+// Written by the process task only, read by the PC command.
+static bool held;
+static int64_t last_pc_frame_us;
+static int64_t last_update_us;
+static uint64_t state_us[POWER_STATES];
+static uint64_t released_us;
+static uint32_t max_acquire_us;
+
+/**
+ * @brief Configure dynamic frequency scaling and create the locks, held.
+ *        Call before the control tasks start.
+ */
+void power_mgmt_init(void)
+{
+    esp_pm_config_esp32s3_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP32S3_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_CPU_MHZ,
+#ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "control_cpu", &cpu_lock));
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "control_apb", &apb_lock));
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "control_sleep", &sleep_lock));
+
+    // Held until the state machine says otherwise, so startup runs at full speed.
+    esp_pm_lock_acquire(cpu_lock);
+    esp_pm_lock_acquire(apb_lock);
+    esp_pm_lock_acquire(sleep_lock);
+    held = true;
+    last_update_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Clock %d..%d MHz", POWER_MIN_CPU_MHZ, CONFIG_ESP32S3_DEFAULT_CPU_FREQ_MHZ);
+}
+
+/**
+ * @brief Note a frame from the PC. The locks stay held while frames come in.
+ */
+void power_mgmt_pc_frame(void)
+{
+    last_pc_frame_us = esp_timer_get_time();
+}
+
+static bool power_state_needs_clock(enum state_codes state, int64_t now_us)
+{
+    if (state == initialising || state == ready || state == run || state == estop)
+    {
+        return true;
+    }
+    return last_pc_frame_us != 0 && now_us - last_pc_frame_us < POWER_PC_TIMEOUT_MS * 1000LL;
+}
+
+/**
+ * @brief Take or release the locks for the current state. Called by the
+ *        process task every cycle and on its receive timeout; only a change
+ *        costs more than a few instructions.
+ */
+void power_mgmt_update(enum state_codes state)
+{
+    int64_t now_us = esp_timer_get_time();
+    int64_t elapsed_us = now_us - last_update_us;
+    last_update_us = now_us;
+
+    if (state < POWER_STATES)
+    {
+        state_us[state] += elapsed_us;
+    }
+    if (!held)
+    {
+        released_us += elapsed_us;
+    }
+
+    bool need = power_state_needs_clock(state, now_us);
+    if (need == held)
+    {
+        return;
+    }
+
+    if (need)
+    {
+        esp_pm_lock_acquire(cpu_lock);
+        esp_pm_lock_acquire(apb_lock);
+        esp_pm_lock_acquire(sleep_lock);
+        uint32_t acquire_us = (uint32_t)(esp_timer_get_time() - now_us);
+        if (acquire_us > max_acquire_us)
+        {
+            max_acquire_us = acquire_us;
+        }
+        ESP_LOGI(TAG, "Full clock in state %d, %u us to switch", state, acquire_us);
+    }
+    else
+    {
+        esp_pm_lock_release(sleep_lock);
+        esp_pm_lock_release(apb_lock);
+        esp_pm_lock_release(cpu_lock);
+        ESP_LOGI(TAG, "Clock scaling allowed in state %d", state);
+    }
+    held = need;
+}
+
+uint8_t power_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    power_report_t report = {
+        .released_ms = (uint32_t)(released_us / 1000),
+        .max_acquire_us = (uint16_t)MIN(max_acquire_us, UINT16_MAX),
+        .held = held,
+    };
+    for (int i = 0; i < POWER_STATES; i++)
+    {
+        report.state_ms[i] = (uint32_t)(state_us[i] / 1000);
+    }
+
+    memcpy(reply, &report, sizeof(report));
+    *reply_len = sizeof(report);
+    return PC_CMD_OK;
+}
+
+#else
+
+uint8_t power_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    return PC_CMD_ERR_UNKNOWN;
+}
+
+#endif /* CONFIG_TR_POWER_MGMT */
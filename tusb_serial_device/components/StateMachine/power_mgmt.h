@@ -0,0 +1,53 @@
+/*
+ * power_mgmt.h
+ *
+ * Power management by state machine state. In initialising, ready, run and
+ * estop, and whenever the PC has sent a frame within the last
+ * POWER_PC_TIMEOUT_MS, the control path holds CPU_FREQ_MAX, APB_FREQ_MAX
+ * and NO_LIGHT_SLEEP locks, so the loop runs exactly as without power
+ * management. In powerUp and enabled with no PC the locks are released and
+ * esp_pm may lower the clock down to POWER_MIN_CPU_MHZ, or light sleep when
+ * tickless idle is enabled and no driver holds a lock of its own.
+ *
+ * Built only with CONFIG_TR_POWER_MGMT (needs PM_ENABLE); otherwise the
+ * calls compile to nothing and the CPU stays at its default clock.
+ */
+
+#ifndef POWER_MGMT_H_
+#define POWER_MGMT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "StateStatusLED.h"
+
+#define POWER_STATES            6   // powerUp .. estop
+
+typedef struct __attribute__((packed)) {
+    uint32_t state_ms[POWER_STATES];    // Time in each state since boot.
+    uint32_t released_ms;       // Time with the locks released, clock scaling allowed.
+    uint16_t max_acquire_us;    // Longest lock acquisition: the wake-up cost paid on leaving idle.
+    uint8_t held;               // 1 while the locks are held.
+} power_report_t;
+
+#ifdef CONFIG_TR_POWER_MGMT
+
+#define POWER_MIN_CPU_MHZ       CONFIG_TR_POWER_MIN_CPU_MHZ
+#define POWER_PC_TIMEOUT_MS     CONFIG_TR_POWER_PC_TIMEOUT_MS
+
+void power_mgmt_init(void);
+void power_mgmt_pc_frame(void);
+void power_mgmt_update(enum state_codes state);
+
+#else
+
+#define power_mgmt_init()           ((void)0)
+#define power_mgmt_pc_frame()       ((void)0)
+#define power_mgmt_update(state)    ((void)0)
+
+#endif /* CONFIG_TR_POWER_MGMT */
+
+uint8_t power_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+#endif /* POWER_MGMT_H_ */
@@ -0,0 +1,691 @@
+/*
+ * recorder.c
+ *
+ * Session recorder on a flash partition. See recorder.h.
+ */
+
+#include <string.h>
+#include <sys/param.h>
+#include "recorder.h"
+
+#ifdef CONFIG_TR_RECORDER
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "stateMachine.h"
+#include "deadline_monitor.h"
+
+static const char *TAG = "recorder";
+
+_Static_assert(sizeof(rec_block_header_t) == 32, "Block header layout changed");
+_Static_assert(sizeof(rec_input_record_t) == 70, "Input record layout changed, update tools/session_tool.py");
+_Static_assert(sizeof(rec_session_info_t) <= PC_CMD_REPLY_MAX, "Session info does not fit a reply");
+_Static_assert(sizeof(rec_status_t) <= PC_CMD_REPLY_MAX, "Recorder status does not fit a reply");
+
+// A page is written only this long after the TPDO1 of the cycle, so it ends well before the next SYNC.
+#define REC_WRITE_WINDOW_US     (DEADLINE_PERIOD_US / 2)
+#define REC_DOWNLOAD_CHUNK      1024
+
+typedef struct {
+    rec_block_header_t header;
+    uint8_t records[REC_BLOCK_SIZE - sizeof(rec_block_header_t)];
+} rec_block_t;
+
+// Filled by the control loop, written by the recorder task.
+static rec_block_t rec_blocks[2];
+static volatile bool rec_pending[2];
+static uint8_t rec_fill;        // Control loop: block being filled.
+static uint8_t rec_write;       // Recorder task: next block to write. Blocks are closed in turn.
+
+static const esp_partition_t *rec_partition;
+static TaskHandle_t rec_task_handle;
+static pc_reply_writer_t rec_download_writer;
+static portMUX_TYPE rec_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Log position, under rec_lock. Blocks [head_seq, head_seq + erased) are erased.
+static uint32_t rec_block_count;
+static uint32_t head_seq;
+static uint32_t erased;
+static bool rec_ready;
+
+// Session in progress, control loop only.
+static bool recording;
+static uint16_t session;
+static uint16_t session_blocks;
+static uint32_t session_cycles;
+static uint32_t session_records;
+static int64_t session_start_us;
+static uint32_t session_start_ms;
+static volatile uint32_t cycle_us;  // Low bits of the cycle TPDO1 time, 0 while idle.
+
+static rec_session_info_t sessions[REC_MAX_SESSIONS];
+static uint8_t session_count;
+static int32_t truncate_session = -1;   // Under rec_lock: to mark once its first block is listed.
+static rec_status_t status;
+static volatile int32_t download_session = -1;
+
+#ifdef CONFIG_TR_RECORDER_INPUTS
+// Inputs of the cycle in progress, taken by recorder_begin().
+static rec_input_record_t rec_input;
+#endif
+
+static inline bool rec_idle_state(enum state_codes state)
+{
+    return state == powerUp || state == enabled || state == wifiConfig || state == devMatching;
+}
+
+static esp_err_t rec_read_header(uint32_t seq, rec_block_header_t *header)
+{
+    return esp_partition_read(rec_partition, (seq % rec_block_count) * REC_BLOCK_SIZE, header, sizeof(*header));
+}
+
+// Called with rec_lock held.
+static rec_session_info_t *rec_session_find(uint16_t id)
+{
+    for (int i = session_count - 1; i >= 0; i--)
+    {
+        if (sessions[i].session == id)
+        {
+            return &sessions[i];
+        }
+    }
+    return NULL;
+}
+
+// Called with rec_lock held. The oldest session goes when the list is full.
+static rec_session_info_t *rec_session_add(uint16_t id, uint32_t first_seq, uint32_t start_ms)
+{
+    if (session_count == REC_MAX_SESSIONS)
+    {
+        memmove(&sessions[0], &sessions[1], (REC_MAX_SESSIONS - 1) * sizeof(sessions[0]));
+        session_count--;
+    }
+    rec_session_info_t *info = &sessions[session_count++];
+    memset(info, 0, sizeof(*info));
+    info->session = id;
+    info->first_seq = first_seq;
+    info->start_ms = start_ms;
+    return info;
+}
+
+// Called with rec_lock held, before the block at seq is erased.
+static void rec_session_forget(uint32_t seq)
+{
+    if (session_count > 0 && sessions[0].first_seq == seq)
+    {
+        sessions[0].first_seq++;
+        sessions[0].truncated = 1;
+        if (--sessions[0].blocks == 0)
+        {
+            memmove(&sessions[0], &sessions[1], (session_count - 1) * sizeof(sessions[0]));
+            session_count--;
+        }
+    }
+}
+
+// Control loop. Records of the session in progress were lost: no erased block left, or the
+// recorder task behind. Its list entry only exists once the first block has been written.
+static void rec_session_truncate(void)
+{
+    portENTER_CRITICAL(&rec_lock);
+    rec_session_info_t *info = rec_session_find(session);
+    if (info != NULL)
+    {
+        info->truncated = 1;
+    }
+    else
+    {
+        truncate_session = session;
+    }
+    portEXIT_CRITICAL(&rec_lock);
+}
+
+/**
+ * @brief Find the head and the erased blocks ahead of it, and list the
+ *        sessions still in the log.
+ */
+static void rec_scan(void)
+{
+    rec_block_header_t header;
+    bool found = false;
+    uint32_t max_seq = 0;
+
+    for (uint32_t pos = 0; pos < rec_block_count; pos++)
+    {
+        if (rec_read_header(pos, &header) == ESP_OK && header.magic == REC_BLOCK_MAGIC &&
+            header.seq % rec_block_count == pos && (!found || header.seq > max_seq))
+        {
+            max_seq = header.seq;
+            found = true;
+        }
+    }
+    uint32_t head = found ? max_seq + 1 : 0;
+
+    // The records of a block go in before its header: blank from the first record on means erased.
+    uint32_t free = 0;
+    for (; free < rec_block_count; free++)
+    {
+        uint32_t probe[(sizeof(rec_block_header_t) + 16) / sizeof(uint32_t)];
+        esp_partition_read(rec_partition, ((head + free) % rec_block_count) * REC_BLOCK_SIZE, probe, sizeof(probe));
+        bool blank = true;
+        for (size_t i = 0; i < sizeof(probe) / sizeof(probe[0]); i++)
+        {
+            blank &= (probe[i] == UINT32_MAX);
+        }
+        if (!blank)
+        {
+            break;
+        }
+    }
+
+    portENTER_CRITICAL(&rec_lock);
+    head_seq = head;
+    erased = free;
+    session_count = 0;
+    portEXIT_CRITICAL(&rec_lock);
+
+    // Oldest first. Sessions are contiguous runs of blocks.
+    uint16_t last_session = 0;
+    for (uint32_t seq = head + free; found && seq < head + rec_block_count; seq++)
+    {
+        uint32_t expected = seq - rec_block_count;
+        if (rec_read_header(seq, &header) != ESP_OK || header.magic != REC_BLOCK_MAGIC || header.seq != expected ||
+            seq < rec_block_count)
+        {
+            continue;
+        }
+        portENTER_CRITICAL(&rec_lock);
+        rec_session_info_t *info = (session_count > 0 && sessions[session_count - 1].session == header.session)
+                                   ? &sessions[session_count - 1] : NULL;
+        if (info == NULL)
+        {
+            info = rec_session_add(header.session, header.seq, header.start_ms);
+            info->truncated = (header.block_in_session != 0);
+        }
+        info->blocks++;
+        info->records += header.count;
+        info->duration_ms = (uint32_t)(((uint64_t)header.first_record + header.count) * header.period_us / 1000);
+        portEXIT_CRITICAL(&rec_lock);
+        last_session = header.session;
+    }
+    session = last_session;
+
+    ESP_LOGI(TAG, "%u blocks, head %u, %u erased, %u sessions", rec_block_count, head, free, session_count);
+}
+
+/**
+ * @brief Find the partition. Session data is downloaded through
+ *        download_writer, the USB link. Call before the recorder task starts.
+ */
+void recorder_init(pc_reply_writer_t download_writer)
+{
+    rec_download_writer = download_writer;
+    rec_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, REC_PARTITION_LABEL);
+    if (rec_partition == NULL)
+    {
+        ESP_LOGW(TAG, "No \"%s\" partition, sessions are not recorded", REC_PARTITION_LABEL);
+        return;
+    }
+    rec_block_count = rec_partition->size / REC_BLOCK_SIZE;
+    status.blocks = (uint16_t)MIN(rec_block_count, UINT16_MAX);
+}
+
+// Control loop. Hands a block to the recorder task; the block gets the next erased sector.
+static void rec_block_close(void)
+{
+    rec_block_t *block = &rec_blocks[rec_fill];
+    bool stored = false;
+
+    if (block->header.count == 0)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&rec_lock);
+    if (erased > 0)
+    {
+        block->header.seq = head_seq++;
+        erased--;
+        stored = true;
+    }
+    portEXIT_CRITICAL(&rec_lock);
+
+    if (!stored)
+    {
+        status.dropped += block->header.count;
+        block->header.count = 0;
+        rec_session_truncate();
+        return;
+    }
+    session_blocks++;
+    rec_pending[rec_fill] = true;
+    rec_fill ^= 1;
+}
+
+// Control loop. Starts the block the next records go into, if the recorder task is done with it.
+static bool rec_block_open(void)
+{
+    rec_block_t *block = &rec_blocks[rec_fill];
+
+    if (rec_pending[rec_fill])
+    {
+        return false;
+    }
+    if (block->header.count == 0)
+    {
+        block->header = (rec_block_header_t){
+            .magic = REC_BLOCK_MAGIC,
+            .session = session,
+            .type = REC_RECORD_TYPE,
+            .record_size = REC_RECORD_SIZE,
+            .block_in_session = session_blocks,
+            .first_record = session_records,
+            .period_us = DEADLINE_PERIOD_US * REC_DIVIDER,
+            .start_ms = session_start_ms,
+        };
+    }
+    return true;
+}
+
+#ifdef CONFIG_TR_RECORDER_INPUTS
+/**
+ * @brief Take the inputs of the cycle. Called at the start of
+ *        main_fsm_function, before the state function can change them.
+ */
+void recorder_begin(enum state_codes state)
+{
+    rec_input.state = (uint8_t)state;
+    rec_input.level = (uint8_t)deadline_level();
+    rec_input.switches = (gpio_get_level(HANDLE_SW_PIN) ? REC_SW_HANDLE : 0) |
+                         (gpio_get_level(RETURN_SW_PIN) ? REC_SW_RETURN : 0) |
+                         (gpio_get_level(ESTOP_PIN) ? REC_SW_ESTOP : 0) |
+                         (flags.rtn_event_triggered ? REC_SW_RTN_EVENT : 0);
+    rec_input.control_mode = inputs.motor_data.control_mode;
+    rec_input.status_word = inputs.motor_data.status_word;
+    rec_input.error_code = inputs.motor_data.error_code;
+    rec_input.position_inc = inputs.motor_data.position_inc;
+    rec_input.speed_inc = inputs.motor_data.speed_inc;
+    rec_input.position_inc_offset = inputs.motor_data.position_inc_offset;
+    rec_input.current = inputs.motor_data.actual_current;
+    rec_input.limit_switches = (inputs.motor_data.motor_ls ? REC_LS_MOTOR : 0) |
+                               (inputs.motor_data.far_side_ls ? REC_LS_FAR : 0) |
+                               (inputs.motor_data.centre_ls ? REC_LS_CENTRE : 0);
+    rec_input.lc_confidence = inputs.inter_force_confidence;
+    rec_input.lc_inc = inputs.inter_force_inc;
+    rec_input.lc_age_us = inputs.inter_force_age_us;
+    memcpy(rec_input.pc_msg, inputs.pc_msg, sizeof(rec_input.pc_msg));
+}
+
+// Control loop. The inputs taken at the start of the cycle and what it produced.
+static void rec_fill_record(uint8_t *slot, enum state_codes state, uint32_t cycle)
+{
+    rec_input_record_t *record = (rec_input_record_t *)slot;
+
+    memcpy(record, &rec_input, sizeof(*record));
+    record->cycle = cycle;
+    record->time_us = (uint32_t)(inputs.motor_data.sample_time_us - session_start_us);
+    record->force = inter_force;
+    record->state_out = (uint8_t)state;
+    record->command = outputs.target_motor_paras.desired_torque;
+    record->position_out = linear_position;
+    record->speed_out = linear_speed;
+}
+#else
+// Control loop. The summary of the cycle just processed.
+static void rec_fill_record(uint8_t *slot, enum state_codes state, uint32_t cycle)
+{
+    rec_record_t *record = (rec_record_t *)slot;
+
+    record->time_us = (uint32_t)(inputs.motor_data.sample_time_us - session_start_us);
+    record->state = (uint8_t)state;
+    record->level = (uint8_t)deadline_level();
+    record->position = linear_position;
+    record->speed = linear_speed;
+    record->current = inputs.motor_data.actual_current;
+    record->force = (int16_t)MAX(MIN(inter_force, INT16_MAX), INT16_MIN);
+    record->command = outputs.target_motor_paras.desired_torque;
+}
+#endif /* CONFIG_TR_RECORDER_INPUTS */
+
+/**
+ * @brief Record the cycle just processed. Called at the end of
+ *        main_fsm_function; copies a record and wakes the recorder task.
+ */
+void recorder_push(enum state_codes state)
+{
+    if (!rec_ready)
+    {
+        return;
+    }
+
+    if (rec_idle_state(state))
+    {
+        if (recording)
+        {
+            rec_block_close();
+            recording = false;
+            status.recording = 0;
+        }
+        cycle_us = 0;
+        xTaskNotifyGive(rec_task_handle);
+        return;
+    }
+
+    if (!recording)
+    {
+        recording = true;
+        session++;
+        session_blocks = 0;
+        session_cycles = 0;
+        session_records = 0;
+        session_start_us = inputs.motor_data.sample_time_us;
+        session_start_ms = (uint32_t)(session_start_us / 1000);
+        status.recording = 1;
+        status.session = session;
+        // The list entry is added by the recorder task with the first block written.
+    }
+
+    uint32_t cycle = session_cycles++;
+    if (cycle % REC_DIVIDER == 0)
+    {
+        if (rec_block_open())
+        {
+            rec_block_t *block = &rec_blocks[rec_fill];
+            rec_fill_record(&block->records[block->header.count++ * REC_RECORD_SIZE], state, cycle);
+            session_records++;
+            if (block->header.count == REC_RECORDS_PER_BLOCK)
+            {
+                rec_block_close();
+            }
+        }
+        else
+        {
+            status.dropped++;
+            rec_session_truncate();
+        }
+    }
+
+    cycle_us = (uint32_t)inputs.motor_data.sample_time_us | 1;
+    xTaskNotifyGive(rec_task_handle);
+}
+
+// Recorder task. Bytes [offset, end) of the block, page by page. While recording, one page
+// per cycle and only in the slack after it; false until the range is written.
+static bool rec_write_pages(rec_block_t *block, size_t *offset, size_t end, bool paced)
+{
+    uint32_t base = (block->header.seq % rec_block_count) * REC_BLOCK_SIZE;
+
+    while (*offset < end)
+    {
+        int64_t now = esp_timer_get_time();
+        uint32_t cycle = cycle_us;
+        paced &= (cycle != 0);
+        if (paced && (uint32_t)now - cycle > REC_WRITE_WINDOW_US)
+        {
+            return false;
+        }
+        size_t chunk = MIN(end, (*offset / REC_PAGE_SIZE + 1) * REC_PAGE_SIZE) - *offset;
+        if (esp_partition_write(rec_partition, base + *offset, (uint8_t *)block + *offset, chunk) != ESP_OK)
+        {
+            status.write_errors++;
+        }
+        status.max_write_us = (uint16_t)MIN(MAX(status.max_write_us, esp_timer_get_time() - now), UINT16_MAX);
+        *offset += chunk;
+        if (paced)
+        {
+            return *offset >= end;
+        }
+    }
+    return true;
+}
+
+// Recorder task. Writes the records, then the header with the CRC, then lists the block.
+static void rec_write_step(void)
+{
+    static size_t offset = sizeof(rec_block_header_t);
+    rec_block_t *block = &rec_blocks[rec_write];
+
+    if (!rec_pending[rec_write])
+    {
+        return;
+    }
+    size_t end = sizeof(rec_block_header_t) + block->header.count * REC_RECORD_SIZE;
+    if (!rec_write_pages(block, &offset, end, true))
+    {
+        return;
+    }
+
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&block->header, offsetof(rec_block_header_t, crc));
+    block->header.crc = esp_rom_crc32_le(crc, block->records, block->header.count * REC_RECORD_SIZE);
+    size_t header_offset = 0;
+    rec_write_pages(block, &header_offset, sizeof(rec_block_header_t), false);  // 32 bytes, right away.
+
+    portENTER_CRITICAL(&rec_lock);
+    rec_session_info_t *info = rec_session_find(block->header.session);
+    if (info == NULL)
+    {
+        info = rec_session_add(block->header.session, block->header.seq, block->header.start_ms);
+    }
+    if (truncate_session == block->header.session)
+    {
+        info->truncated = 1;
+        truncate_session = -1;
+    }
+    info->truncated |= (info->first_seq + info->blocks != block->header.seq);
+    info->blocks++;
+    info->records += block->header.count;
+    info->duration_ms = (uint32_t)(((uint64_t)block->header.first_record + block->header.count) * block->header.period_us / 1000);
+    portEXIT_CRITICAL(&rec_lock);
+
+    block->header.count = 0;
+    offset = sizeof(rec_block_header_t);
+    rec_pending[rec_write] = false;
+    rec_write ^= 1;
+}
+
+// Recorder task, idle states only. Erases the oldest block, which drops it from the list.
+static void rec_erase_step(void)
+{
+    uint32_t target = MIN((uint32_t)REC_ERASE_AHEAD_KB * 1024 / REC_BLOCK_SIZE, rec_block_count - 1);
+    uint32_t seq;
+
+    portENTER_CRITICAL(&rec_lock);
+    if (erased >= target)
+    {
+        portEXIT_CRITICAL(&rec_lock);
+        return;
+    }
+    seq = head_seq + erased;
+    if (seq >= rec_block_count)
+    {
+        rec_session_forget(seq - rec_block_count);
+    }
+    portEXIT_CRITICAL(&rec_lock);
+
+    int64_t start = esp_timer_get_time();
+    if (esp_partition_erase_range(rec_partition, (seq % rec_block_count) * REC_BLOCK_SIZE, REC_BLOCK_SIZE) != ESP_OK)
+    {
+        status.write_errors++;
+        return;
+    }
+    status.max_erase_us = (uint16_t)MIN(MAX(status.max_erase_us, esp_timer_get_time() - start), UINT16_MAX);
+
+    portENTER_CRITICAL(&rec_lock);
+    erased++;
+    portEXIT_CRITICAL(&rec_lock);
+}
+
+// Recorder task, idle states only. Sends each block as header and records, then an end header.
+static void rec_download(uint16_t id)
+{
+    static uint8_t chunk[REC_DOWNLOAD_CHUNK];
+    rec_block_header_t header;
+    rec_session_info_t info = {0};
+    uint32_t sent = 0;
+
+    portENTER_CRITICAL(&rec_lock);
+    rec_session_info_t *found = rec_session_find(id);
+    if (found != NULL)
+    {
+        info = *found;
+    }
+    portEXIT_CRITICAL(&rec_lock);
+
+    for (uint32_t seq = info.first_seq; found != NULL && seq < info.first_seq + info.blocks; seq++)
+    {
+        // A session started, or the block is gone: stop, the end header tells how far it got.
+        if (recording || rec_read_header(seq, &header) != ESP_OK || header.magic != REC_BLOCK_MAGIC || header.seq != seq)
+        {
+            break;
+        }
+        rec_download_writer((const uint8_t *)&header, sizeof(header));
+        size_t size = header.count * (size_t)header.record_size;
+        for (size_t offset = 0; offset < size; offset += sizeof(chunk))
+        {
+            size_t len = MIN(sizeof(chunk), size - offset);
+            esp_partition_read(rec_partition, (seq % rec_block_count) * REC_BLOCK_SIZE + sizeof(header) + offset, chunk, len);
+            rec_download_writer(chunk, len);
+        }
+        sent++;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = REC_END_MAGIC;
+    header.session = id;
+    header.seq = sent;
+    header.crc = esp_rom_crc32_le(0, (const uint8_t *)&header, offsetof(rec_block_header_t, crc));
+    rec_download_writer((const uint8_t *)&header, sizeof(header));
+    ESP_LOGI(TAG, "Session %u: %u blocks sent", id, sent);
+}
+
+/**
+ * @brief Writes the blocks the control loop fills; while idle, erases ahead
+ *        and serves downloads. Lowest priority.
+ */
+void recorder_task(void *arg)
+{
+    rec_task_handle = xTaskGetCurrentTaskHandle();
+    if (rec_partition == NULL)
+    {
+        vTaskSuspend(NULL);
+    }
+    rec_scan();
+    rec_ready = true;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(REC_ERASE_INTERVAL_MS));
+
+        rec_write_step();
+        if (recording || rec_pending[0] || rec_pending[1])
+        {
+            continue;
+        }
+        if (download_session >= 0)
+        {
+            rec_download((uint16_t)download_session);
+            download_session = -1;
+            continue;
+        }
+
+        // At most one erase per interval, whatever woke the task.
+        static TickType_t last_erase;
+        if (xTaskGetTickCount() - last_erase >= pdMS_TO_TICKS(REC_ERASE_INTERVAL_MS))
+        {
+            last_erase = xTaskGetTickCount();
+            rec_erase_step();
+        }
+    }
+}
+
+uint8_t recorder_cmd_list(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    if (len != 1)
+    {
+        return PC_CMD_ERR_LENGTH;
+    }
+    uint8_t status_code = PC_CMD_ERR_ARG;
+
+    // payload[0]: 0 for the newest session.
+    portENTER_CRITICAL(&rec_lock);
+    if (payload[0] < session_count)
+    {
+        memcpy(reply, &sessions[session_count - 1 - payload[0]], sizeof(rec_session_info_t));
+        status_code = PC_CMD_OK;
+    }
+    portEXIT_CRITICAL(&rec_lock);
+
+    if (status_code == PC_CMD_OK)
+    {
+        *reply_len = sizeof(rec_session_info_t);
+    }
+    return status_code;
+}
+
+uint8_t recorder_cmd_read(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    uint16_t id;
+
+    if (len != sizeof(id))
+    {
+        return PC_CMD_ERR_LENGTH;
+    }
+    memcpy(&id, payload, sizeof(id));
+    if (!rec_ready || recording || download_session >= 0 || rec_download_writer == NULL)
+    {
+        return PC_CMD_ERR_BUSY;
+    }
+
+    portENTER_CRITICAL(&rec_lock);
+    rec_session_info_t *info = rec_session_find(id);
+    if (info != NULL)
+    {
+        memcpy(reply, info, sizeof(*info));
+    }
+    portEXIT_CRITICAL(&rec_lock);
+    if (info == NULL)
+    {
+        return PC_CMD_ERR_ARG;
+    }
+
+    *reply_len = sizeof(rec_session_info_t);
+    download_session = id;
+    xTaskNotifyGive(rec_task_handle);
+    return PC_CMD_OK;
+}
+
+uint8_t recorder_cmd_status(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    rec_status_t report = status;
+
+    portENTER_CRITICAL(&rec_lock);
+    report.erased = (uint16_t)MIN(erased, UINT16_MAX);
+    report.sessions = session_count;
+    portEXIT_CRITICAL(&rec_lock);
+
+    memcpy(reply, &report, sizeof(report));
+    *reply_len = sizeof(report);
+    return PC_CMD_OK;
+}
+
+#else
+
+uint8_t recorder_cmd_list(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    return PC_CMD_ERR_UNKNOWN;
+}
+
+uint8_t recorder_cmd_read(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    return PC_CMD_ERR_UNKNOWN;
+}
+
+uint8_t recorder_cmd_status(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    return PC_CMD_ERR_UNKNOWN;
+}
+
+#endif /* CONFIG_TR_RECORDER */
@@ -0,0 +1,179 @@
+/*
+ * recorder.h
+ *
+ * Session recorder. While the state machine is in initialising, ready, run
+ * or estop, every control cycle is recorded to the "session" flash partition
+ * (partitions.csv), so the data of a session survives a dropped PC link.
+ *
+ * The partition is a ring of 4 KB blocks, one flash sector each, written in
+ * order and never rewritten in place: each sector is erased once per lap, so
+ * wear is even. A block holds a rec_block_header_t and up to
+ * REC_RECORDS_PER_BLOCK records. Its seq is the count of blocks written
+ * before it, so it sits at sector seq % blocks and the highest seq found at
+ * boot is the head. The CRC32 in the header covers the header up to the CRC
+ * and the records; a block whose header is missing (power lost while it was
+ * written) is skipped.
+ *
+ * The control loop only copies a record into one of two RAM blocks. The
+ * recorder task writes a full block one 256 byte page at a time, each in the
+ * slack after a control cycle: a flash write stops both cores. Sectors are
+ * erased ahead of the head only while the state machine is idle (powerUp,
+ * enabled, wifiConfig, devMatching), one every REC_ERASE_INTERVAL_MS; an
+ * erase holds the cores for about 45 ms, which costs one late SYNC. By
+ * default the whole partition is kept erased. When a session runs out of
+ * erased blocks the rest of it is not recorded and it is listed as truncated.
+ *
+ * Sessions are listed with PC_CMD_REC_LIST and sent with PC_CMD_REC_READ.
+ * The data goes out over USB, see recorder_init(). tools/session_tool.py
+ * downloads them and converts them to CSV or Parquet.
+ *
+ * With CONFIG_TR_RECORDER_INPUTS a record holds everything main_fsm_function
+ * reads in a cycle instead, and what it produced, so tools/session_tool.py
+ * can turn a session into a trace for host/bench/fw_replay.
+ */
+
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "StateStatusLED.h"
+#include "pc_command.h"
+
+#define REC_PARTITION_LABEL     "session"
+#define REC_BLOCK_SIZE          4096
+#define REC_PAGE_SIZE           256
+#define REC_BLOCK_MAGIC         0x31434552  // "REC1"
+#define REC_END_MAGIC           0x444e4552  // "REND", closes a download.
+#define REC_MAX_SESSIONS        64          // Newest ones listed.
+
+typedef enum {
+    REC_TYPE_CYCLE = 1,         // rec_record_t
+    REC_TYPE_INPUT = 2,         // rec_input_record_t
+} rec_type_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             // REC_BLOCK_MAGIC
+    uint32_t seq;               // Blocks written before this one.
+    uint16_t session;
+    uint16_t count;             // Records in the block.
+    uint8_t type;               // rec_type_t
+    uint8_t record_size;
+    uint16_t block_in_session;  // 0 for the first block of a session.
+    uint32_t first_record;      // Records of the session before this block.
+    uint32_t period_us;         // Control period times the recording divider.
+    uint32_t start_ms;          // Session start, ms since boot.
+    uint32_t crc;               // CRC32 of the header up to here and of the records.
+} rec_block_header_t;
+
+// One control cycle, taken at the end of main_fsm_function.
+typedef struct __attribute__((packed)) {
+    uint32_t time_us;           // TPDO1 reception since the session start.
+    uint8_t state;              // enum state_codes
+    uint8_t level;              // deadline_level_t
+    int32_t position;           // linear_position, increments from the centre.
+    int32_t speed;              // linear_speed
+    int16_t current;            // Actual current from TPDO2.
+    int16_t force;              // inter_force, 0.1 N.
+    int16_t command;            // Current command put in the RPDO.
+} rec_record_t;
+
+// rec_input_record_t.switches
+#define REC_SW_HANDLE           0x01    // gpio_get_level(HANDLE_SW_PIN)
+#define REC_SW_RETURN           0x02
+#define REC_SW_ESTOP            0x04
+#define REC_SW_RTN_EVENT        0x08    // flags.rtn_event_triggered
+
+// rec_input_record_t.limit_switches
+#define REC_LS_MOTOR            0x01
+#define REC_LS_FAR              0x02
+#define REC_LS_CENTRE           0x04
+
+// One control cycle as main_fsm_function saw it, then what it produced.
+typedef struct __attribute__((packed)) {
+    uint32_t cycle;             // Cycles since the session start.
+    uint32_t time_us;           // motor_data.sample_time_us since the session start.
+    uint8_t state;              // cur_state before the step.
+    uint8_t level;              // deadline_level_t
+    uint8_t switches;           // REC_SW_*
+    uint8_t control_mode;
+    uint16_t status_word;
+    uint16_t error_code;
+    int32_t position_inc;
+    int32_t speed_inc;
+    int32_t position_inc_offset;
+    int16_t current;
+    uint8_t limit_switches;     // REC_LS_*
+    uint8_t lc_confidence;
+    int32_t lc_inc;             // inputs.inter_force_inc
+    int32_t lc_age_us;
+    int32_t force;              // lc_cal_process() result. Calibration state is not replayed, its output is.
+    uint8_t pc_msg[14];
+    uint8_t state_out;          // cur_state after the step.
+    uint8_t reserved;
+    int16_t command;            // desired_torque
+    int32_t position_out;       // linear_position
+    int32_t speed_out;          // linear_speed
+} rec_input_record_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t session;
+    uint16_t blocks;
+    uint32_t records;
+    uint32_t first_seq;
+    uint32_t start_ms;
+    uint32_t duration_ms;
+    uint8_t truncated;          // 1 if its oldest blocks have been erased, or records were dropped.
+} rec_session_info_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t blocks;            // Partition size in blocks, 0 without a partition.
+    uint16_t erased;            // Blocks erased ahead of the head.
+    uint8_t sessions;           // Sessions listed.
+    uint8_t recording;          // 1 during a session.
+    uint16_t session;           // Current or last session.
+    uint32_t dropped;           // Records not recorded: writer behind or no erased block left.
+    uint32_t write_errors;
+    uint16_t max_write_us;      // Longest page write: the stall it causes.
+    uint16_t max_erase_us;
+} rec_status_t;
+
+#ifdef CONFIG_TR_RECORDER
+
+#ifdef CONFIG_TR_RECORDER_INPUTS
+#define REC_RECORD_TYPE         REC_TYPE_INPUT
+#define REC_RECORD_SIZE         sizeof(rec_input_record_t)
+#define REC_DIVIDER             1       // A replay needs every cycle.
+#else
+#define REC_RECORD_TYPE         REC_TYPE_CYCLE
+#define REC_RECORD_SIZE         sizeof(rec_record_t)
+#define REC_DIVIDER             CONFIG_TR_RECORDER_DIVIDER
+#endif
+#define REC_RECORDS_PER_BLOCK   ((REC_BLOCK_SIZE - sizeof(rec_block_header_t)) / REC_RECORD_SIZE)
+#define REC_ERASE_AHEAD_KB      CONFIG_TR_RECORDER_ERASE_AHEAD_KB
+#define REC_ERASE_INTERVAL_MS   200
+
+void recorder_init(pc_reply_writer_t download_writer);
+void recorder_push(enum state_codes state);
+void recorder_task(void *arg);
+
+#else
+
+#define recorder_init(writer)       ((void)0)
+#define recorder_push(state)        ((void)0)
+
+#endif /* CONFIG_TR_RECORDER */
+
+#if defined(CONFIG_TR_RECORDER) && defined(CONFIG_TR_RECORDER_INPUTS)
+void recorder_begin(enum state_codes state);
+#else
+#define recorder_begin(state)       ((void)0)
+#endif
+
+uint8_t recorder_cmd_list(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+uint8_t recorder_cmd_read(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+uint8_t recorder_cmd_status(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+#endif /* RECORDER_H_ */
@@ -0,0 +1,298 @@
+/*
+ * rs485_bus.c
+ *
+ * RS485 bus scheduler. See rs485_bus.h.
+ *
+ * Rate monotonic: of the periodic slaves that are due, the one with the
+ * shortest period goes first; background slaves fill the idle bus time.
+ * Round robin: every slave that is due is served in registration order.
+ * Waits shorter than a tick (10 ms at CONFIG_FREERTOS_HZ 100) use a one shot
+ * esp_timer, so a 2 ms poll period is kept without spinning.
+ */
+
+#include "rs485_bus.h"
+#include "stateMachine.h"
+
+static const char *TAG = "rs485_bus";
+
+static rs485_slave_t *slaves[RS485_MAX_SLAVES];
+static size_t slave_count;
+static size_t rr_next;
+static uint32_t byte_time_us;
+static esp_timer_handle_t wake_timer;
+static TaskHandle_t bus_task_handle;
+
+static void rs485_wake_cb(void *arg)
+{
+    xTaskNotifyGive(bus_task_handle);
+}
+
+/**
+ * @brief Install UART1 in RS485 half duplex mode.
+ *
+ * @param baud_rate: common to all slaves on the bus.
+ */
+esp_err_t rs485_bus_init(uint32_t baud_rate)
+{
+    // UART 1 was used to communicate with FPGA, now used for 485 with load cell.
+    const uart_config_t uart_config = {
+        .baud_rate = baud_rate,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_APB,
+    };
+    // We won't use a buffer for sending data.
+    ESP_ERROR_CHECK(uart_driver_install(RS485_UART_NUM, RS485_RX_BUF_SIZE, 0, 0, NULL, 0));
+    ESP_ERROR_CHECK(uart_param_config(RS485_UART_NUM, &uart_config));
+    ESP_ERROR_CHECK(uart_set_pin(RS485_UART_NUM, RS485_TXD_PIN, RS485_RXD_PIN, RS485_RTS_PIN, UART_PIN_NO_CHANGE));
+
+    // Echo suppression is performed by the UART peripheral when the bit UART_RS485_CONF_REG.UART_RS485TX_RX_EN is enabled.
+    REG_SET_BIT(0x3FF50044, 3);
+
+    // Set UART driver mode to Half Duplex
+    ESP_ERROR_CHECK(uart_set_mode(RS485_UART_NUM, UART_MODE_RS485_HALF_DUPLEX));
+
+    byte_time_us = 10000000 / baud_rate;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = rs485_wake_cb,
+        .name = "rs485_wake",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &wake_timer));
+
+    ESP_LOGI(TAG, "RS485 bus on UART1 at %u baud", baud_rate);
+    return ESP_OK;
+}
+
+/**
+ * @brief Add a slave to the schedule. Call before rs485_bus_task starts; the
+ *        descriptor must stay valid for the lifetime of the bus.
+ */
+esp_err_t rs485_bus_add_slave(rs485_slave_t *slave)
+{
+    if (slave_count >= RS485_MAX_SLAVES || slave->on_rx == NULL || slave->bytes_needed == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(&slave->stats, 0, sizeof(rs485_slave_stats_t));
+    slave->next_due_us = 0;
+    slaves[slave_count++] = slave;
+
+    ESP_LOGI(TAG, "Slave %s: period %u us, timeout %u us", slave->name, slave->period_us, slave->timeout_us);
+    return ESP_OK;
+}
+
+uint32_t rs485_bus_byte_time_us(void)
+{
+    return byte_time_us;
+}
+
+static inline bool rs485_is_due(const rs485_slave_t *slave, int64_t now)
+{
+    return slave->period_us == 0 || now >= slave->next_due_us;
+}
+
+/**
+ * @brief Choose the next slave to poll.
+ *
+ * @param[out] wait_us: time until the next periodic slave is due when nothing
+ *             is due now.
+ * @return slave to poll, NULL if none is due.
+ */
+static rs485_slave_t *rs485_pick(int64_t now, int64_t *wait_us)
+{
+    rs485_slave_t *pick = NULL;
+    int64_t next_due = INT64_MAX;
+
+#ifdef CONFIG_TR_RS485_SCHED_ROUND_ROBIN
+    for (size_t i = 0; i < slave_count; i++)
+    {
+        rs485_slave_t *slave = slaves[(rr_next + i) % slave_count];
+        if (rs485_is_due(slave, now))
+        {
+            pick = slave;
+            rr_next = (rr_next + i + 1) % slave_count;
+            break;
+        }
+        next_due = MIN(next_due, slave->next_due_us);
+    }
+#else
+    rs485_slave_t *background = NULL;
+    for (size_t i = 0; i < slave_count; i++)
+    {
+        // Background slaves take turns, so one of them cannot hog the idle time.
+        rs485_slave_t *slave = slaves[(rr_next + i) % slave_count];
+        if (slave->period_us == 0)
+        {
+            if (background == NULL)
+            {
+                background = slave;
+            }
+        }
+        else if (now >= slave->next_due_us)
+        {
+            if (pick == NULL || slave->period_us < pick->period_us)
+            {
+                pick = slave;
+            }
+        }
+        else
+        {
+            next_due = MIN(next_due, slave->next_due_us);
+        }
+    }
+    if (pick == NULL && background != NULL)
+    {
+        pick = background;
+        for (size_t i = 0; i < slave_count; i++)
+        {
+            if (slaves[i] == background)
+            {
+                rr_next = (i + 1) % slave_count;
+            }
+        }
+    }
+#endif
+
+    *wait_us = (pick == NULL) ? next_due - now : 0;
+    return pick;
+}
+
+// Sleep until the next poll is due. Sub tick waits go through the one shot timer.
+static void rs485_wait(int64_t wait_us)
+{
+    const int64_t tick_us = portTICK_PERIOD_MS * 1000;
+
+    if (wait_us >= tick_us)
+    {
+        vTaskDelay(wait_us / tick_us);
+    }
+    else if (wait_us > 0)
+    {
+        esp_timer_start_once(wake_timer, wait_us);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+// Ticks for a UART read that must not return before timeout_us, rounded up.
+static TickType_t rs485_ticks(int64_t timeout_us)
+{
+    const int64_t tick_us = portTICK_PERIOD_MS * 1000;
+    return (TickType_t)((timeout_us + tick_us - 1) / tick_us) + 1;
+}
+
+static void rs485_transaction(rs485_slave_t *slave, int64_t start)
+{
+    static uint8_t rx_chunk[RS485_RX_CHUNK];
+
+    slave->stats.transactions++;
+    if (slave->period_us != 0)
+    {
+        if (slave->next_due_us != 0 && start - slave->next_due_us >= slave->period_us)
+        {
+            // Overrun: skip the missed polls instead of bunching them up.
+            slave->stats.late++;
+            slave->next_due_us = start + slave->period_us;
+        }
+        else
+        {
+            slave->next_due_us = (slave->next_due_us == 0) ? start + slave->period_us
+                                                            : slave->next_due_us + slave->period_us;
+        }
+    }
+
+    int64_t deadline = start + slave->timeout_us;
+    if (slave->request != NULL)
+    {
+        // Whatever is left belongs to an earlier transaction that timed out.
+        uart_flush_input(RS485_UART_NUM);
+        uart_write_bytes(RS485_UART_NUM, (const char *)slave->request, slave->request_len);
+        deadline += slave->request_len * byte_time_us;
+    }
+
+    bool complete = false;
+    while (!complete)
+    {
+        int64_t remaining = deadline - esp_timer_get_time();
+        if (remaining <= 0)
+        {
+            break;
+        }
+
+        size_t wanted = MIN(slave->bytes_needed(slave->ctx), sizeof(rx_chunk));
+        int rxBytes = uart_read_bytes(RS485_UART_NUM, rx_chunk, wanted, rs485_ticks(remaining));
+        if (rxBytes <= 0)
+        {
+            break;
+        }
+        complete = slave->on_rx(slave->ctx, rx_chunk, rxBytes, esp_timer_get_time());
+    }
+
+    if (complete)
+    {
+        int64_t now = esp_timer_get_time();
+        slave->stats.responses++;
+        slave->stats.last_response_us = now;
+        slave->stats.last_latency_us = (uint32_t)(now - start);
+        slave->stats.max_latency_us = MAX(slave->stats.max_latency_us, slave->stats.last_latency_us);
+    }
+    else
+    {
+        slave->stats.timeouts++;
+        if (slave->on_timeout != NULL)
+        {
+            slave->on_timeout(slave->ctx);
+        }
+    }
+}
+
+/**
+ * @brief The only user of UART1. Polls the registered slaves according to
+ *        CONFIG_TR_RS485_SCHED_*.
+ */
+void rs485_bus_task(void *arg)
+{
+    bus_task_handle = xTaskGetCurrentTaskHandle();
+
+    if (slave_count == 0)
+    {
+        ESP_LOGW(TAG, "No slaves registered");
+        vTaskDelete(NULL);
+    }
+
+    while (1)
+    {
+        int64_t wait_us;
+        int64_t now = esp_timer_get_time();
+        rs485_slave_t *slave = rs485_pick(now, &wait_us);
+
+        if (slave == NULL)
+        {
+            rs485_wait(wait_us);
+            continue;
+        }
+
+        rs485_transaction(slave, now);
+        // Blocked on the one-shot timer, not spinning: this task is above the RPDO and SYNC tasks.
+        rs485_wait(slave->turnaround_us);
+    }
+}
+
+size_t rs485_bus_slave_count(void)
+{
+    return slave_count;
+}
+
+bool rs485_bus_get_stats(size_t index, const char **name, rs485_slave_stats_t *stats)
+{
+    if (index >= slave_count)
+    {
+        return false;
+    }
+    *name = slaves[index]->name;
+    memcpy(stats, &slaves[index]->stats, sizeof(rs485_slave_stats_t));
+    return true;
+}
@@ -0,0 +1,80 @@
+/*
+ * rs485_bus.h
+ *
+ * Master side scheduler for the RS485 bus on UART1 (half duplex, the driver
+ * switches the transceiver with RTS). Slave devices register a descriptor
+ * with their request, poll period, response timeout and turnaround time; one
+ * task runs the transactions one after the other and hands every response
+ * to its slave with the reception time, so a new sensor is a descriptor and
+ * a decoder instead of another task fighting for the bus.
+ */
+
+#ifndef RS485_BUS_H_
+#define RS485_BUS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "driver/uart.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#define RS485_UART_NUM          UART_NUM_1
+// New board pcb pin 18 for TX, pin 17 for RX, pin 16 drives the 485 transceiver direction.
+#define RS485_TXD_PIN           (GPIO_NUM_18)
+#define RS485_RXD_PIN           (GPIO_NUM_17)
+#define RS485_RTS_PIN           (GPIO_NUM_16)
+
+#define RS485_BAUD_RATE         CONFIG_TR_RS485_BAUD_RATE
+#define RS485_RX_BUF_SIZE       1024
+#define RS485_RX_CHUNK          64
+#define RS485_MAX_SLAVES        8
+
+/**
+ * @brief Response bytes for the slave.
+ *
+ * @param ctx: slave context.
+ * @param data: bytes read from the bus.
+ * @param len: number of bytes.
+ * @param rx_time_us: esp_timer time the read returned, i.e. just after the
+ *        last of these bytes was received.
+ * @return true once the response is complete, which ends the transaction.
+ */
+typedef bool (*rs485_rx_fn_t)(void *ctx, const uint8_t *data, size_t len, int64_t rx_time_us);
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t responses;
+    uint32_t timeouts;
+    uint32_t late;              // Polls started a whole period or more after they were due.
+    uint32_t last_latency_us;   // Request start to complete response.
+    uint32_t max_latency_us;
+    int64_t last_response_us;
+} rs485_slave_stats_t;
+
+typedef struct {
+    const char *name;
+    const uint8_t *request;     // NULL for a listen only slave, e.g. a sensor in continuous output mode.
+    size_t request_len;
+    uint32_t period_us;         // 0: background, polled back to back whenever no periodic slave is due.
+    uint32_t timeout_us;        // From the end of the request on the wire to the complete response.
+    uint32_t turnaround_us;     // Bus idle time after the transaction before the next request.
+
+    size_t (*bytes_needed)(void *ctx); // Bytes to complete the response in progress, at least 1.
+    rs485_rx_fn_t on_rx;
+    void (*on_timeout)(void *ctx);
+    void *ctx;
+
+    // Owned by the bus.
+    int64_t next_due_us;
+    rs485_slave_stats_t stats;
+} rs485_slave_t;
+
+esp_err_t rs485_bus_init(uint32_t baud_rate);
+esp_err_t rs485_bus_add_slave(rs485_slave_t *slave);
+uint32_t rs485_bus_byte_time_us(void);
+void rs485_bus_task(void *arg);
+size_t rs485_bus_slave_count(void);
+bool rs485_bus_get_stats(size_t index, const char **name, rs485_slave_stats_t *stats);
+
+#endif /* RS485_BUS_H_ */
@@ -0,0 +1,100 @@
+/*
+ * rtos_objects.c
+ *
+ * Static storage and creation of the objects listed in rtos_objects.h.
+ */
+
+#include "rtos_objects.h"
+
+static const char *TAG = "rtos_objects";
+
+#define RTOS_QUEUE_STORAGE(handle, length, type, subsystem)                 \
+    QueueHandle_t handle;                                                   \
+    static uint8_t handle##_storage[(length) * sizeof(type)];               \
+    static StaticQueue_t handle##_buffer;
+RTOS_QUEUES(RTOS_QUEUE_STORAGE)
+
+#define RTOS_SEMAPHORE_STORAGE(handle, kind, subsystem)                     \
+    SemaphoreHandle_t handle;                                               \
+    static StaticSemaphore_t handle##_buffer;
+RTOS_SEMAPHORES(RTOS_SEMAPHORE_STORAGE)
+
+#define RTOS_EVENT_GROUP_STORAGE(handle, subsystem)                         \
+    EventGroupHandle_t handle;                                              \
+    static StaticEventGroup_t handle##_buffer;
+RTOS_EVENT_GROUPS(RTOS_EVENT_GROUP_STORAGE)
+
+// The task functions are spread over main and the modules, declare them all here.
+#define RTOS_TASK_STORAGE(id, name, function, stack, priority, subsystem)  \
+    void function(void *arg);                                               \
+    static StackType_t id##_stack[stack];                                   \
+    static StaticTask_t id##_tcb;
+RTOS_TASKS(RTOS_TASK_STORAGE)
+
+#define RTOS_QUEUE_SIZE(handle, length, type, subsystem)    + sizeof(handle##_storage) + sizeof(StaticQueue_t)
+#define RTOS_SEMAPHORE_SIZE(handle, kind, subsystem)        + sizeof(StaticSemaphore_t)
+#define RTOS_EVENT_GROUP_SIZE(handle, subsystem)            + sizeof(StaticEventGroup_t)
+#define RTOS_TASK_SIZE(id, name, function, stack, priority, subsystem) + sizeof(id##_stack) + sizeof(StaticTask_t)
+
+/**
+ * @brief Create the queues, semaphores and event groups. Call first in
+ *        app_main, before anything sends or waits on them.
+ */
+void rtos_objects_init(void)
+{
+#define RTOS_QUEUE_CREATE(handle, length, type, subsystem) \
+    handle = xQueueCreateStatic((length), sizeof(type), handle##_storage, &handle##_buffer);
+    RTOS_QUEUES(RTOS_QUEUE_CREATE)
+
+#define RTOS_SEMAPHORE_CREATE(handle, kind, subsystem) \
+    handle = xSemaphoreCreate##kind##Static(&handle##_buffer);
+    RTOS_SEMAPHORES(RTOS_SEMAPHORE_CREATE)
+
+#define RTOS_EVENT_GROUP_CREATE(handle, subsystem) \
+    handle = xEventGroupCreateStatic(&handle##_buffer);
+    RTOS_EVENT_GROUPS(RTOS_EVENT_GROUP_CREATE)
+
+    ESP_LOGI(TAG, "Queues, semaphores and event groups: %u bytes",
+             0 RTOS_QUEUES(RTOS_QUEUE_SIZE) RTOS_SEMAPHORES(RTOS_SEMAPHORE_SIZE) RTOS_EVENT_GROUPS(RTOS_EVENT_GROUP_SIZE));
+}
+
+static bool task_started[RTOS_TASK_COUNT];
+
+/**
+ * @brief Start one task of the table ahead of the others, e.g. from a startup
+ *        step. Each task must be started from one place only.
+ */
+void rtos_task_start(rtos_task_t task)
+{
+    if (task >= RTOS_TASK_COUNT || task_started[task])
+    {
+        return;
+    }
+    task_started[task] = true;
+
+    switch (task)
+    {
+#define RTOS_TASK_CREATE(id, name, function, stack, priority, subsystem)                        \
+    case RTOS_TASK_##id:                                                                        \
+        xTaskCreateStatic(function, name, (stack), NULL, (priority), id##_stack, &id##_tcb);    \
+        break;
+    RTOS_TASKS(RTOS_TASK_CREATE)
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Start every task in the table that is not running yet, in table
+ *        order. A task that returns from its function must delete itself; its
+ *        stack stays reserved.
+ */
+void rtos_tasks_start(void)
+{
+    for (int task = 0; task < RTOS_TASK_COUNT; task++)
+    {
+        rtos_task_start((rtos_task_t)task);
+    }
+
+    ESP_LOGI(TAG, "Task stacks and control blocks: %u bytes", 0 RTOS_TASKS(RTOS_TASK_SIZE));
+}
@@ -0,0 +1,130 @@
+/*
+ * rtos_objects.h
+ *
+ * Every queue, semaphore, event group and task of the firmware, in one set
+ * of tables. rtos_objects_init() creates the synchronisation objects and
+ * rtos_tasks_start() the tasks, all from static storage sized from the
+ * message types, so boot does not depend on the heap and the RAM they take
+ * is fixed at link time. tools/ram_report.py reads these tables to put the
+ * storage of each object under its subsystem.
+ *
+ * Driver internals (UART and TWAI queues, esp_timer, TinyUSB) are still
+ * allocated by the drivers at init.
+ */
+
+#ifndef RTOS_OBJECTS_H_
+#define RTOS_OBJECTS_H_
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "stateMachine.h"
+#include "can_open_comm.h"
+
+// X(handle, length, item type, subsystem)
+#define RTOS_QUEUES(X)                                                  \
+    X(uart_queue,               10, queue_msg,          control)        \
+    X(udp_send_queue,           10, udp_send_msg,       pc_link)        \
+    X(can_send_queue,           10, output_wrapper,     can)            \
+    X(can_receive_queue,        10, twai_message_t,     can)            \
+    X(motor_status_queue,       10, motor_status_t,     can)            \
+    X(can_sdo_rx_queue,         10, sdo_msg_t,          can)
+
+// X(handle, Binary or Mutex, subsystem)
+#define RTOS_SEMAPHORES(X)                                              \
+    X(sem_motor_enabled,        Mutex,                  can)            \
+    X(init_done_sem,            Binary,                 control)        \
+    X(timer_start_sem,          Binary,                 control)        \
+    X(usb_tx_mutex,             Mutex,                  pc_link)
+
+#ifdef CONFIG_TR_WIFI_PROVISIONING
+#define RTOS_EVENT_GROUPS_WIFI(X)                                       \
+    X(wifi_event_group,                                 wifi)
+#else
+#define RTOS_EVENT_GROUPS_WIFI(X)
+#endif
+
+// X(handle, subsystem)
+#define RTOS_EVENT_GROUPS(X)                                            \
+    X(key_press_event_group,                            control)        \
+    X(startup_event_group,                              startup)        \
+    RTOS_EVENT_GROUPS_WIFI(X)
+
+#if defined(CONFIG_TR_WIFI_PROVISIONING) && CONFIG_TR_WIFI_ECHO_PORT > 0
+#define RTOS_TASKS_WIFI_ECHO(X)                                         \
+    X(wifi_echo,    "wifi_echo",         wifi_echo_task,     3072, 2,                           wifi)
+#else
+#define RTOS_TASKS_WIFI_ECHO(X)
+#endif
+
+#ifdef CONFIG_TR_WIFI_PROVISIONING
+#define RTOS_TASKS_WIFI(X)                                              \
+    X(wifi_prov,    "wifi_prov",         wifi_prov_task,     4096, 1,                           wifi)  \
+    X(rtn_button,   "rtn_button_timer",  rtn_button_timer_task, 2048, 1,                        wifi)  \
+    RTOS_TASKS_WIFI_ECHO(X)
+#else
+#define RTOS_TASKS_WIFI(X)
+#endif
+
+#ifdef CONFIG_TR_DIAG_ENABLE
+#define RTOS_TASKS_DIAG(X)                                              \
+    X(diagnostics,  "diagnostics",       diagnostics_task,   3072, 1,                           diagnostics)
+#else
+#define RTOS_TASKS_DIAG(X)
+#endif
+
+#ifdef CONFIG_TR_TRACE_ENABLE
+#define RTOS_TASKS_TRACE(X)                                             \
+    X(trace,        "trace",             trace_task,         3072, 1,                           trace)
+#else
+#define RTOS_TASKS_TRACE(X)
+#endif
+
+#ifdef CONFIG_TR_HEAP_GUARD
+#define RTOS_TASKS_HEAP_GUARD(X)                                        \
+    X(heap_guard,   "heap_guard",        heap_guard_task,    3072, 1,                           heap_guard)
+#else
+#define RTOS_TASKS_HEAP_GUARD(X)
+#endif
+
+#ifdef CONFIG_TR_RECORDER
+#define RTOS_TASKS_RECORDER(X)                                          \
+    X(recorder,     "recorder",          recorder_task,      3072, 1,                           recorder)
+#else
+#define RTOS_TASKS_RECORDER(X)
+#endif
+
+// X(id, name, function, stack bytes, priority, subsystem), started in this order. startup runs
+// init steps next to app_main (startup.h) and driver_init and twai_rx are started by the drive
+// bring-up step already; rtos_tasks_start() skips them.
+#define RTOS_TASKS(X)                                                                                       \
+    X(startup,      "startup",           startup_task,       4096, 1,                           startup)    \
+    X(driver_init,  "init motor driver", driver_init_task,   8192, configMAX_PRIORITIES - 7,    can)        \
+    X(rs485_bus,    "rs485_bus_task",    rs485_bus_task,     4096, configMAX_PRIORITIES - 4,    rs485)      \
+    X(process,      "uart_process_task", uart_process_task,  8192, configMAX_PRIORITIES - 3,    control)    \
+    X(pc_link_rx,   "pc_link_rx_task",   pc_link_rx_task,    3072, configMAX_PRIORITIES - 2,    pc_link)    \
+    X(pc_link_tx,   "pc_link_tx_task",   pc_link_tx_task,    2048, configMAX_PRIORITIES - 6,    pc_link)    \
+    X(sync,         "timed_2ms_task",    timed_task_,        2048, configMAX_PRIORITIES - 8,    control)    \
+    X(twai_rx,      "twai_recv_task",    twai_receive_task,  4096, configMAX_PRIORITIES - 9,    can)        \
+    X(rpdo_send,    "rpdo_send_task",    canRPDOSendTask,    4096, configMAX_PRIORITIES - 5,    can)        \
+    X(led,          "led",               led_task,           2048, 1,                           led)        \
+    RTOS_TASKS_WIFI(X)                                                                                      \
+    RTOS_TASKS_DIAG(X)                                                                                      \
+    RTOS_TASKS_TRACE(X)                                                                                     \
+    RTOS_TASKS_HEAP_GUARD(X)                                                                                \
+    RTOS_TASKS_RECORDER(X)
+
+#define RTOS_TASK_ID(id, name, function, stack, priority, subsystem) RTOS_TASK_##id,
+typedef enum {
+    RTOS_TASKS(RTOS_TASK_ID)
+    RTOS_TASK_COUNT
+} rtos_task_t;
+
+void rtos_objects_init(void);
+void rtos_task_start(rtos_task_t task);
+void rtos_tasks_start(void);
+
+#endif /* RTOS_OBJECTS_H_ */
@@ -0,0 +1,296 @@
+/*
+ * safety.c
+ *
+ * Safety supervisor on the RPDO path. See safety.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "safety.h"
+#include "pc_command.h"
+
+_Static_assert(sizeof(safety_report_t) <= PC_CMD_REPLY_MAX, "safety_report_t does not fit a reply");
+_Static_assert(SAFETY_CAUSES <= 16, "last_causes is a 16 bit mask");
+
+#ifdef CONFIG_TR_SAFETY_SUPERVISOR
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "trace.h"
+#include "deadline_monitor.h"
+#include "stateMachine.h"
+
+static const char *TAG = "safety";
+
+#define SAFETY_BIT(cause)       (1u << (cause))
+
+// Rise per cycle at the nominal period. A doubled SYNC period only makes the ramps slower.
+#define SAFETY_CURRENT_STEP     ((int32_t)((int64_t)SAFETY_CURRENT_SLEW * DEADLINE_PERIOD_US / 1000))
+#define SAFETY_SPEED_STEP       ((int32_t)((int64_t)SAFETY_SPEED_SLEW * DEADLINE_PERIOD_US / 1000))
+
+// PC frames from the process task, outputs and the command from the RPDO and PC tasks.
+static portMUX_TYPE safety_lock = portMUX_INITIALIZER_UNLOCKED;
+static safety_report_t report;
+static int64_t pc_time_us;
+
+// RPDO task only.
+static uint8_t last_mode;
+static int32_t last_current;
+static int32_t last_speed;
+static int32_t last_position;
+static uint16_t logged_causes;
+
+/**
+ * @brief A command frame has come in from the PC.
+ */
+void safety_pc_frame(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&safety_lock);
+    pc_time_us = now;
+    portEXIT_CRITICAL(&safety_lock);
+}
+
+// Towards zero at once; away from it by at most step from the last value, or from zero on a sign change.
+static inline int32_t safety_slew(int32_t target, int32_t last, int32_t step)
+{
+    int32_t base = ((target >= 0) == (last >= 0)) ? last : 0;
+
+    if (step <= 0 || llabs(target) <= llabs(base))
+    {
+        return target;
+    }
+    return (target > base) ? MIN(target, base + step) : MAX(target, base - step);
+}
+
+static inline int32_t safety_clamp(int32_t value, int32_t limit)
+{
+    return MAX(-limit, MIN(value, limit));
+}
+
+static uint16_t safety_check_torque(target_motor_para_t *target, int32_t speed, int outward)
+{
+    uint16_t causes = 0;
+    int32_t current = target->desired_torque;
+
+    if (llabs(current) > SAFETY_MAX_CURRENT)
+    {
+        current = safety_clamp(current, SAFETY_MAX_CURRENT);
+        causes |= SAFETY_BIT(SAFETY_CAUSE_CURRENT);
+    }
+    if (outward != 0 && current * outward > 0)
+    {
+        current = 0;
+        causes |= SAFETY_BIT(SAFETY_CAUSE_TRAVEL);
+    }
+
+    // Only a current in the direction of motion adds energy; braking is never limited.
+    bool driving = (int64_t)current * speed > 0;
+    if (driving && llabs(speed) > SAFETY_MAX_SPEED)
+    {
+        current = 0;
+        causes |= SAFETY_BIT(SAFETY_CAUSE_SPEED);
+    }
+    else if (driving && SAFETY_MAX_POWER > 0)
+    {
+        int64_t limit = (int64_t)SAFETY_MAX_POWER * DRIVE_SPEED_PER_MM_S / llabs(speed);
+        if (llabs(current) > limit)
+        {
+            current = (current > 0) ? (int32_t)limit : -(int32_t)limit;
+            causes |= SAFETY_BIT(SAFETY_CAUSE_POWER);
+        }
+    }
+
+    int32_t slewed = safety_slew(current, last_current, SAFETY_CURRENT_STEP);
+    if (slewed != current)
+    {
+        current = slewed;
+        causes |= SAFETY_BIT(SAFETY_CAUSE_CURRENT_SLEW);
+    }
+
+    target->desired_torque = (short)current;
+    last_current = current;
+    return causes;
+}
+
+static uint16_t safety_check_speed(target_motor_para_t *target, int outward)
+{
+    uint16_t causes = 0;
+    int32_t speed = target->desired_speed_inc;
+
+    if (llabs(speed) > SAFETY_MAX_SPEED)
+    {
+        speed = safety_clamp(speed, SAFETY_MAX_SPEED);
+        causes |= SAFETY_BIT(SAFETY_CAUSE_SPEED);
+    }
+    if (outward != 0 && (int64_t)speed * outward > 0)
+    {
+        speed = 0;
+        causes |= SAFETY_BIT(SAFETY_CAUSE_TRAVEL);
+    }
+
+    int32_t slewed = safety_slew(speed, last_speed, SAFETY_SPEED_STEP);
+    if (slewed != speed)
+    {
+        speed = slewed;
+        causes |= SAFETY_BIT(SAFETY_CAUSE_SPEED_SLEW);
+    }
+
+    // RPDO2 carries the current in speed mode as well.
+    if (llabs(target->desired_torque) > SAFETY_MAX_CURRENT)
+    {
+        target->desired_torque = (short)safety_clamp(target->desired_torque, SAFETY_MAX_CURRENT);
+        causes |= SAFETY_BIT(SAFETY_CAUSE_CURRENT);
+    }
+
+    target->desired_speed_inc = speed;
+    last_speed = speed;
+    return causes;
+}
+
+static uint16_t safety_check_position(target_motor_para_t *target, bool travel, int32_t low, int32_t high)
+{
+    uint16_t causes = 0;
+    int32_t position = target->desired_position_inc;
+
+    if (travel && (position < low || position > high))
+    {
+        position = MAX(low, MIN(position, high));
+        causes |= SAFETY_BIT(SAFETY_CAUSE_POSITION);
+    }
+    if (SAFETY_POSITION_STEP > 0 && llabs((int64_t)position - last_position) > SAFETY_POSITION_STEP)
+    {
+        position = (position > last_position) ? last_position + SAFETY_POSITION_STEP
+                                              : last_position - SAFETY_POSITION_STEP;
+        causes |= SAFETY_BIT(SAFETY_CAUSE_POSITION);
+    }
+
+    target->desired_position_inc = position;
+    last_position = position;
+    return causes;
+}
+
+static void safety_account(uint16_t causes, int64_t now_us)
+{
+    portENTER_CRITICAL(&safety_lock);
+    report.interventions++;
+    for (uint16_t bits = causes; bits != 0; bits &= bits - 1)
+    {
+        int cause = __builtin_ctz(bits);
+        report.count[cause] += (report.count[cause] < UINT16_MAX);
+    }
+    report.last_causes = causes;
+    report.last_ms = (uint32_t)(now_us / 1000);
+    portEXIT_CRITICAL(&safety_lock);
+}
+
+/**
+ * @brief Check and limit the targets of one output before its RPDOs are encoded.
+ *
+ * @param out: output of the state machine, changed in place.
+ * @param now_us: esp_timer time.
+ * @return the safety_cause_t bits of what was changed, 0 if it passed as it was.
+ */
+uint16_t safety_apply(output_wrapper *out, int64_t now_us)
+{
+    target_motor_para_t *target = &out->target_motor_paras;
+    uint16_t causes = 0;
+    int64_t pc_us;
+
+    portENTER_CRITICAL(&safety_lock);
+    pc_us = pc_time_us;
+    portEXIT_CRITICAL(&safety_lock);
+
+    if (now_us - out->input_time_us > SAFETY_DRIVE_TIMEOUT_MS * 1000LL)
+    {
+        causes |= SAFETY_BIT(SAFETY_CAUSE_DRIVE_STALE);
+    }
+    if (out->state == run && !out->fallback && now_us - pc_us > SAFETY_PC_TIMEOUT_MS * 1000LL)
+    {
+        causes |= SAFETY_BIT(SAFETY_CAUSE_PC_STALE);
+    }
+    if (target->control_mode != DRIVE_MODE_POSITION && target->control_mode != DRIVE_MODE_SPEED &&
+        target->control_mode != DRIVE_MODE_TORQUE)
+    {
+        causes |= SAFETY_BIT(SAFETY_CAUSE_MODE);
+    }
+    if (causes != 0)
+    {
+        // As the deadline monitor's zero torque level.
+        target->control_mode = DRIVE_MODE_TORQUE;
+        target->desired_torque = 0;
+        target->desired_speed_inc = 0;
+    }
+
+    // A new mode ramps from rest, or from where the drive is.
+    if (target->control_mode != last_mode)
+    {
+        last_mode = target->control_mode;
+        last_current = 0;
+        last_speed = out->actual_speed_inc;
+        last_position = out->actual_position_inc;
+    }
+
+    // The travel is only known once initialising has passed both limit switches.
+    bool travel = out->state == run && motor_ls_position != 0 && far_ls_position != 0;
+    int32_t low = MIN(motor_ls_position, far_ls_position);
+    int32_t high = MAX(motor_ls_position, far_ls_position);
+    int outward = 0;
+    if (travel)
+    {
+        outward = (out->actual_position_inc < low) ? -1 : (out->actual_position_inc > high) ? 1 : 0;
+    }
+
+    switch (target->control_mode)
+    {
+    case DRIVE_MODE_TORQUE:
+        causes |= safety_check_torque(target, out->actual_speed_inc, outward);
+        break;
+    case DRIVE_MODE_SPEED:
+        causes |= safety_check_speed(target, outward);
+        break;
+    default:
+        causes |= safety_check_position(target, travel, low, high);
+        break;
+    }
+
+    if (causes != 0)
+    {
+        safety_account(causes, now_us);
+        TRACE_EVENT(TRACE_EV_SAFETY, causes);
+    }
+    if (causes != logged_causes)
+    {
+        if (causes != 0)
+        {
+            ESP_LOGW(TAG, "Output limited, causes 0x%03x", causes);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "Outputs pass again");
+        }
+        logged_causes = causes;
+    }
+    return causes;
+}
+
+uint8_t safety_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    portENTER_CRITICAL(&safety_lock);
+    memcpy(reply, &report, sizeof(report));
+    portEXIT_CRITICAL(&safety_lock);
+    *reply_len = sizeof(report);
+    return PC_CMD_OK;
+}
+
+#else
+
+uint8_t safety_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    return PC_CMD_ERR_UNKNOWN;
+}
+
+#endif /* CONFIG_TR_SAFETY_SUPERVISOR */
@@ -0,0 +1,85 @@
+/*
+ * safety.h
+ *
+ * Safety supervisor. The RPDO task passes every output of the state machine
+ * through safety_apply() before it is encoded, so a bug anywhere in the
+ * control law cannot put an out-of-range target on the bus. The checks work
+ * on the RPDO values and the drive's own TPDO values, in the drive frame:
+ * a positive current or speed increases position_inc, whatever BELT_DRIVEN
+ * does to the commands upstream.
+ *
+ * Per control mode:
+ *   torque (4)    current clamped to SAFETY_MAX_CURRENT and its rise to
+ *                 SAFETY_CURRENT_SLEW per ms; no current that accelerates
+ *                 beyond SAFETY_MAX_SPEED, or drives with more than
+ *                 SAFETY_MAX_POWER (current times mm/s)
+ *   speed (3)     speed clamped to SAFETY_MAX_SPEED and its rise to
+ *                 SAFETY_SPEED_SLEW per ms, current clamped as above
+ *   position (1)  target moved at most SAFETY_POSITION_STEP per cycle
+ * In run, once both limit switch positions are learned, nothing may push
+ * further out past them and a position target is clamped between them.
+ *
+ * A cycle whose drive status is older than SAFETY_DRIVE_TIMEOUT_MS, or in
+ * run with no PC command for SAFETY_PC_TIMEOUT_MS and no heartbeat fallback
+ * in charge (heartbeat.h), goes out in torque mode with zero current, as
+ * does an unknown control mode. Drops towards zero
+ * are never rate limited.
+ *
+ * The work per cycle is a fixed number of comparisons. Each intervention is
+ * counted per cause, recorded as TRACE_EV_SAFETY and logged when the causes
+ * change; PC_CMD_SAFETY_GET returns the counters.
+ */
+
+#ifndef SAFETY_H_
+#define SAFETY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "stateMachine.h"
+
+typedef enum {
+    SAFETY_CAUSE_CURRENT = 0,   // Current above SAFETY_MAX_CURRENT.
+    SAFETY_CAUSE_CURRENT_SLEW,
+    SAFETY_CAUSE_SPEED,         // Speed target above the limit, or current accelerating beyond it.
+    SAFETY_CAUSE_SPEED_SLEW,
+    SAFETY_CAUSE_POSITION,      // Position target outside the travel or moved too far.
+    SAFETY_CAUSE_POWER,
+    SAFETY_CAUSE_TRAVEL,        // Current or speed pushing out past a limit switch.
+    SAFETY_CAUSE_MODE,          // Unknown control mode.
+    SAFETY_CAUSE_PC_STALE,
+    SAFETY_CAUSE_DRIVE_STALE,
+    SAFETY_CAUSES
+} safety_cause_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t interventions;     // Outputs changed.
+    uint16_t count[SAFETY_CAUSES];  // Outputs changed per cause, saturating.
+    uint16_t last_causes;       // Bit per safety_cause_t of the last intervention.
+    uint32_t last_ms;           // Time of the last intervention, ms since boot.
+} safety_report_t;
+
+#ifdef CONFIG_TR_SAFETY_SUPERVISOR
+
+#define SAFETY_MAX_CURRENT          CONFIG_TR_SAFETY_MAX_CURRENT
+#define SAFETY_CURRENT_SLEW         CONFIG_TR_SAFETY_CURRENT_SLEW
+#define SAFETY_MAX_SPEED            CONFIG_TR_SAFETY_MAX_SPEED
+#define SAFETY_SPEED_SLEW           CONFIG_TR_SAFETY_SPEED_SLEW
+#define SAFETY_POSITION_STEP        CONFIG_TR_SAFETY_POSITION_STEP
+#define SAFETY_MAX_POWER            CONFIG_TR_SAFETY_MAX_POWER
+#define SAFETY_PC_TIMEOUT_MS        CONFIG_TR_SAFETY_PC_TIMEOUT_MS
+#define SAFETY_DRIVE_TIMEOUT_MS     CONFIG_TR_SAFETY_DRIVE_TIMEOUT_MS
+
+void safety_pc_frame(void);
+uint16_t safety_apply(output_wrapper *out, int64_t now_us);
+
+#else
+
+#define safety_pc_frame()           ((void)0)
+#define safety_apply(out, now_us)   ((uint16_t)0)
+
+#endif /* CONFIG_TR_SAFETY_SUPERVISOR */
+
+uint8_t safety_cmd_get(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+#endif /* SAFETY_H_ */
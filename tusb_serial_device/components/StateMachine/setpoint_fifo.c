@@ -0,0 +1,293 @@
+/*
+ * setpoint_fifo.c
+ *
+ * Setpoint stream from the PC. See setpoint_fifo.h.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <sys/param.h>
+#include "setpoint_fifo.h"
+#include "pc_command.h"
+
+_Static_assert(sizeof(setpoint_stats_t) <= PC_CMD_REPLY_MAX, "setpoint_stats_t does not fit a reply");
+_Static_assert(sizeof(setpoint_batch_ack_t) <= PC_CMD_REPLY_MAX, "setpoint_batch_ack_t does not fit a reply");
+
+#ifdef CONFIG_TR_SETPOINT_FIFO
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "pc_link.h"
+#include "control_rate.h"
+#include "power_mgmt.h"
+#include "safety.h"
+#include "stateMachine.h"
+#include "heartbeat.h"
+
+_Static_assert(SETPOINT_BATCH_HEADER + SETPOINT_BATCH_MAX * 4 <= PC_SERVICE_MAX_PAYLOAD, "batch does not fit a service frame");
+_Static_assert(SETPOINT_FIFO_DEPTH <= UINT8_MAX, "level is 8 bit");
+
+static const char *TAG = "setpoint";
+
+// Mode (PC_MODE_*) and flags of byte 3 of a command frame, see run_state().
+#define SETPOINT_MODE_MASK          0x03
+#define SETPOINT_CURRENT_ON         0x80
+
+#ifdef CONFIG_TR_SETPOINT_UNDERRUN_RAMP
+#define SETPOINT_CURRENT_STEP       ((int32_t)((int64_t)SETPOINT_RAMP_CURRENT_PER_MS * CONTROL_PERIOD_US / 1000))
+#define SETPOINT_SPEED_STEP         ((int32_t)((int64_t)SETPOINT_RAMP_SPEED_PER_MS * CONTROL_PERIOD_US / 1000))
+#endif
+
+typedef struct {
+    int32_t value;
+    uint8_t mode;
+} setpoint_t;
+
+typedef struct {
+    setpoint_t setpoint;
+    uint16_t seq;
+    bool queued;
+} setpoint_slot_t;
+
+// Batches from the PC and USB receive tasks, cycles from the process task.
+// The setpoint for stats.next_seq + n sits in slot (cycle + n) % depth; only
+// the next SETPOINT_FIFO_DEPTH cycles are taken, so a slot never holds two.
+// cycle does not wrap with the 16 bit sequence numbers, whatever the depth.
+static portMUX_TYPE setpoint_lock = portMUX_INITIALIZER_UNLOCKED;
+static setpoint_slot_t fifo[SETPOINT_FIFO_DEPTH];
+static uint32_t cycle;
+static setpoint_stats_t stats;
+static bool stream_allowed;         // In run; batches are refused otherwise.
+static bool batch_pending;          // A batch came in since the last cycle.
+
+// Process task only.
+static setpoint_t last;
+static uint8_t logged_state;
+
+static void setpoint_flush(void)
+{
+    memset(fifo, 0, sizeof(fifo));
+    stats.level = 0;
+    stats.state = SETPOINT_IDLE;
+}
+
+// As a command frame would carry it.
+static void setpoint_write(uint8_t *pc_msg, const setpoint_t *setpoint)
+{
+    pc_msg[3] = (pc_msg[3] & ~(SETPOINT_MODE_MASK | SETPOINT_CURRENT_ON)) | setpoint->mode;
+    switch (setpoint->mode)
+    {
+    case PC_MODE_POSITION:
+        memcpy(&pc_msg[4], &setpoint->value, 4);
+        break;
+    case PC_MODE_SPEED:
+        memcpy(&pc_msg[8], &setpoint->value, 4);
+        break;
+    default:
+    {
+        int16_t current = (int16_t)setpoint->value;
+        memcpy(&pc_msg[12], &current, 2);
+        pc_msg[3] |= SETPOINT_CURRENT_ON;
+        break;
+    }
+    }
+}
+
+#ifdef CONFIG_TR_SETPOINT_UNDERRUN_RAMP
+static inline int32_t setpoint_towards_zero(int32_t value, int32_t step)
+{
+    return (value > 0) ? MAX(0, value - step) : MIN(0, value + step);
+}
+#endif
+
+/**
+ * @brief Take the setpoint of this cycle, before the state machine runs.
+ *
+ * @param state: state of the state machine; the stream only plays in run.
+ * @param pc_msg: inputs.pc_msg, the setpoint bytes are replaced while a stream plays.
+ * @param now_us: esp_timer time.
+ */
+void setpoint_fifo_apply(enum state_codes state, uint8_t *pc_msg, int64_t now_us)
+{
+    bool got = false;
+    bool fresh;
+    uint8_t stream_state;
+
+    portENTER_CRITICAL(&setpoint_lock);
+    fresh = batch_pending;
+    batch_pending = false;
+    stream_allowed = (state == run);
+    if (!stream_allowed && stats.state != SETPOINT_IDLE)
+    {
+        setpoint_flush();
+    }
+    if (stats.state == SETPOINT_FILLING && stats.level >= SETPOINT_PREFILL)
+    {
+        stats.state = SETPOINT_PLAYING;
+    }
+    if (stats.state == SETPOINT_PLAYING || stats.state == SETPOINT_UNDERRUN)
+    {
+        // One sequence number per cycle, whether or not its setpoint came:
+        // the setpoints after a gap or an underrun still play on their cycle.
+        setpoint_slot_t *slot = &fifo[cycle % SETPOINT_FIFO_DEPTH];
+
+        if (slot->queued && slot->seq == stats.next_seq)
+        {
+            last = slot->setpoint;
+            slot->queued = false;
+            stats.level--;
+            stats.state = SETPOINT_PLAYING;
+            got = true;
+        }
+        else if (stats.level > 0)
+        {
+            stats.gaps++;
+        }
+        else
+        {
+            stats.state = SETPOINT_UNDERRUN;
+            stats.underruns++;
+        }
+        stats.next_seq++;
+        cycle++;
+    }
+    stream_state = stats.state;
+    portEXIT_CRITICAL(&setpoint_lock);
+
+    if (fresh)
+    {
+        power_mgmt_pc_frame();
+        safety_pc_frame();
+        heartbeat_pc_frame(now_us);
+    }
+    if (stream_state != logged_state)
+    {
+        if (stream_state == SETPOINT_UNDERRUN)
+        {
+            ESP_LOGW(TAG, "FIFO ran empty");
+        }
+        logged_state = stream_state;
+    }
+
+    if (stream_state == SETPOINT_IDLE || stream_state == SETPOINT_FILLING)
+    {
+        return; // No stream, or not started yet: the command frames are in charge.
+    }
+#ifdef CONFIG_TR_SETPOINT_UNDERRUN_RAMP
+    if (!got && last.mode == PC_MODE_CURRENT)
+    {
+        last.value = setpoint_towards_zero(last.value, SETPOINT_CURRENT_STEP);
+    }
+    else if (!got && last.mode == PC_MODE_SPEED)
+    {
+        last.value = setpoint_towards_zero(last.value, SETPOINT_SPEED_STEP);
+    }
+#endif
+    setpoint_write(pc_msg, &last);
+}
+
+uint8_t setpoint_cmd_batch(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    if (len < SETPOINT_BATCH_HEADER || (len - SETPOINT_BATCH_HEADER) % 4 != 0 ||
+        len > SETPOINT_BATCH_HEADER + SETPOINT_BATCH_MAX * 4)
+    {
+        return PC_CMD_ERR_LENGTH;
+    }
+
+    uint8_t mode = payload[0];
+    uint16_t seq;
+    size_t count = (len - SETPOINT_BATCH_HEADER) / 4;
+    int32_t values[SETPOINT_BATCH_MAX];
+
+    memcpy(&seq, &payload[1], 2);
+    memcpy(values, &payload[SETPOINT_BATCH_HEADER], count * 4);
+    if (mode > PC_MODE_CURRENT)
+    {
+        return PC_CMD_ERR_ARG;
+    }
+    for (size_t i = 0; i < count && mode == PC_MODE_CURRENT; i++)
+    {
+        if (values[i] < INT16_MIN || values[i] > INT16_MAX)
+        {
+            return PC_CMD_ERR_ARG;
+        }
+    }
+
+    setpoint_batch_ack_t ack = {0};
+    portENTER_CRITICAL(&setpoint_lock);
+    if (!stream_allowed)
+    {
+        portEXIT_CRITICAL(&setpoint_lock);
+        return PC_CMD_ERR_BUSY;
+    }
+    stats.batches++;
+    batch_pending = true;
+    if (count == 0)
+    {
+        setpoint_flush();
+    }
+    else if (stats.state == SETPOINT_IDLE)
+    {
+        stats.state = SETPOINT_FILLING;
+        stats.next_seq = seq;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        uint16_t setpoint_seq = (uint16_t)(seq + i);
+        int16_t ahead = (int16_t)(setpoint_seq - stats.next_seq);
+        setpoint_slot_t *slot;
+
+        if (ahead < 0)
+        {
+            stats.late++;       // Its cycle has been played.
+            continue;
+        }
+        if (ahead >= SETPOINT_FIFO_DEPTH)
+        {
+            stats.overruns++;
+            continue;
+        }
+        slot = &fifo[(cycle + ahead) % SETPOINT_FIFO_DEPTH];
+        if (!slot->queued)
+        {
+            stats.level++;
+        }
+        *slot = (setpoint_slot_t){
+            .setpoint = {.value = values[i], .mode = mode},
+            .seq = setpoint_seq,
+            .queued = true,
+        };
+        stats.queued++;
+        ack.accepted++;
+    }
+    ack.next_seq = stats.next_seq;
+    ack.level = stats.level;
+    portEXIT_CRITICAL(&setpoint_lock);
+
+    memcpy(reply, &ack, sizeof(ack));
+    *reply_len = sizeof(ack);
+    return PC_CMD_OK;
+}
+
+uint8_t setpoint_cmd_status(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    portENTER_CRITICAL(&setpoint_lock);
+    memcpy(reply, &stats, sizeof(stats));
+    portEXIT_CRITICAL(&setpoint_lock);
+    *reply_len = sizeof(stats);
+    return PC_CMD_OK;
+}
+
+#else
+
+uint8_t setpoint_cmd_batch(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    return PC_CMD_ERR_UNKNOWN;
+}
+
+uint8_t setpoint_cmd_status(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    return PC_CMD_ERR_UNKNOWN;
+}
+
+#endif /* CONFIG_TR_SETPOINT_FIFO */
@@ -0,0 +1,87 @@
+/*
+ * setpoint_fifo.h
+ *
+ * Setpoint stream from the PC. A PC_CMD_SETPOINT_BATCH service frame carries
+ * up to SETPOINT_BATCH_MAX setpoints of one mode, numbered by the control
+ * cycle they are meant for:
+ *   [0]      mode, as in byte 3 of a command frame: 0 position, 1 speed, 2 current
+ *   [1..2]   uint16 sequence number of the first setpoint, +1 per cycle
+ *   [3..]    int32 setpoints, in the units of the command frame
+ * An empty batch ends the stream. The reply (setpoint_batch_ack_t) gives the
+ * PC the fill level to pace its batches by.
+ *
+ * In run, the process task takes one setpoint per cycle and writes it into
+ * inputs.pc_msg, so the state machine runs from it as from a command frame;
+ * the flags in byte 2 still come from the command frames. Playback starts
+ * once SETPOINT_PREFILL setpoints are queued; from then on the sequence
+ * number advances every cycle, in underrun too, and each setpoint plays on
+ * its own cycle. A cycle without a setpoint holds the last one, or with
+ * CONFIG_TR_SETPOINT_UNDERRUN_RAMP a current or speed ramps to zero; a
+ * position is always held.
+ *
+ * A setpoint for a cycle already played is dropped as late, one more than
+ * SETPOINT_FIFO_DEPTH cycles ahead as an overrun; a second setpoint for the
+ * same cycle replaces the first. Batches count as frames from the PC for
+ * the heartbeat, the safety supervisor and power management.
+ *
+ * Built only with CONFIG_TR_SETPOINT_FIFO; otherwise the call compiles to
+ * nothing and the batch command is unknown.
+ */
+
+#ifndef SETPOINT_FIFO_H_
+#define SETPOINT_FIFO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "StateStatusLED.h"
+
+#define SETPOINT_BATCH_HEADER       3
+#define SETPOINT_BATCH_MAX          7   // Fills a service frame payload.
+
+typedef enum {
+    SETPOINT_IDLE = 0,          // No stream, the command frames are in charge.
+    SETPOINT_FILLING,           // Stream started, waiting for SETPOINT_PREFILL setpoints.
+    SETPOINT_PLAYING,
+    SETPOINT_UNDERRUN,          // FIFO ran empty; holding or ramping, the cycles go on.
+} setpoint_state_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t next_seq;          // Sequence number of the next cycle played.
+    uint8_t level;              // Setpoints queued.
+    uint8_t accepted;           // Setpoints of this batch queued.
+} setpoint_batch_ack_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t batches;
+    uint32_t queued;            // Setpoints accepted.
+    uint32_t underruns;         // Cycles without a setpoint, FIFO empty.
+    uint32_t overruns;          // Setpoints dropped, too far ahead.
+    uint32_t late;              // Setpoints dropped, their cycle was already played.
+    uint32_t gaps;              // Cycles without a setpoint, later ones queued.
+    uint16_t next_seq;
+    uint8_t level;
+    uint8_t state;              // setpoint_state_t
+} setpoint_stats_t;
+
+#ifdef CONFIG_TR_SETPOINT_FIFO
+
+#define SETPOINT_FIFO_DEPTH         CONFIG_TR_SETPOINT_FIFO_DEPTH
+#define SETPOINT_PREFILL            CONFIG_TR_SETPOINT_PREFILL
+#ifdef CONFIG_TR_SETPOINT_UNDERRUN_RAMP
+#define SETPOINT_RAMP_CURRENT_PER_MS CONFIG_TR_SETPOINT_RAMP_CURRENT_PER_MS
+#define SETPOINT_RAMP_SPEED_PER_MS  CONFIG_TR_SETPOINT_RAMP_SPEED_PER_MS
+#endif
+
+void setpoint_fifo_apply(enum state_codes state, uint8_t *pc_msg, int64_t now_us);
+
+#else
+
+#define setpoint_fifo_apply(state, pc_msg, now_us)  ((void)0)
+
+#endif /* CONFIG_TR_SETPOINT_FIFO */
+
+uint8_t setpoint_cmd_batch(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+uint8_t setpoint_cmd_status(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+#endif /* SETPOINT_FIFO_H_ */
@@ -0,0 +1,101 @@
+/*
+ * startup.c
+ *
+ * Startup orchestrator. See startup.h.
+ */
+
+#include "startup.h"
+#include "boot_profile.h"
+#include "rtos_objects.h"
+#include "esp_log.h"
+
+static const char *TAG = "startup";
+
+// Step bits and the startup task's done bit share startup_event_group, 24 bits.
+#define STARTUP_TASK_DONE_BIT   (1UL << STARTUP_MAX_STEPS)
+
+static portMUX_TYPE startup_lock = portMUX_INITIALIZER_UNLOCKED;
+static const startup_step_t *startup_steps;
+static size_t startup_count;
+static size_t next_step;
+static uint32_t failed_steps;
+
+// Run steps until none is left. Called by app_main and the startup task at the same time.
+static void startup_work(void)
+{
+    while (1)
+    {
+        size_t i;
+        portENTER_CRITICAL(&startup_lock);
+        i = next_step++;
+        portEXIT_CRITICAL(&startup_lock);
+        if (i >= startup_count)
+        {
+            return;
+        }
+
+        const startup_step_t *step = &startup_steps[i];
+        if (step->after != 0)
+        {
+            // Dependencies are earlier in the table, so they are taken already and will finish.
+            xEventGroupWaitBits(startup_event_group, step->after, pdFALSE, pdTRUE, portMAX_DELAY);
+        }
+
+        esp_err_t err;
+        if (failed_steps & step->after)
+        {
+            err = ESP_ERR_INVALID_STATE;
+        }
+        else
+        {
+            int64_t start_us = boot_profile_now_us();
+            err = step->fn();
+            boot_profile_phase(step->name, start_us, boot_profile_now_us());
+        }
+
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "%s failed: %s", step->name, esp_err_to_name(err));
+            portENTER_CRITICAL(&startup_lock);
+            failed_steps |= STARTUP_AFTER(i);
+            portEXIT_CRITICAL(&startup_lock);
+        }
+        xEventGroupSetBits(startup_event_group, STARTUP_AFTER(i));
+    }
+}
+
+void startup_task(void *arg)
+{
+    startup_work();
+    xEventGroupSetBits(startup_event_group, STARTUP_TASK_DONE_BIT);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Run the steps on app_main and the startup task, and return when all
+ *        are done. Needs rtos_objects_init() first.
+ *
+ * @param steps: step table, dependencies before the steps that need them.
+ * @param count: number of steps, at most STARTUP_MAX_STEPS.
+ * @return ESP_OK, or ESP_FAIL if any step failed.
+ */
+esp_err_t startup_run(const startup_step_t *steps, size_t count)
+{
+    if (count > STARTUP_MAX_STEPS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    startup_steps = steps;
+    startup_count = count;
+    next_step = 0;
+    failed_steps = 0;
+    xEventGroupClearBits(startup_event_group, STARTUP_AFTER(STARTUP_MAX_STEPS + 1) - 1);
+
+    rtos_task_start(RTOS_TASK_startup);
+    startup_work();
+    xEventGroupWaitBits(startup_event_group, STARTUP_TASK_DONE_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+
+    boot_profile_mark(BOOT_MARK_STARTUP_DONE);
+    return (failed_steps == 0) ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,39 @@
+/*
+ * startup.h
+ *
+ * Startup orchestrator. app_main hands over a table of init steps, each with
+ * the steps it needs done first. app_main and the startup task (rtos_objects.h)
+ * both take the next step in table order, wait for its dependencies and run
+ * it, so independent steps overlap: while one core blocks in the LED clear or
+ * the USB install, the other brings up the drive. Each step is recorded in
+ * the boot profile.
+ *
+ * List a step after the steps it depends on. A step whose dependency failed
+ * is not run and counts as failed.
+ */
+
+#ifndef STARTUP_H_
+#define STARTUP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_err.h"
+
+#define STARTUP_MAX_STEPS       23
+#define STARTUP_AFTER(step)     (1UL << (step))
+
+typedef struct {
+    const char *name;
+    esp_err_t (*fn)(void);
+    uint32_t after;             // STARTUP_AFTER() of each dependency, or 0.
+} startup_step_t;
+
+// Created from static storage in rtos_objects.c.
+extern EventGroupHandle_t startup_event_group;
+
+esp_err_t startup_run(const startup_step_t *steps, size_t count);
+void startup_task(void *arg);
+
+#endif /* STARTUP_H_ */
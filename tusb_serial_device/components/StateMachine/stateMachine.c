@@ -5,7 +5,16 @@
  *      Author: BC
  */
 
+#include <inttypes.h>
 #include "stateMachine.h"
+#include "load_cell_cal.h"
+#include "trace.h"
+#include "deadline_monitor.h"
+#include "control_rate.h"
+#include "recorder.h"
+
+_Static_assert(LC_CAL_MAX_FORCE_DN <= INT16_MAX, "the calibrated force goes to the PC as int16");
+
 #define BELT_DRIVEN
 
 
@@ -23,7 +32,13 @@ bool handle_button = false;
 
 int TRANS_COUNT = 14; 
 
-static int speed_array[5] = {0};
+// Moving average of the drive speed over 20 ms, 5 cycles at 250 Hz.
+#define SPEED_AVG_WINDOW CONTROL_CYCLES(20000)
+// Cycles a limit switch has to read active before its position is taken.
+#define LS_DEBOUNCE_CYCLES CONTROL_CYCLES(12000)
+
+static int speed_array[SPEED_AVG_WINDOW] = {0};
+static bytes_int_conv converter;
 /* array and enum below must be in sync! */
 enum ret_codes (* state[])(void) = { powerUp_state, enabled_state, initialising_state, 
     ready_state, run_state, estop_state, wifiConfig_state, devMatching_state};
@@ -47,6 +62,7 @@ struct transition state_transitions[] = {
     {enabled, ok,  initialising},
 	{enabled, back,  wifiConfig},
 	{wifiConfig, repeat,  wifiConfig},
+	{wifiConfig, ok,  enabled},
 
     {initialising, repeat,  initialising},
     {initialising, ok,  ready},
@@ -129,7 +145,7 @@ enum ret_codes enabled_state(void)
 	ESP_LOGI("enbled", "enabled");
 	// Set control mode to 0. Set speed to 0.
 
-	set_control_mode(1);
+	set_control_mode(PC_MODE_SPEED);
 	setSpeed(0); 
 	
 	// 可以用handle button 或者上位机来初始化
@@ -148,9 +164,10 @@ enum ret_codes enabled_state(void)
 	else if (flags.rtn_event_triggered)
 	{
 		/* code */
+		// Provisioning runs in its own task, the loop keeps its cycle meanwhile.
 		printf("Starting smart config.");
-		 start_smart_config(); 
-		 return back; 
+		wifi_prov_request();
+		return back; 
 	}
 	
 	else {
@@ -165,8 +182,19 @@ enum ret_codes devMatching_state(void)
 }
 
 
+/*
+ * Motor held as in enabled while the provisioning task waits for the phone app.
+ * Back to enabled once it is done or has timed out and the button is released.
+ */
 enum ret_codes wifiConfig_state(void)
 {
+	set_control_mode(PC_MODE_SPEED);
+	setSpeed(0); 
+
+	if (!wifi_prov_busy() && !flags.rtn_event_triggered)
+	{
+		return ok; 
+	}
 	return repeat; 
 }
 
@@ -187,7 +215,7 @@ enum ret_codes initialising_state(void)
 	switch(init_stages)
     {
         case move_motor:
-            set_control_mode(1);
+            set_control_mode(PC_MODE_SPEED);
 			setSpeed(40); 
 			if(getMotorLS())
 			{
@@ -206,13 +234,13 @@ enum ret_codes initialising_state(void)
             break;
 
         case move_far:
-			set_control_mode(1); 
+			set_control_mode(PC_MODE_SPEED); 
 			setSpeed(-40); 
 		//    printf("nmd");
 		    if(getFarLS())
 			{
 				init_stages = centre_error; 
-				set_control_mode(1);
+				set_control_mode(PC_MODE_SPEED);
 				setSpeed(0);
 				printf("Far side LS reached \n");  
 			}
@@ -245,7 +273,7 @@ enum ret_codes initialising_state(void)
             break;
 		
 		case initialised:
-            set_control_mode(1);
+            set_control_mode(PC_MODE_SPEED);
 			setSpeed(0); 
 			ESP_LOGI("Init state", "Init done");
 			return ok; 
@@ -283,7 +311,7 @@ enum ret_codes ready_state(void)
     
 	
 
-	set_control_mode(2); 
+	set_control_mode(PC_MODE_CURRENT); 
 	setCurrent(0); 
 	return ok; 
 }
@@ -294,7 +322,6 @@ enum ret_codes run_state(void)
 {
 	uint8_t motor_control_mode = inputs.pc_msg[3] & 3; 
 	// ESP_LOGI("run_state", "Mode: %d \n", inputs.pc_msg[3]);
-	bool use_desired_force = true; 
 	// memcpy(outputs.to_pc, inputs.robot_msg, MSG_LENGTH_UP); 
 	short int desired_current= getDesiredCurrentFromPC(); 
 	int position_no_offset = getCurrentPosition(0); 
@@ -304,9 +331,9 @@ enum ret_codes run_state(void)
 
 
 	// Position control. 
-	case 0:
+	case PC_MODE_POSITION:
 		
-		set_control_mode(0); 
+		set_control_mode(PC_MODE_POSITION); 
 		int desiredP = getDesiredPositionFromPC();
 		setDesiredPosition(desiredP, zero_position);
 		// ESP_LOGI("run_state", "Mode: %d \n", motor_control_mode);
@@ -315,15 +342,15 @@ enum ret_codes run_state(void)
 		// printf("desired = %d \n", desiredP);
 		/* code */
 		break;
-	case 1: // Speed control 
+	case PC_MODE_SPEED: // Speed control 
 			// ESP_LOGI("run_state", "Mode: %d \n", motor_control_mode);
-			set_control_mode(1); 
+			set_control_mode(PC_MODE_SPEED); 
 			setSpeedIncFromPC();
 		break;
-	case 2: // Currrent control
+	case PC_MODE_CURRENT: // Currrent control
 		// ESP_LOGI("run_state", "Mode: %d \n", motor_control_mode);
 
-		set_control_mode(2); 
+		set_control_mode(PC_MODE_CURRENT); 
 		if(inputs.pc_msg[3]&128)
 		{
 			
@@ -436,17 +463,17 @@ void set_control_mode(uint8_t control_mode)
 
 	switch (control_mode)
 	{
-	case 0:/* Position control  */
+	case PC_MODE_POSITION:/* Position control  */
 		/* code */
-		outputs.target_motor_paras.control_mode = 1; 
+		outputs.target_motor_paras.control_mode = DRIVE_MODE_POSITION; 
 		break;
-	case 1:/* Speed control  */
+	case PC_MODE_SPEED:/* Speed control  */
 		/* code */
-		outputs.target_motor_paras.control_mode = 3; 
+		outputs.target_motor_paras.control_mode = DRIVE_MODE_SPEED; 
 		break;
-	case 2:/* Torque control;  */
+	case PC_MODE_CURRENT:/* Torque control;  */
 		/* code */
-		outputs.target_motor_paras.control_mode = 4; 
+		outputs.target_motor_paras.control_mode = DRIVE_MODE_TORQUE; 
 		break;
 	default:
 		break;
@@ -463,11 +490,8 @@ void init_state_machine(void){
 	
 	// We are not direct copy pc message to FPGA. Hence, we will always change outputs.to_robot
 	memcpy(outputs.to_robot, msg_defaults, 14); 
-	bool estop_pressed =false;
 	cur_state = powerUp;
 
-	Temp_F=0;
-
 	Temp_speed=0;
 	New_speed=0;
 	gap=0;
@@ -486,6 +510,8 @@ int motor_ls_counter = 0;
 bool main_fsm_function(void) {
 
 	//printf("进入状态机测试…………");
+	TRACE_EVENT(TRACE_EV_FSM_BEGIN, cur_state);
+	recorder_begin(cur_state);
 	 
 	state_fun = state[cur_state];
     rc = state_fun();
@@ -548,7 +574,7 @@ bool main_fsm_function(void) {
 	{
 		if(getFarLS()){
 			far_ls_counter++; 
-			if(far_ls_counter == 3)
+			if(far_ls_counter == LS_DEBOUNCE_CYCLES)
 			{
 				far_ls_position = getCurrentPosition(0); 
 				far_ls_counter = 0; 
@@ -561,7 +587,7 @@ bool main_fsm_function(void) {
 	{
 		if(getMotorLS()){
 			motor_ls_counter ++; 
-			if(motor_ls_counter == 3)
+			if(motor_ls_counter == LS_DEBOUNCE_CYCLES)
 			{
 				motor_ls_position = getCurrentPosition(0);
 				motor_ls_counter = 0 ; 
@@ -592,26 +618,16 @@ bool main_fsm_function(void) {
 	// converter.input[1] =inputs.robot_msg[29];
 	// converter.input[2] =inputs.robot_msg[30];
 	// converter.input[3] =inputs.robot_msg[31];
-	inter_force = inputs.inter_force_inc; 
+	// Calibrated force in 0.1 N. The handle switch reads 0 while the handle is held.
+	bool lc_at_rest = gpio_get_level(HANDLE_SW_PIN) != 0 &&
+		Temp_speed < LC_CAL_REST_SPEED_INC && Temp_speed > -LC_CAL_REST_SPEED_INC;
+	inter_force = lc_cal_process(inputs.inter_force_inc, inputs.inter_force_confidence,
+		lc_at_rest, inputs.motor_data.sample_time_us);
 
 
 	//电流数据拆分（27-30位）
 	// converter.input[0] =inputs.robot_msg[18];
 	// converter.input[1] =inputs.robot_msg[19];
-	short int I = inputs.motor_data.actual_current; 
-	//printf("I,%d", I);
-	//printf("\n");
-    //原始电流数据打印
-
-	if(inter_force>1000||inter_force<-1000)
-	{
-		inter_force=Temp_F;
-	}
-	else
-	{
-
-		Temp_F = converter.value;
-	}
 
 	// Here to process the message sent to the PC.
 	processUpwardUdpMsg();
@@ -641,12 +657,18 @@ bool main_fsm_function(void) {
 		// printf("dst: %d;\n", cur_state);
 	}
 	else { 
+		if(cur_state != estop)
+		{
+			trace_trigger(TRACE_TRIG_ESTOP);
+		}
 		cur_state = estop;
 		printf("Current state: estop\n"); 
 		led_state(cur_state);
 
 	}
 
+	recorder_push(cur_state);
+	TRACE_EVENT(TRACE_EV_FSM_END, cur_state);
 	return effective_robot_msg; 
 
 }
@@ -657,9 +679,9 @@ void setSpeed(float desired_speed)
 {
 
 	#ifndef BELT_DRIVEN	
-    	int desired_speed_inc = (int) (-desired_speed*16384);
+    	int desired_speed_inc = (int) (-desired_speed*DRIVE_SPEED_PER_MM_S);
 	#else
-			int desired_speed_inc = (int) (-desired_speed*16384); // The lead of beltdirven module is 40mm twice of the previous screw module. 
+			int desired_speed_inc = (int) (-desired_speed*DRIVE_SPEED_PER_MM_S); // The lead of beltdirven module is 40mm twice of the previous screw module. 
 	#endif 
 	// outputs.to_robot[8] = desired_speed_inc  & 0xFF;
 	// outputs.to_robot[9] = (desired_speed_inc >> 8) & 0xFF;
@@ -841,7 +863,7 @@ int movingAvg(int *ptrArrNumbers, int len, int nextNum, bool reset)
 /// This function is used to set take a moving average of current speed and replace the robot uploaed speed with it. 
 void setCurrentSpeed(int processed_speed)
 {
-	inputs.motor_data.speed_inc =  movingAvg(speed_array, 5, processed_speed, false);
+	inputs.motor_data.speed_inc =  movingAvg(speed_array, SPEED_AVG_WINDOW, processed_speed, false);
 	
 	// inputs.robot_msg[14] = converter.input[0] ;
 	// inputs.robot_msg[15] = converter.input[1] ;
@@ -859,13 +881,17 @@ void processUpwardUdpMsg(void)
 	// ESP_LOG_BUFFER_HEXDUMP("P_out", &inputs.motor_data.position_inc, 4, ESP_LOG_INFO);
 	// memcpy(outputs.to_pc, inputs.robot_msg, MSG_LENGTH_UP); 
 	memcpy(&outputs.to_pc[4], &inputs.motor_data.control_mode,1); 
+	outputs.to_pc[5] = deadline_level(); // Health: 0 normal, 3 zero torque after overruns.
 	memcpy(&outputs.to_pc[6], &inputs.motor_data.status_word,2); 
 	memcpy(&outputs.to_pc[8], &inputs.motor_data.error_code,2); 
 	memcpy(&outputs.to_pc[10], &inputs.motor_data.position_inc_offset, 4); 
 	converter.value =linear_speed;
 	memcpy(&outputs.to_pc[14],  &converter.input, 4); 
 	memcpy(&outputs.to_pc[18], &inputs.motor_data.actual_current, 2); 
-	memcpy(&outputs.to_pc[28], &inputs.inter_force_inc, 4);
+	memcpy(&outputs.to_pc[20], &inputs.motor_data.sample_time_us, 8); // Device time of this sample, see time_sync.h.
+	memcpy(&outputs.to_pc[28], &inputs.inter_force_inc, 4); // Raw load cell counts.
+	int16_t force_dn = (int16_t)inter_force; // Calibrated, 0.1 N; lc_cal_process() keeps it within +-LC_CAL_MAX_FORCE_DN.
+	memcpy(&outputs.to_pc[2], &force_dn, 2);
 	// printf("Position is %d \n", inputs.motor_data.position_inc);
 	int handle_sw_status = gpio_get_level(HANDLE_SW_PIN); 
 	int rtn_sw_status = gpio_get_level(RETURN_SW_PIN); 
@@ -993,7 +1019,7 @@ short int Compensation(int V, int F, int resistance_I)
  	// short int interface_cap = 7; 
   //******************************************************************************
 
-  float linear_speed=V/16384;
+  float linear_speed=V/DRIVE_SPEED_PER_MM_S;
   
   float interaction_force=(float) F/10;
 
@@ -1065,7 +1091,7 @@ short int Compensation(int V, int F, int resistance_I)
 uint8_t abnormal_detection(int V, int game_generated_current)
 {
 	// int64_t t2 = esp_timer_get_time();
-	int vel_osci_thres = 1638400;
+	int vel_osci_thres = 100 * DRIVE_SPEED_PER_MM_S;
     int peak_thres = 3; 
 
 	// If game generated desired current is virtually none. No need to for abnormal detection. 
@@ -1104,7 +1130,7 @@ uint8_t abnormal_detection(int V, int game_generated_current)
 			if((current_time - osci_record[0]) > 500000)
 			{
 				detected = false; 
-				printf("%lld\n", current_time);
+				printf("%" PRId64 "\n", current_time);
 
 			
 			
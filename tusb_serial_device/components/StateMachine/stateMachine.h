@@ -28,7 +28,6 @@
 #include "esp_netif.h"
 #include "driver/gpio.h"
 #include "driver/uart.h"
-#include "led_strip.h"
 #include "StateStatusLED.h"
 #include "wifiConnection.h"
 // #include "can_open_comm.h"
@@ -42,15 +41,16 @@
 
 #define RTN_PRESS_EVENT_BIT BIT0
 
-QueueHandle_t uart_queue; 
-QueueHandle_t udp_send_queue;
+// Created from static storage in rtos_objects.c.
+extern QueueHandle_t uart_queue; 
+extern QueueHandle_t udp_send_queue;
 // QueueHandle_t uart_tx_queue;
-QueueHandle_t can_send_queue; 
-QueueHandle_t can_receive_queue; 
+extern QueueHandle_t can_send_queue; 
+extern QueueHandle_t can_receive_queue; 
 
 
-static SemaphoreHandle_t timer_start_sem;
-static SemaphoreHandle_t init_done_sem; 
+extern SemaphoreHandle_t timer_start_sem;
+extern SemaphoreHandle_t init_done_sem; 
 
 
 
@@ -66,8 +66,6 @@ typedef union
 } bytes_int_conv;
 
 
-static bytes_int_conv converter; 
-
 
 struct flag_wrapper
 {
@@ -94,6 +92,8 @@ typedef struct {
     uint8_t far_side_ls;
     uint8_t centre_ls; 
 
+    int64_t sample_time_us; // esp_timer time the TPDO1 of this cycle was received.
+
     
 
 } motor_status_t;
@@ -118,6 +118,12 @@ typedef struct
     target_motor_para_t target_motor_paras; 
     uint8_t to_pc[34] ;
     int return_code ; // !Not being used anymore
+    int64_t input_time_us; // motor_data.sample_time_us the targets were computed from, for the deadline monitor.
+    // For the safety supervisor: the state and the drive status the targets were computed in.
+    uint8_t state;
+    int actual_position_inc;
+    int actual_speed_inc;
+    uint8_t fallback;           // 1 when the targets come from the heartbeat fallback, not from the PC.
 } output_wrapper  ;
 
 output_wrapper outputs; 
@@ -137,7 +143,7 @@ typedef struct
     motor_status_t motor_status; 
     int lc_value; // Inc value from the torque sensor. 
     // queue_sender q_sender; 
-    int sender_int; // 0: robot_rx; 1: PC_UDP_rev; 2: Rtn_button press monitor task. 3. 485 of load cell. 
+    int sender_int; // 0: robot_rx; 1: PC_UDP_rev; 2: Rtn_button press monitor task. 3. 485 of load cell (not used, the force is resampled per cycle). 
     uint8_t process_flag;  // Bit0: rtn_pressed; 
 
 } queue_msg;
@@ -146,7 +152,9 @@ struct input_wrapper
 {
     // uint8_t robot_msg[34];
     motor_status_t motor_data; 
-    int inter_force_inc; 
+    int inter_force_inc;        // Load cell value resampled to motor_data.sample_time_us.
+    int inter_force_age_us;     // Cycle time minus the newest load cell sample time.
+    uint8_t inter_force_confidence; // 0..100, see load_cell_force_at().
     uint8_t pc_msg[14]; 
 
 } inputs; 
@@ -214,13 +222,14 @@ int Temp_speed;
 int New_speed;
 int gap;
 
-int Temp_F;
-
 int temp_position;
 
 int linear_speed;
 int linear_position;
-int inter_force;  // 交互力传感器信息。
+// Raw positions of the limit switches, 0 until passed since enabling.
+extern int far_ls_position;
+extern int motor_ls_position;
+int inter_force;  // 交互力传感器信息。 Calibrated, 0.1 N, see lc_cal_process().
 
 
 int zero_position; 
@@ -233,10 +242,24 @@ enum ret_codes rc;
 int estop_pressed;
 
 
-static void rtn_button_timer_task(void *pvParameters); 
+void rtn_button_timer_task(void *pvParameters);
 
 void setSpeed(float desired_speed);
 void setCurrent(short int desired_current);
+
+// Modes of byte 3 of a PC command frame, the argument of set_control_mode().
+#define PC_MODE_POSITION        0
+#define PC_MODE_SPEED           1
+#define PC_MODE_CURRENT         2
+
+// Drive control modes as sent in the RPDOs, what set_control_mode() puts in target_motor_paras.
+#define DRIVE_MODE_POSITION     1
+#define DRIVE_MODE_SPEED        3
+#define DRIVE_MODE_TORQUE       4
+
+// speed_inc per mm/s of the slider, as in setSpeed() and abnormal_detection().
+#define DRIVE_SPEED_PER_MM_S    16384
+
 void set_control_mode(uint8_t control_mode); 
 bool main_fsm_function(void); 
 
@@ -266,10 +289,8 @@ void setSpeedIncFromPC(void);
 
 
 
-static int rtn_button_press_seconds  ; 
-
 
-static EventGroupHandle_t key_press_event_group;
+extern EventGroupHandle_t key_press_event_group;
 
 // output_wrapper powerUp_state(input_wrapper inputs);
 // output_wrapper enabled_state(input_wrapper inputs);
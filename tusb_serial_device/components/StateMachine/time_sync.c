@@ -0,0 +1,30 @@
+/*
+ * time_sync.c
+ *
+ * Clock exchange for the PC. See time_sync.h.
+ */
+
+#include <string.h>
+#include "time_sync.h"
+#include "pc_command.h"
+#include "esp_timer.h"
+
+_Static_assert(sizeof(time_sync_reply_t) <= PC_CMD_REPLY_MAX, "time_sync_reply_t does not fit a reply");
+
+uint8_t time_sync_cmd(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    time_sync_reply_t sync;
+
+    // The handler runs as the frame is parsed, so this is the receive time up to the task wake-up.
+    sync.rx_us = esp_timer_get_time();
+    if (len != sizeof(sync.pc_time))
+    {
+        return PC_CMD_ERR_LENGTH;
+    }
+    memcpy(&sync.pc_time, payload, sizeof(sync.pc_time));
+    sync.tx_us = esp_timer_get_time();
+
+    memcpy(reply, &sync, sizeof(sync));
+    *reply_len = sizeof(sync);
+    return PC_CMD_OK;
+}
@@ -0,0 +1,27 @@
+/*
+ * time_sync.h
+ *
+ * Clock exchange for the PC, as an NTP client query. The PC sends its own
+ * time t1 with PC_CMD_TIME_SYNC and notes the time t4 the reply comes in;
+ * the reply carries t1 back and the esp_timer times t2 and t3 at which the
+ * request was handled and answered. Every robot frame carries the
+ * esp_timer time of its drive sample in bytes 20..27, so with the offset
+ * and drift fitted over a few exchanges the PC maps it to its own clock
+ * (tools/timesync.py). Works over whichever link the request came on.
+ */
+
+#ifndef TIME_SYNC_H_
+#define TIME_SYNC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct __attribute__((packed)) {
+    uint64_t pc_time;           // t1, as sent; any unit.
+    int64_t rx_us;              // t2, esp_timer
+    int64_t tx_us;              // t3, esp_timer
+} time_sync_reply_t;
+
+uint8_t time_sync_cmd(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+#endif /* TIME_SYNC_H_ */
@@ -0,0 +1,130 @@
+/*
+ * trace.c
+ *
+ * Event tracer rings, triggers and console dump. See trace.h.
+ */
+
+#include "trace.h"
+#include "pc_command.h"
+#include "stateMachine.h"
+
+#ifdef CONFIG_TR_TRACE_ENABLE
+
+#include "esp_freertos_hooks.h"
+
+static const char *TAG = "trace";
+
+_Static_assert((TRACE_DEPTH & (TRACE_DEPTH - 1)) == 0, "CONFIG_TR_TRACE_DEPTH must be a power of two");
+
+trace_ring_t trace_rings[portNUM_PROCESSORS];
+volatile int32_t trace_countdown = -1;
+volatile bool trace_frozen;
+
+static volatile uint8_t trigger_reason;
+
+// Tick interrupt of each core: pairs the core cycle counter with esp_timer.
+// In IRAM, the tick keeps running while the flash cache is off.
+static void IRAM_ATTR trace_tick_hook(void)
+{
+    TRACE_EVENT(TRACE_EV_CLOCK, (uint32_t)esp_timer_get_time());
+}
+
+/**
+ * @brief Stop recording TRACE_POST_TRIGGER events from now. Further triggers
+ *        before trace_rearm() are ignored.
+ */
+void trace_trigger(trace_trigger_t reason)
+{
+    if (trace_frozen || trace_countdown >= 0)
+    {
+        return;
+    }
+    trigger_reason = reason;
+    TRACE_EVENT(TRACE_EV_TRIGGER, reason);
+    trace_countdown = TRACE_POST_TRIGGER;
+}
+
+void trace_rearm(void)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        trace_rings[core].head = 0;
+    }
+    trigger_reason = 0;
+    trace_countdown = -1;
+    trace_frozen = false;
+}
+
+static void trace_dump(void)
+{
+    printf("TRACE begin mhz=%d depth=%d trigger=%d\n", CONFIG_ESP32S3_DEFAULT_CPU_FREQ_MHZ, TRACE_DEPTH, trigger_reason);
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        const trace_ring_t *ring = &trace_rings[core];
+        uint32_t count = MIN(ring->head, TRACE_DEPTH);
+        for (uint32_t i = ring->head - count; i != ring->head; i++)
+        {
+            const trace_event_t *event = &ring->events[i & (TRACE_DEPTH - 1)];
+            printf("T %d %08x %u %08x\n", core, event->ccount, event->id, event->arg);
+        }
+    }
+    printf("TRACE end\n");
+}
+
+// Prints the rings once they freeze. The lowest priority keeps the slow
+// console output out of the way of the control tasks.
+void trace_task(void *arg)
+{
+    bool dumped = false;
+
+    while (1)
+    {
+        vTaskDelay(pdMS_TO_TICKS(100));
+        if (trace_frozen && !dumped)
+        {
+            ESP_LOGW(TAG, "Trace frozen, trigger %d", trigger_reason);
+            trace_dump();
+            dumped = true;
+        }
+        else if (!trace_frozen)
+        {
+            dumped = false;
+        }
+    }
+}
+
+void trace_init(void)
+{
+    trace_rearm();
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        ESP_ERROR_CHECK(esp_register_freertos_tick_hook_for_cpu(trace_tick_hook, core));
+    }
+    ESP_LOGI(TAG, "Tracing %d events per core", TRACE_DEPTH);
+}
+
+uint8_t trace_cmd_trigger(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    trace_trigger(TRACE_TRIG_MANUAL);
+    return PC_CMD_OK;
+}
+
+uint8_t trace_cmd_rearm(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    trace_rearm();
+    return PC_CMD_OK;
+}
+
+#else
+
+uint8_t trace_cmd_trigger(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    return PC_CMD_ERR_UNKNOWN;
+}
+
+uint8_t trace_cmd_rearm(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len)
+{
+    return PC_CMD_ERR_UNKNOWN;
+}
+
+#endif /* CONFIG_TR_TRACE_ENABLE */
@@ -0,0 +1,108 @@
+/*
+ * trace.h
+ *
+ * Hot path event tracer. TRACE_EVENT(id, arg) stores the CPU cycle count, the
+ * event id and a 32 bit argument in a ring buffer of the calling core, with
+ * interrupts masked for the few instructions it takes. Built only with
+ * CONFIG_TR_TRACE_ENABLE; otherwise TRACE_EVENT compiles to nothing.
+ *
+ * A trigger (deadline miss, estop, PC command) lets TRACE_POST_TRIGGER more
+ * events in and then freezes the rings. The frozen rings are printed on the
+ * console, one "T core ccount id arg" line per event, and
+ * tools/trace2perfetto.py turns that log into a Chrome/Perfetto trace. Each
+ * core also records TRACE_EV_CLOCK with the esp_timer time from its tick
+ * interrupt, which places the unsynchronised cycle counters on one time axis.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+typedef enum {
+    TRACE_EV_CLOCK = 1,     // arg: esp_timer time, low 32 bits.
+    TRACE_EV_SYNC_SENT,     // arg: 0.
+    TRACE_EV_TPDO_RX,       // arg: COB-ID.
+    TRACE_EV_FSM_BEGIN,     // arg: state.
+    TRACE_EV_FSM_END,       // arg: state after the transition.
+    TRACE_EV_RPDO_QUEUED,   // arg: control mode.
+    TRACE_EV_RPDO_SENT,     // arg: COB-ID.
+    TRACE_EV_LC_SAMPLE,     // arg: raw value.
+    TRACE_EV_PC_FRAME,      // arg: frame[1], 0xAB command or 0xCD service.
+    TRACE_EV_TRIGGER,       // arg: trace_trigger_t.
+    TRACE_EV_SAFETY,        // arg: safety_cause_t bits of an output the safety supervisor changed.
+} trace_event_id_t;
+
+typedef enum {
+    TRACE_TRIG_MANUAL = 1,
+    TRACE_TRIG_ESTOP,
+    TRACE_TRIG_DEADLINE,
+} trace_trigger_t;
+
+#ifdef CONFIG_TR_TRACE_ENABLE
+
+#include "freertos/FreeRTOS.h"
+#include "esp_cpu.h"
+
+#define TRACE_DEPTH             CONFIG_TR_TRACE_DEPTH
+#define TRACE_POST_TRIGGER      CONFIG_TR_TRACE_POST_TRIGGER
+
+typedef struct {
+    uint32_t ccount;
+    uint32_t arg;
+    uint16_t id;
+} trace_event_t;
+
+typedef struct {
+    trace_event_t events[TRACE_DEPTH];
+    uint32_t head;              // Free running, events written since the last arm.
+} trace_ring_t;
+
+extern trace_ring_t trace_rings[portNUM_PROCESSORS];
+extern volatile int32_t trace_countdown;   // < 0 until triggered.
+extern volatile bool trace_frozen;
+
+static inline __attribute__((always_inline)) void trace_record(uint16_t id, uint32_t arg)
+{
+    if (trace_frozen)
+    {
+        return;
+    }
+
+    uint32_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+    trace_ring_t *ring = &trace_rings[xPortGetCoreID()];
+    trace_event_t *event = &ring->events[ring->head & (TRACE_DEPTH - 1)];
+    event->ccount = esp_cpu_get_ccount();
+    event->arg = arg;
+    event->id = id;
+    ring->head++;
+    if (trace_countdown >= 0 && trace_countdown-- == 0)
+    {
+        trace_frozen = true;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+}
+
+#define TRACE_EVENT(id, arg)    trace_record((id), (uint32_t)(arg))
+
+void trace_init(void);
+void trace_task(void *arg);
+void trace_trigger(trace_trigger_t reason);
+void trace_rearm(void);
+
+#else
+
+#define TRACE_EVENT(id, arg)    ((void)0)
+#define trace_init()            ((void)0)
+#define trace_trigger(reason)   ((void)0)
+#define trace_rearm()           ((void)0)
+
+#endif /* CONFIG_TR_TRACE_ENABLE */
+
+uint8_t trace_cmd_trigger(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+uint8_t trace_cmd_rearm(const uint8_t *payload, size_t len, uint8_t *reply, size_t *reply_len);
+
+#endif /* TRACE_H_ */
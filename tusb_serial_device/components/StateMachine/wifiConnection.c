@@ -9,71 +9,65 @@
  */
 
 #include "wifiConnection.h"
+#include "deadline_monitor.h"
+#include "lwip/sockets.h"
+#include "esp_mac.h"
 
 static const char *TAG = "wifi connection";
 
+#define WIFI_PROV_REQUEST_BIT   BIT0
+#define WIFI_CONNECTED_BIT      BIT1
+#define WIFI_FAIL_BIT           BIT2
+#define ESPTOUCH_DONE_BIT       BIT3
+
+#define WIFI_CACHE_NAMESPACE    "wifi_cache"
+#define WIFI_CACHE_KEY          "ap"
+#define WIFI_CACHE_MAGIC        0x57494643  // "WIFC"
+
+// Last AP the robot got an address from, for a connect without a scan.
+typedef struct {
+    uint32_t magic;
+    uint8_t ssid[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_ap_cache_t;
+
+// Written by the provisioning task, read by the control task.
+static volatile wifi_prov_state_t prov_state = WIFI_PROV_DISCONNECTED;
+static volatile bool smartconfig_running;
 static int s_retry_num = 0;
+static int retry_limit = WIFI_MAXIMUM_RETRY;
 
-static int wifi_reconfig_flag = 0; 
-
-static EventGroupHandle_t s_wifi_event_group;
-
-
-static void smartconfig_example_task(void * parm);
-
-static void event_handler(void* arg, esp_event_base_t event_base,
-                                int32_t event_id, void* event_data);
-
-static const int WIFI_CONNECTED_BIT = BIT0;
-static const int ESPTOUCH_DONE_BIT = BIT2;
-static const int WIFI_FAIL_BIT  =  BIT1;
-static const int SC_WIFI_CONNECTED_BIT = BIT3;
-
-/* The event group allows multiple bits for each event,
-   but we only care about one event - are we connected
-   to the AP with an IP? */
-
+/*
+ * Runs in the event loop task. Reconnects on its own, except while smart config
+ * owns the station.
+ */
 static void event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
 {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        // xTaskCreate(smartconfig_example_task, "smartconfig_example_task", 4096, NULL, 3, NULL);
-        if(wifi_reconfig_flag==0){
-            esp_wifi_connect();
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
+        if (smartconfig_running) {
+            return;
         }
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        // esp_wifi_connect();
-        // xEventGroupClearBits(s_wifi_event_group, CONNECTED_BIT);
-        if(wifi_reconfig_flag==0){
-            if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY) {
-                esp_wifi_connect();
-                s_retry_num++;
-                ESP_LOGI(TAG, "retry to connect to the AP");
-            } else {
-            
-                xEventGroupClearBits(s_wifi_event_group, SC_WIFI_CONNECTED_BIT);
-                xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-                xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-                ESP_LOGI(TAG,"connect to the AP fail");
-            }
-            
+        if (s_retry_num < retry_limit) {
+            esp_wifi_connect();
+            s_retry_num++;
+            ESP_LOGI(TAG, "retry to connect to the AP");
+        } else {
+            xEventGroupSetBits(wifi_event_group, WIFI_FAIL_BIT);
+            ESP_LOGI(TAG,"connect to the AP fail");
         }
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        xEventGroupSetBits(s_wifi_event_group,  SC_WIFI_CONNECTED_BIT);
-        xEventGroupSetBits(s_wifi_event_group,  WIFI_CONNECTED_BIT);
-        s_retry_num = 0 ;
+        s_retry_num = 0;
+        xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
     } else if (event_base == SC_EVENT && event_id == SC_EVENT_SCAN_DONE) {
         ESP_LOGI(TAG, "Scan done");
     } else if (event_base == SC_EVENT && event_id == SC_EVENT_FOUND_CHANNEL) {
         ESP_LOGI(TAG, "Found channel");
     } else if (event_base == SC_EVENT && event_id == SC_EVENT_GOT_SSID_PSWD) {
-        ESP_LOGI(TAG, "Got SSID and password");
-
         smartconfig_event_got_ssid_pswd_t *evt = (smartconfig_event_got_ssid_pswd_t *)event_data;
         wifi_config_t wifi_config;
-        uint8_t ssid[33] = { 0 };
-        uint8_t password[65] = { 0 };
-        uint8_t rvd_data[33] = { 0 };
 
         bzero(&wifi_config, sizeof(wifi_config_t));
         memcpy(wifi_config.sta.ssid, evt->ssid, sizeof(wifi_config.sta.ssid));
@@ -82,179 +76,277 @@ static void event_handler(void* arg, esp_event_base_t event_base,
         if (wifi_config.sta.bssid_set == true) {
             memcpy(wifi_config.sta.bssid, evt->bssid, sizeof(wifi_config.sta.bssid));
         }
+        ESP_LOGI(TAG, "Got credentials for SSID %.32s", (const char *)wifi_config.sta.ssid);
 
-        memcpy(ssid, evt->ssid, sizeof(evt->ssid));
-        memcpy(password, evt->password, sizeof(evt->password));
-        ESP_LOGI(TAG, "SSID:%s", ssid);
-        ESP_LOGI(TAG, "PASSWORD:%s", password);
-        if (evt->type == SC_TYPE_ESPTOUCH_V2) {
-            ESP_ERROR_CHECK( esp_smartconfig_get_rvd_data(rvd_data, sizeof(rvd_data)) );
-            ESP_LOGI(TAG, "RVD_DATA:");
-            for (int i=0; i<33; i++) {
-                printf("%02x ", rvd_data[i]);
-            }
-            printf("\n");
-        }
-
-        ESP_ERROR_CHECK( esp_wifi_disconnect() );
+        // Only these go to NVS, the fast connect settings stay in RAM.
+        esp_wifi_disconnect();
+        esp_wifi_set_storage(WIFI_STORAGE_FLASH);
         ESP_ERROR_CHECK( esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
+        esp_wifi_set_storage(WIFI_STORAGE_RAM);
         esp_wifi_connect();
     } else if (event_base == SC_EVENT && event_id == SC_EVENT_SEND_ACK_DONE) {
-        xEventGroupSetBits(s_wifi_event_group, ESPTOUCH_DONE_BIT);
+        xEventGroupSetBits(wifi_event_group, ESPTOUCH_DONE_BIT);
     }
 }
 
-
-/*
-* The following function is from smartconfig example. 
-*
-*/
-// static void initialise_wifi(void)
-// {
-//     ESP_ERROR_CHECK(esp_netif_init());
-//     s_wifi_event_group = xEventGroupCreate();
-//     ESP_ERROR_CHECK(esp_event_loop_create_default());
-//     esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
-//     assert(sta_netif);
-
-//     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-//     ESP_ERROR_CHECK( esp_wifi_init(&cfg) );
-
-//     ESP_ERROR_CHECK( esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL) );
-//     ESP_ERROR_CHECK( esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL) );
-//     ESP_ERROR_CHECK( esp_event_handler_register(SC_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL) );
-
-//     ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA) );
-//     ESP_ERROR_CHECK( esp_wifi_start() );
-// }
-
-
-void wifi_init_sta(void)
+static void wifi_init_sta(void)
 {
-     wifi_reconfig_flag =0;  
-    
-    s_wifi_event_group = xEventGroupCreate();
-
-    ESP_ERROR_CHECK(esp_netif_init());
-
-   // ESP_ERROR_CHECK(esp_event_loop_create_default());
     esp_netif_create_default_wifi_sta();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-
-     wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = EXAMPLE_ESP_WIFI_SSID,
-            .password = EXAMPLE_ESP_WIFI_PASS,
-            /* Setting a password implies station will connect to all security modes including WEP/WPA.
-             * However these modes are deprecated and not advisable to be used. Incase your Access point
-             * doesn't support WPA2, these mode can be enabled by commenting below line */
-	     //.threshold.authmode = ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD,
-        },
-    };
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    // The credentials from NVS are loaded by esp_wifi_init. Changes are kept in RAM unless said otherwise.
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(SC_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_start());
+
+#ifdef CONFIG_TR_WIFI_LOW_LATENCY
+    // Power save buffers frames to the robot until the next beacon, 100 ms apart by default.
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
+    ESP_ERROR_CHECK(esp_wifi_set_bandwidth(WIFI_IF_STA, WIFI_BW_HT20));
+    ESP_LOGI(TAG, "Control link profile: no power save, HT20");
+#endif
+    ESP_LOGI(TAG, "wifi_init_sta finished.");
+}
 
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_got_ip));
-    ESP_ERROR_CHECK( esp_event_handler_register(SC_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL) );
-
-   
-    // wifi_config_t wifi_config; 
-
-    ESP_ERROR_CHECK(esp_wifi_get_config(WIFI_IF_STA, &wifi_config) );
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA) );
-    ESP_ERROR_CHECK(esp_wifi_start() );
+#ifdef CONFIG_TR_WIFI_FAST_RECONNECT
 
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
+static bool wifi_cache_load(wifi_ap_cache_t *cache)
+{
+    nvs_handle_t handle;
+    size_t size = sizeof(wifi_ap_cache_t);
 
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-            pdFALSE,
-            pdFALSE,
-            portMAX_DELAY);
-
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 wifi_config.sta.ssid, wifi_config.sta.password);
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                wifi_config.sta.ssid, wifi_config.sta.password);
-         xTaskCreate(smartconfig_example_task, "smartconfig_example_task", 4096, NULL, 3, NULL);
-
-        EventBits_t bits_2 = xEventGroupWaitBits(s_wifi_event_group,   SC_WIFI_CONNECTED_BIT ,
-            pdFALSE,
-            pdFALSE,
-            portMAX_DELAY);
-
-         if (bits_2 & SC_WIFI_CONNECTED_BIT) {
-            ESP_LOGE(TAG, "Connected via smart config. Yeah!");
-         }
-         else {
-            ESP_LOGE(TAG, "UNEXPECTED EVENT");
-        }
+    if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    esp_err_t err = nvs_get_blob(handle, WIFI_CACHE_KEY, cache, &size);
+    nvs_close(handle);
+    return err == ESP_OK && size == sizeof(wifi_ap_cache_t) && cache->magic == WIFI_CACHE_MAGIC;
+}
+
+// Flash writes stall both cores, so only when the AP has changed.
+static void wifi_cache_save(const uint8_t *ssid)
+{
+    wifi_ap_record_t ap;
+    wifi_ap_cache_t cache, stored;
+    nvs_handle_t handle;
 
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+    memset(&cache, 0, sizeof(cache));
+    cache.magic = WIFI_CACHE_MAGIC;
+    memcpy(cache.ssid, ssid, sizeof(cache.ssid));
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    cache.channel = ap.primary;
+
+    if (wifi_cache_load(&stored) && memcmp(&stored, &cache, sizeof(cache)) == 0) {
+        return;
+    }
+    if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        if (nvs_set_blob(handle, WIFI_CACHE_KEY, &cache, sizeof(cache)) == ESP_OK) {
+            nvs_commit(handle);
+            ESP_LOGI(TAG, "Cached AP " MACSTR " on channel %u", MAC2STR(cache.bssid), cache.channel);
+        }
+        nvs_close(handle);
+    }
+}
 
+#endif /* CONFIG_TR_WIFI_FAST_RECONNECT */
 
-    } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
+static bool wifi_connect_attempt(const wifi_config_t *wifi_config, int retries, uint32_t timeout_ms)
+{
+    retry_limit = retries;
+    s_retry_num = 0;
+    xEventGroupClearBits(wifi_event_group, WIFI_FAIL_BIT);
+    esp_wifi_set_config(WIFI_IF_STA, (wifi_config_t *)wifi_config);
+    esp_wifi_connect();
+
+    EventBits_t bits = xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+                                           pdFALSE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    if (!(bits & WIFI_CONNECTED_BIT)) {
+        retry_limit = 0;
+        esp_wifi_disconnect();
+        return false;
     }
+    return true;
 }
 
+/*
+ * Connect with the stored credentials and wait for an address or the retries to run out.
+ * With a cached AP for these credentials, first straight to its BSSID and channel.
+ */
+static wifi_prov_state_t wifi_connect_stored(void)
+{
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) != ESP_OK || wifi_config.sta.ssid[0] == 0) {
+        ESP_LOGI(TAG, "No stored credentials");
+        return WIFI_PROV_DISCONNECTED;
+    }
+
+    prov_state = WIFI_PROV_CONNECTING;
+    int64_t start_us = esp_timer_get_time();
+    bool connected = false;
+
+#ifdef CONFIG_TR_WIFI_FAST_RECONNECT
+    wifi_ap_cache_t cache;
+    if (wifi_cache_load(&cache) && memcmp(cache.ssid, wifi_config.sta.ssid, sizeof(cache.ssid)) == 0) {
+        wifi_config_t fast_config = wifi_config;
+        fast_config.sta.channel = cache.channel;
+        fast_config.sta.bssid_set = true;
+        memcpy(fast_config.sta.bssid, cache.bssid, sizeof(cache.bssid));
+        fast_config.sta.scan_method = WIFI_FAST_SCAN;
+        connected = wifi_connect_attempt(&fast_config, 1, WIFI_FAST_CONNECT_TIMEOUT_MS);
+        if (!connected) {
+            ESP_LOGI(TAG, "Cached AP not found, scanning");
+        }
+    }
+#endif
+
+    if (!connected) {
+        wifi_config.sta.channel = 0;
+        wifi_config.sta.bssid_set = false;
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        connected = wifi_connect_attempt(&wifi_config, WIFI_MAXIMUM_RETRY, WIFI_CONNECT_TIMEOUT_MS);
+    }
+
+    if (!connected) {
+        ESP_LOGI(TAG, "Failed to connect to SSID:%.32s", (const char *)wifi_config.sta.ssid);
+        return WIFI_PROV_DISCONNECTED;
+    }
+
+    ESP_LOGI(TAG, "connected to ap SSID:%.32s in %lld ms", (const char *)wifi_config.sta.ssid,
+             (esp_timer_get_time() - start_us) / 1000);
+#ifdef CONFIG_TR_WIFI_FAST_RECONNECT
+    wifi_cache_save(wifi_config.sta.ssid);
+#endif
+    return WIFI_PROV_CONNECTED;
+}
 
-static void smartconfig_example_task(void * parm)
+// ESP-Touch until the app confirms or the timeout, then back to the stored credentials.
+static wifi_prov_state_t wifi_smartconfig(void)
 {
-    EventBits_t uxBits;
+    deadline_stats_t before, after;
+    int64_t start_us = esp_timer_get_time();
+    deadline_get_stats(&before);
+
+    smartconfig_running = true;
+    esp_wifi_disconnect();
+    xEventGroupClearBits(wifi_event_group, ESPTOUCH_DONE_BIT | WIFI_CONNECTED_BIT);
+
     ESP_ERROR_CHECK( esp_smartconfig_set_type(SC_TYPE_ESPTOUCH) );
     smartconfig_start_config_t cfg = SMARTCONFIG_START_CONFIG_DEFAULT();
     ESP_ERROR_CHECK( esp_smartconfig_start(&cfg) );
-    while (1) {
-        uxBits = xEventGroupWaitBits(s_wifi_event_group, SC_WIFI_CONNECTED_BIT | ESPTOUCH_DONE_BIT, true, false, portMAX_DELAY);
-        if(uxBits & WIFI_CONNECTED_BIT) {
-            ESP_LOGI(TAG, "WiFi Connected to ap");
-        }
-        if(uxBits & ESPTOUCH_DONE_BIT) {
-            ESP_LOGI(TAG, "smartconfig over");
-            esp_smartconfig_stop();
-            vTaskDelete(NULL);
+
+    EventBits_t bits = xEventGroupWaitBits(wifi_event_group, ESPTOUCH_DONE_BIT, pdTRUE, pdTRUE,
+                                           pdMS_TO_TICKS(WIFI_PROV_TIMEOUT_S * 1000));
+    esp_smartconfig_stop();
+    smartconfig_running = false;
+
+    wifi_prov_state_t result;
+    if (bits & ESPTOUCH_DONE_BIT) {
+        ESP_LOGI(TAG, "smartconfig over");
+        if (xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT) {
+            result = WIFI_PROV_CONNECTED;
+#ifdef CONFIG_TR_WIFI_FAST_RECONNECT
+            wifi_config_t wifi_config;
+            esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+            wifi_cache_save(wifi_config.sta.ssid);
+#endif
+        } else {
+            result = wifi_connect_stored();
         }
+    } else {
+        ESP_LOGW(TAG, "smartconfig timed out after %d s", WIFI_PROV_TIMEOUT_S);
+        result = wifi_connect_stored();
     }
+
+    deadline_get_stats(&after);
+    ESP_LOGI(TAG, "Provisioning took %lld ms, %u of %u control cycles missed meanwhile",
+             (esp_timer_get_time() - start_us) / 1000, after.missed - before.missed, after.cycles - before.cycles);
+    return result;
 }
 
+/**
+ * @brief Provisioning task, lowest priority. Connects with the stored
+ *        credentials, then runs smart config on each wifi_prov_request().
+ */
+void wifi_prov_task(void *arg)
+{
+    wifi_init_sta();
+    prov_state = wifi_connect_stored();
+
+    while (1) {
+        xEventGroupWaitBits(wifi_event_group, WIFI_PROV_REQUEST_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+        prov_state = WIFI_PROV_SMARTCONFIG;
+        xEventGroupClearBits(wifi_event_group, WIFI_PROV_REQUEST_BIT);
+        prov_state = wifi_smartconfig();
+    }
+}
 
+/**
+ * @brief Ask for provisioning. Returns at once; safe from the control task.
+ */
+void wifi_prov_request(void)
+{
+    xEventGroupSetBits(wifi_event_group, WIFI_PROV_REQUEST_BIT);
+}
 
-void start_smart_config(void){
-    wifi_reconfig_flag =1; 
-    ESP_ERROR_CHECK( esp_wifi_disconnect() );
-    ESP_ERROR_CHECK( esp_wifi_stop() );
+// True from wifi_prov_request() until provisioning has ended.
+bool wifi_prov_busy(void)
+{
+    return (xEventGroupGetBits(wifi_event_group) & WIFI_PROV_REQUEST_BIT) || prov_state == WIFI_PROV_SMARTCONFIG;
+}
 
-    ESP_ERROR_CHECK( esp_wifi_deinit() );
+wifi_prov_state_t wifi_prov_state(void)
+{
+    return prov_state;
+}
 
-     vTaskDelay(1000/ portTICK_PERIOD_MS); 
+#if CONFIG_TR_WIFI_ECHO_PORT > 0
 
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK( esp_wifi_init(&cfg) );
+/**
+ * @brief Send every datagram on WIFI_ECHO_PORT back to where it came from,
+ *        for round trip measurements with tools/udp_rtt_probe.py.
+ */
+void wifi_echo_task(void *arg)
+{
+    uint8_t rx_buffer[128];
 
+    while (1) {
+        xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+
+        struct sockaddr_in local_addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(WIFI_ECHO_PORT),
+            .sin_addr.s_addr = htonl(INADDR_ANY),
+        };
+        int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+        if (sock < 0 || bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
+            ESP_LOGE(TAG, "UDP echo socket: errno %d", errno);
+        } else {
+            ESP_LOGI(TAG, "UDP echo on port %d", WIFI_ECHO_PORT);
+            while (1) {
+                struct sockaddr_storage source_addr;
+                socklen_t socklen = sizeof(source_addr);
+                int len = recvfrom(sock, rx_buffer, sizeof(rx_buffer), 0, (struct sockaddr *)&source_addr, &socklen);
+                if (len < 0) {
+                    break;
+                }
+                sendto(sock, rx_buffer, len, 0, (struct sockaddr *)&source_addr, socklen);
+            }
+        }
 
-    ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA) );
-    ESP_ERROR_CHECK( esp_wifi_start() );
-    xTaskCreate(smartconfig_example_task, "smartconfig_example_task", 4096, NULL, 3, NULL);
+        if (sock >= 0) {
+            close(sock);
+        }
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
 }
-// void app_main(void)
-// {
-//     ESP_ERROR_CHECK( nvs_flash_init() );
-//     initialise_wifi();
-// }
\ No newline at end of file
+
+#endif
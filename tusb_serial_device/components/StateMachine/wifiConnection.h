@@ -4,7 +4,14 @@
  *  Created on: 2022.5.29
  *      Author: BC
  * This script is to implement the wifi connection functionalities of the touch rehab robots. 
- * 
+ *
+ * Wi-Fi runs in its own low priority task, never in the control task. At boot
+ * it connects with the credentials stored in NVS, if any. wifi_prov_request()
+ * starts ESP-Touch provisioning; it ends when the phone app has sent the
+ * credentials and the robot is connected, or after WIFI_PROV_TIMEOUT_S, when
+ * the stored credentials are used again. New credentials are stored in NVS by
+ * the Wi-Fi driver. With CONFIG_TR_WIFI_FAST_RECONNECT the BSSID and channel
+ * of the last AP are cached in NVS too, and tried before a full scan.
  */
 
 
@@ -13,6 +20,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -27,48 +35,39 @@
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
+#include "sdkconfig.h"
 
-#endif /* WIFI_CONNECTION_H_ */
-
-
-/* The examples use WiFi configuration that you can set via project configuration menu
-   If you'd rather not, just change the below entries to strings with
-   the config you want - ie #define EXAMPLE_WIFI_SSID "mywifissid"
-*/
-#define EXAMPLE_ESP_WIFI_SSID      "Redmi_mmzlab"
-#define EXAMPLE_ESP_WIFI_PASS      "mmzlab123897987"
-#define EXAMPLE_ESP_MAXIMUM_RETRY  10
-
-
-// static void initialise_wifi(void);       
+#define WIFI_PROV_TIMEOUT_S         CONFIG_TR_WIFI_PROV_TIMEOUT_S
+#define WIFI_CONNECT_TIMEOUT_MS     15000
+// Association to the cached BSSID, before falling back to a full scan.
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000
+#define WIFI_ECHO_PORT              CONFIG_TR_WIFI_ECHO_PORT
+#define WIFI_MAXIMUM_RETRY          10
 
-void wifi_init_sta(void);
-
-static void smartconfig_example_task(void * parm);
-
-
-void start_smart_config(void); 
-
-// #if CONFIG_ESP_WIFI_AUTH_OPEN
-// #define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_OPEN
-// #elif CONFIG_ESP_WIFI_AUTH_WEP
-// #define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WEP
-// #elif CONFIG_ESP_WIFI_AUTH_WPA_PSK
-// #define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA_PSK
-// #elif CONFIG_ESP_WIFI_AUTH_WPA2_PSK
-// #define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA2_PSK
-// #elif CONFIG_ESP_WIFI_AUTH_WPA_WPA2_PSK
-// #define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA_WPA2_PSK
-// #elif CONFIG_ESP_WIFI_AUTH_WPA3_PSK
-// #define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA3_PSK
-// #elif CONFIG_ESP_WIFI_AUTH_WPA2_WPA3_PSK
-// #define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA2_WPA3_PSK
-// #elif CONFIG_ESP_WIFI_AUTH_WAPI_PSK
-// #define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WAPI_PSK
+typedef enum {
+    WIFI_PROV_DISCONNECTED = 0, // No stored credentials, or the AP is not reachable.
+    WIFI_PROV_CONNECTING,
+    WIFI_PROV_CONNECTED,
+    WIFI_PROV_SMARTCONFIG,      // Waiting for the phone app.
+} wifi_prov_state_t;
 
+#ifdef CONFIG_TR_WIFI_PROVISIONING
 
+// Created from static storage in rtos_objects.c.
+extern EventGroupHandle_t wifi_event_group;
 
+void wifi_prov_task(void *arg);
+void wifi_echo_task(void *arg);
+void wifi_prov_request(void);
+bool wifi_prov_busy(void);
+wifi_prov_state_t wifi_prov_state(void);
 
+#else
 
+#define wifi_prov_request()     ((void)0)
+#define wifi_prov_busy()        (false)
+#define wifi_prov_state()       (WIFI_PROV_DISCONNECTED)
 
+#endif /* CONFIG_TR_WIFI_PROVISIONING */
 
+#endif /* WIFI_CONNECTION_H_ */
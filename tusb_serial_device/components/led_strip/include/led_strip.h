@@ -17,6 +17,7 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
 #include "esp_err.h"
 
 /**
@@ -31,6 +32,24 @@ typedef struct led_strip_s led_strip_t;
 */
 typedef void *led_strip_dev_t;
 
+/**
+* @brief Called when a frame started by refresh_async has been sent. Runs in the RMT interrupt.
+*
+*/
+typedef void (*led_strip_done_cb_t)(led_strip_t *strip, void *arg);
+
+/**
+* @brief Cost of the frames sent so far
+*
+*/
+typedef struct {
+    uint32_t frames;        /*!< Frames sent */
+    uint32_t busy;          /*!< refresh_async calls refused because a frame was still being sent */
+    uint32_t last_cycles;   /*!< CPU cycles spent translating the last frame, in the caller and in the RMT interrupt */
+    uint32_t max_cycles;    /*!< Most CPU cycles spent on one frame */
+    uint32_t last_wire_us;  /*!< Start of the last frame to the end of its transmission */
+} led_strip_stats_t;
+
 /**
 * @brief Declare of LED Strip Type
 *
@@ -68,6 +87,23 @@ struct led_strip_s {
     */
     esp_err_t (*refresh)(led_strip_t *strip, uint32_t timeout_ms);
 
+    /**
+    * @brief Start sending memory colors to LEDs and return
+    *
+    * @param strip: LED strip
+    * @param done: called from the RMT interrupt when the frame is sent, or NULL
+    * @param arg: argument for done
+    *
+    * @return
+    *      - ESP_OK: Frame started
+    *      - ESP_ERR_INVALID_STATE: The previous frame is still being sent, nothing done
+    *      - ESP_FAIL: Refresh failed because some other error occurred
+    *
+    * @note:
+    *      The colors are copied when the frame starts, set_pixel may be called again right away.
+    */
+    esp_err_t (*refresh_async)(led_strip_t *strip, led_strip_done_cb_t done, void *arg);
+
     /**
     * @brief Clear LED strip (turn off all LEDs)
     *
@@ -91,6 +127,14 @@ struct led_strip_s {
     *      - ESP_FAIL: Free resources failed because error occurred
     */
     esp_err_t (*del)(led_strip_t *strip);
+
+    /**
+    * @brief Read the frame counters and the cost of the last frame
+    *
+    * @param strip: LED strip
+    * @param stats: filled with the counters
+    */
+    void (*get_stats)(led_strip_t *strip, led_strip_stats_t *stats);
 };
 
 /**
@@ -124,6 +168,10 @@ led_strip_t *led_strip_new_rmt_ws2812(const led_strip_config_t *config);
 /**
  * @brief Init the RMT peripheral and LED strip configuration.
  *
+ * @note A strip that does not fit one RMT memory block (2 LEDs on the
+ *       ESP32-S3) also takes the memory of the next channel, which must then
+ *       be left unused.
+ *
  * @param[in] channel: RMT peripheral channel number.
  * @param[in] gpio: GPIO number for the RMT data output.
  * @param[in] led_num: number of addressable LEDs.
@@ -13,11 +13,16 @@
 // limitations under the License.
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 #include <sys/cdefs.h>
 #include "esp_log.h"
 #include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "led_strip.h"
 #include "driver/rmt.h"
+#include "soc/soc_caps.h"
 
 #define RMT_TX_CHANNEL RMT_CHANNEL_0
 
@@ -39,20 +44,45 @@ static const char *TAG = "ws2812";
 #define WS2812_T1L_NS (350)
 #define WS2812_RESET_US (280)
 
-static uint32_t ws2812_t0h_ticks = 0;
-static uint32_t ws2812_t1h_ticks = 0;
-static uint32_t ws2812_t0l_ticks = 0;
-static uint32_t ws2812_t1l_ticks = 0;
+// RMT symbols of every byte value, MSB first, built when the first strip is installed. 8 KB, in DRAM
+// because the translator also runs in the RMT interrupt.
+static DRAM_ATTR rmt_item32_t ws2812_symbols[256][8];
+static uint32_t ws2812_symbols_clk_hz = 0;
 
 typedef struct {
     led_strip_t parent;
     rmt_channel_t rmt_channel;
     uint32_t strip_len;
-    uint8_t buffer[0];
+    volatile bool busy;
+    led_strip_done_cb_t done;
+    void *done_arg;
+    int64_t start_us;
+    uint32_t frame_cycles;
+    led_strip_stats_t stats;
+    uint8_t *wire;      // Frame being sent, read by the translator.
+    uint8_t buffer[0];  // set_pixel colors, then the wire copy.
 } ws2812_t;
 
+// The RMT driver has one TX end callback for all channels.
+static ws2812_t *ws2812_channels[RMT_CHANNEL_MAX];
+
+static void ws2812_build_symbols(uint32_t counter_clk_hz)
+{
+    // ns -> ticks
+    float ratio = (float)counter_clk_hz / 1e9;
+    const rmt_item32_t bit0 = {{{ (uint32_t)(ratio * WS2812_T0H_NS), 1, (uint32_t)(ratio * WS2812_T0L_NS), 0 }}}; //Logical 0
+    const rmt_item32_t bit1 = {{{ (uint32_t)(ratio * WS2812_T1H_NS), 1, (uint32_t)(ratio * WS2812_T1L_NS), 0 }}}; //Logical 1
+
+    for (int value = 0; value < 256; value++) {
+        for (int i = 0; i < 8; i++) {
+            ws2812_symbols[value][i].val = (value & (1 << (7 - i))) ? bit1.val : bit0.val;
+        }
+    }
+    ws2812_symbols_clk_hz = counter_clk_hz;
+}
+
 /**
- * @brief Conver RGB data to RMT format.
+ * @brief Conver RGB data to RMT format, one table row per byte.
  *
  * @note For WS2812, R,G,B each contains 256 different choices (i.e. uint8_t)
  *
@@ -71,28 +101,45 @@ static void IRAM_ATTR ws2812_rmt_adapter(const void *src, rmt_item32_t *dest, si
         *item_num = 0;
         return;
     }
-    const rmt_item32_t bit0 = {{{ ws2812_t0h_ticks, 1, ws2812_t0l_ticks, 0 }}}; //Logical 0
-    const rmt_item32_t bit1 = {{{ ws2812_t1h_ticks, 1, ws2812_t1l_ticks, 0 }}}; //Logical 1
-    size_t size = 0;
-    size_t num = 0;
-    uint8_t *psrc = (uint8_t *)src;
+    uint32_t start = esp_cpu_get_ccount();
+    size_t size = wanted_num / 8;
+    if (size > src_size) {
+        size = src_size;
+    }
+    const uint8_t *psrc = (const uint8_t *)src;
     rmt_item32_t *pdest = dest;
-    while (size < src_size && num < wanted_num) {
+    for (size_t n = 0; n < size; n++) {
+        const rmt_item32_t *symbols = ws2812_symbols[psrc[n]];
         for (int i = 0; i < 8; i++) {
-            // MSB first
-            if (*psrc & (1 << (7 - i))) {
-                pdest->val =  bit1.val;
-            } else {
-                pdest->val =  bit0.val;
-            }
-            num++;
-            pdest++;
+            pdest[i].val = symbols[i].val;
         }
-        size++;
-        psrc++;
+        pdest += 8;
     }
     *translated_size = size;
-    *item_num = num;
+    *item_num = size * 8;
+
+    ws2812_t *ws2812 = NULL;
+    if (rmt_translator_get_context(item_num, (void **)&ws2812) == ESP_OK && ws2812) {
+        ws2812->frame_cycles += esp_cpu_get_ccount() - start;
+    }
+}
+
+static void IRAM_ATTR ws2812_tx_end(rmt_channel_t channel, void *arg)
+{
+    ws2812_t *ws2812 = ws2812_channels[channel];
+    if (ws2812 == NULL || !ws2812->busy) {
+        return;
+    }
+    ws2812->stats.frames++;
+    ws2812->stats.last_cycles = ws2812->frame_cycles;
+    if (ws2812->frame_cycles > ws2812->stats.max_cycles) {
+        ws2812->stats.max_cycles = ws2812->frame_cycles;
+    }
+    ws2812->stats.last_wire_us = (uint32_t)(esp_timer_get_time() - ws2812->start_us);
+    ws2812->busy = false;
+    if (ws2812->done) {
+        ws2812->done(&ws2812->parent, ws2812->done_arg);
+    }
 }
 
 static esp_err_t ws2812_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
@@ -110,12 +157,41 @@ err:
     return ret;
 }
 
+static esp_err_t ws2812_refresh_async(led_strip_t *strip, led_strip_done_cb_t done, void *arg)
+{
+    esp_err_t ret = ESP_OK;
+    ws2812_t *ws2812 = __containerof(strip, ws2812_t, parent);
+    if (ws2812->busy) {
+        ws2812->stats.busy++;
+        return ESP_ERR_INVALID_STATE;
+    }
+    memcpy(ws2812->wire, ws2812->buffer, ws2812->strip_len * 3);
+    ws2812->done = done;
+    ws2812->done_arg = arg;
+    ws2812->frame_cycles = 0;
+    ws2812->start_us = esp_timer_get_time();
+    ws2812->busy = true;
+    // Translates the first memory block here, the rest in the RMT interrupt.
+    if (rmt_write_sample(ws2812->rmt_channel, ws2812->wire, ws2812->strip_len * 3, false) != ESP_OK) {
+        ws2812->busy = false;
+        STRIP_CHECK(false, "transmit RMT samples failed", err, ESP_FAIL);
+    }
+    return ESP_OK;
+err:
+    return ret;
+}
+
 static esp_err_t ws2812_refresh(led_strip_t *strip, uint32_t timeout_ms)
 {
     esp_err_t ret = ESP_OK;
     ws2812_t *ws2812 = __containerof(strip, ws2812_t, parent);
-    STRIP_CHECK(rmt_write_sample(ws2812->rmt_channel, ws2812->buffer, ws2812->strip_len * 3, true) == ESP_OK,
-                "transmit RMT samples failed", err, ESP_FAIL);
+    // Let a frame started by refresh_async finish first.
+    STRIP_CHECK(rmt_wait_tx_done(ws2812->rmt_channel, pdMS_TO_TICKS(timeout_ms)) == ESP_OK,
+                "previous frame not sent", err, ESP_ERR_TIMEOUT);
+    // The driver wakes waiters before it calls ws2812_tx_end, possibly on the other core.
+    while (ws2812->busy) {
+    }
+    STRIP_CHECK(ws2812_refresh_async(strip, NULL, NULL) == ESP_OK, "transmit RMT samples failed", err, ESP_FAIL);
     return rmt_wait_tx_done(ws2812->rmt_channel, pdMS_TO_TICKS(timeout_ms));
 err:
     return ret;
@@ -129,9 +205,16 @@ static esp_err_t ws2812_clear(led_strip_t *strip, uint32_t timeout_ms)
     return ws2812_refresh(strip, timeout_ms);
 }
 
+static void ws2812_get_stats(led_strip_t *strip, led_strip_stats_t *stats)
+{
+    ws2812_t *ws2812 = __containerof(strip, ws2812_t, parent);
+    *stats = ws2812->stats;
+}
+
 static esp_err_t ws2812_del(led_strip_t *strip)
 {
     ws2812_t *ws2812 = __containerof(strip, ws2812_t, parent);
+    ws2812_channels[ws2812->rmt_channel] = NULL;
     free(ws2812);
     return ESP_OK;
 }
@@ -139,49 +222,61 @@ static esp_err_t ws2812_del(led_strip_t *strip)
 led_strip_t *led_strip_new_rmt_ws2812(const led_strip_config_t *config)
 {
     led_strip_t *ret = NULL;
+    ws2812_t *ws2812 = NULL;
     STRIP_CHECK(config, "configuration can't be null", err, NULL);
 
-    // 24 bits per led
-    uint32_t ws2812_size = sizeof(ws2812_t) + config->max_leds * 3;
-    ws2812_t *ws2812 = calloc(1, ws2812_size);
+    // 24 bits per led, twice: the colors being set and the frame being sent. Internal RAM, the
+    // translator reads the frame in the RMT interrupt.
+    uint32_t ws2812_size = sizeof(ws2812_t) + config->max_leds * 3 * 2;
+    ws2812 = heap_caps_calloc(1, ws2812_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     STRIP_CHECK(ws2812, "request memory for ws2812 failed", err, NULL);
 
     uint32_t counter_clk_hz = 0;
     STRIP_CHECK(rmt_get_counter_clock((rmt_channel_t)config->dev, &counter_clk_hz) == ESP_OK,
-                "get rmt counter clock failed", err, NULL);
-    // ns -> ticks
-    float ratio = (float)counter_clk_hz / 1e9;
-    ws2812_t0h_ticks = (uint32_t)(ratio * WS2812_T0H_NS);
-    ws2812_t0l_ticks = (uint32_t)(ratio * WS2812_T0L_NS);
-    ws2812_t1h_ticks = (uint32_t)(ratio * WS2812_T1H_NS);
-    ws2812_t1l_ticks = (uint32_t)(ratio * WS2812_T1L_NS);
+                "get rmt counter clock failed", err_free, NULL);
+    if (ws2812_symbols_clk_hz == 0) {
+        ws2812_build_symbols(counter_clk_hz);
+    }
+    STRIP_CHECK(counter_clk_hz == ws2812_symbols_clk_hz, "all strips need the same RMT counter clock", err_free, NULL);
 
     // set ws2812 to rmt adapter
     rmt_translator_init((rmt_channel_t)config->dev, ws2812_rmt_adapter);
+    rmt_translator_set_context((rmt_channel_t)config->dev, ws2812);
 
     ws2812->rmt_channel = (rmt_channel_t)config->dev;
     ws2812->strip_len = config->max_leds;
+    ws2812->wire = &ws2812->buffer[config->max_leds * 3];
+    ws2812_channels[ws2812->rmt_channel] = ws2812;
 
     ws2812->parent.set_pixel = ws2812_set_pixel;
     ws2812->parent.refresh = ws2812_refresh;
+    ws2812->parent.refresh_async = ws2812_refresh_async;
     ws2812->parent.clear = ws2812_clear;
     ws2812->parent.del = ws2812_del;
+    ws2812->parent.get_stats = ws2812_get_stats;
 
     return &ws2812->parent;
+err_free:
+    free(ws2812);
 err:
     return ret;
 }
 
 led_strip_t * led_strip_init(uint8_t channel, uint8_t gpio, uint16_t led_num)
 {
-    static led_strip_t *pStrip;
+    led_strip_t *pStrip;
 
     rmt_config_t config = RMT_DEFAULT_CONFIG_TX(gpio, channel);
     // set counter clock to 40MHz
     config.clk_div = 2;
+    // Two memory blocks halve the refill interrupts of a long strip.
+    if (led_num * 24 > SOC_RMT_MEM_WORDS_PER_CHANNEL && channel + 1 < SOC_RMT_TX_CANDIDATES_PER_GROUP) {
+        config.mem_block_num = 2;
+    }
 
     ESP_ERROR_CHECK(rmt_config(&config));
     ESP_ERROR_CHECK(rmt_driver_install(config.channel, 0, 0));
+    rmt_register_tx_end_callback(ws2812_tx_end, NULL);
 
     // install ws2812 driver
     led_strip_config_t strip_config = LED_STRIP_DEFAULT_CONFIG(led_num, (led_strip_dev_t)config.channel);
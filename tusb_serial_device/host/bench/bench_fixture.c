@@ -0,0 +1,666 @@
+/*
+ * bench_fixture.c
+ *
+ * Session trace loading and synthesis, and the calls into the firmware for
+ * bench_main.cc. See bench_fixture.h for the trace format.
+ */
+
+#include "bench_fixture.h"
+#include "stateMachine.h"
+#include "can_open_comm.h"
+#include "pc_link.h"
+#include "load_cell_cal.h"
+#include "safety.h"
+
+// Defined in stateMachine.c without a prototype in the header.
+int movingAvg(int *ptrArrNumbers, int len, int nextNum, bool reset);
+
+#define BENCH_PERIOD_US         4000
+#define BENCH_PC_PERIOD_US      10000
+#define BENCH_LC_PERIOD_US      2500
+
+typedef struct {
+    int64_t time_us;
+    twai_message_t msg;
+} bench_can_t;
+
+typedef struct {
+    int64_t time_us;
+    size_t offset;
+    size_t len;
+} bench_chunk_t;
+
+typedef struct {
+    int64_t time_us;
+    int32_t value;
+} bench_lc_t;
+
+typedef struct {
+    int64_t time_us;
+    int handle;
+    int rtn;
+    int estop;
+} bench_gpio_t;
+
+typedef struct {
+    int64_t time_us;
+    size_t first_frame;
+    size_t frame_count;
+    motor_status_t status;      // The cycle's TPDOs decoded, as the process task receives them.
+    uint8_t pc_msg[PC_CMD_FRAME_LEN];
+    int32_t lc_raw;
+    int handle;
+    int rtn;
+    int estop;
+} bench_cycle_t;
+
+// One I record, and the O record of the same cycle if there is one.
+typedef struct {
+    int64_t time_us;
+    uint32_t cycle;
+    int state;
+    int level;
+    unsigned int switches;
+    motor_status_t status;
+    int32_t lc_inc;
+    int32_t lc_age_us;
+    uint8_t lc_confidence;
+    int32_t force;
+    uint8_t pc_msg[PC_CMD_FRAME_LEN];
+    bool has_expected;
+    bench_replay_out_t expected;
+} bench_replay_t;
+
+// rec_input_record_t.switches and .limit_switches, see recorder.h.
+#define BENCH_SW_HANDLE         0x01
+#define BENCH_SW_RETURN         0x02
+#define BENCH_SW_ESTOP          0x04
+#define BENCH_SW_RTN_EVENT      0x08
+#define BENCH_LS_MOTOR          0x01
+#define BENCH_LS_FAR            0x02
+#define BENCH_LS_CENTRE         0x04
+
+// Growable array.
+#define BENCH_ARRAY(type, name) static struct { type *items; size_t count; size_t cap; } name
+
+BENCH_ARRAY(bench_can_t, can_frames);
+BENCH_ARRAY(bench_chunk_t, pc_chunks);
+BENCH_ARRAY(uint8_t, pc_bytes);
+BENCH_ARRAY(bench_lc_t, lc_samples);
+BENCH_ARRAY(bench_gpio_t, gpio_changes);
+BENCH_ARRAY(bench_cycle_t, cycles);
+BENCH_ARRAY(size_t, tpdo_index[3]);
+BENCH_ARRAY(bench_replay_t, replay);
+
+int32_t bench_replay_force;
+
+static char trace_name[256];
+static motor_status_t rx_status;
+static pc_frame_parser_t pc_parser;
+static int moving_avg_window[5];
+
+static void *bench_grow(void *items, size_t *cap, size_t count, size_t size)
+{
+    if (count < *cap)
+    {
+        return items;
+    }
+    *cap = (*cap == 0) ? 256 : *cap * 2;
+    void *grown = realloc(items, *cap * size);
+    if (grown == NULL)
+    {
+        fprintf(stderr, "Out of memory loading the trace\n");
+        exit(1);
+    }
+    return grown;
+}
+
+#define BENCH_PUSH(array, value)                                                              \
+    do                                                                                        \
+    {                                                                                         \
+        (array).items = bench_grow((array).items, &(array).cap, (array).count, sizeof(*(array).items)); \
+        (array).items[(array).count++] = (value);                                             \
+    } while (0)
+
+static void bench_add_can(int64_t time_us, uint32_t cob_id, const uint8_t *data, uint8_t dlc)
+{
+    bench_can_t frame = {.time_us = time_us};
+    frame.msg.identifier = cob_id;
+    frame.msg.data_length_code = dlc;
+    memcpy(frame.msg.data, data, MIN(dlc, 8));
+    BENCH_PUSH(can_frames, frame);
+}
+
+static void bench_add_pc(int64_t time_us, const uint8_t *data, size_t len)
+{
+    bench_chunk_t chunk = {.time_us = time_us, .offset = pc_bytes.count, .len = len};
+    for (size_t i = 0; i < len; i++)
+    {
+        BENCH_PUSH(pc_bytes, data[i]);
+    }
+    BENCH_PUSH(pc_chunks, chunk);
+}
+
+static void bench_clear(void)
+{
+    can_frames.count = 0;
+    pc_chunks.count = 0;
+    pc_bytes.count = 0;
+    lc_samples.count = 0;
+    gpio_changes.count = 0;
+    cycles.count = 0;
+    replay.count = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        tpdo_index[i].count = 0;
+    }
+}
+
+// Command frames reach inputs.pc_msg the way uart_frame_handler and the process task pass them on.
+static void bench_pc_frame_handler(const uint8_t *frame, size_t len)
+{
+    if (frame[1] == PC_FRAME_HEAD)
+    {
+        memcpy(inputs.pc_msg, frame, PC_CMD_FRAME_LEN);
+    }
+}
+
+/**
+ * @brief Split the records into control cycles and work out the inputs the
+ *        process task sees in each: the decoded TPDOs, and the latest PC
+ *        command, load cell sample and switch levels.
+ */
+static void bench_build_cycles(void)
+{
+    size_t chunk = 0, lc = 0, gpio = 0;
+    int32_t lc_raw = 0;
+    bench_gpio_t levels = {.handle = 1, .rtn = 1, .estop = 1};
+
+    memset(&rx_status, 0, sizeof(rx_status));
+    memset(inputs.pc_msg, 0, sizeof(inputs.pc_msg));
+    pc_frame_parser_init(&pc_parser, bench_pc_frame_handler);
+
+    for (size_t i = 0; i < can_frames.count; i++)
+    {
+        uint8_t function_code = can_frames.items[i].msg.identifier >> 7;
+        if (function_code == 3 || function_code == 5 || function_code == 7)
+        {
+            BENCH_PUSH(tpdo_index[(function_code - 3) / 2], i);
+        }
+        if (function_code != 3)
+        {
+            continue;
+        }
+
+        bench_cycle_t cycle = {.time_us = can_frames.items[i].time_us, .first_frame = i};
+        size_t end = i + 1;
+        while (end < can_frames.count && (can_frames.items[end].msg.identifier >> 7) != 3)
+        {
+            end++;
+        }
+        cycle.frame_count = end - i;
+
+        tpro1_flag = tpro2_flag = tpro3_flag = 0;
+        for (size_t f = i; f < end; f++)
+        {
+            host_time_us = can_frames.items[f].time_us;
+            processRxMsg(&can_frames.items[f].msg, &rx_status);
+        }
+        cycle.status = rx_status;
+
+        for (; chunk < pc_chunks.count && pc_chunks.items[chunk].time_us <= cycle.time_us; chunk++)
+        {
+            pc_frame_parser_feed(&pc_parser, &pc_bytes.items[pc_chunks.items[chunk].offset], pc_chunks.items[chunk].len);
+        }
+        memcpy(cycle.pc_msg, inputs.pc_msg, PC_CMD_FRAME_LEN);
+
+        for (; lc < lc_samples.count && lc_samples.items[lc].time_us <= cycle.time_us; lc++)
+        {
+            lc_raw = lc_samples.items[lc].value;
+        }
+        cycle.lc_raw = lc_raw;
+
+        for (; gpio < gpio_changes.count && gpio_changes.items[gpio].time_us <= cycle.time_us; gpio++)
+        {
+            levels = gpio_changes.items[gpio];
+        }
+        cycle.handle = levels.handle;
+        cycle.rtn = levels.rtn;
+        cycle.estop = levels.estop;
+
+        BENCH_PUSH(cycles, cycle);
+    }
+    tpro1_flag = tpro2_flag = tpro3_flag = 0;
+}
+
+/**
+ * @brief Load a session trace.
+ *
+ * @return number of control cycles in it, -1 if the file cannot be read.
+ *         Replay records are counted by bench_replay_count().
+ */
+int bench_trace_load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    bench_clear();
+    char line[512];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        long long time_us;
+        int consumed;
+        line_no++;
+
+        if (line[0] == '#' || line[0] == '\n' || sscanf(line + 1, "%lld%n", &time_us, &consumed) != 1)
+        {
+            continue;
+        }
+        const char *rest = line + 1 + consumed;
+
+        switch (line[0])
+        {
+        case 'C':
+        {
+            unsigned int cob_id, dlc, data[8] = {0};
+            uint8_t bytes[8];
+            if (sscanf(rest, "%x %u %x %x %x %x %x %x %x %x", &cob_id, &dlc, &data[0], &data[1], &data[2],
+                       &data[3], &data[4], &data[5], &data[6], &data[7]) < 2)
+            {
+                fprintf(stderr, "%s:%d: bad CAN record\n", path, line_no);
+                continue;
+            }
+            for (int i = 0; i < 8; i++)
+            {
+                bytes[i] = (uint8_t)data[i];
+            }
+            bench_add_can(time_us, cob_id, bytes, (uint8_t)dlc);
+            break;
+        }
+        case 'P':
+        {
+            uint8_t bytes[128];
+            size_t len = 0;
+            unsigned int byte;
+            while (len < sizeof(bytes) && sscanf(rest, "%x%n", &byte, &consumed) == 1)
+            {
+                bytes[len++] = (uint8_t)byte;
+                rest += consumed;
+            }
+            bench_add_pc(time_us, bytes, len);
+            break;
+        }
+        case 'L':
+        {
+            int value;
+            if (sscanf(rest, "%d", &value) == 1)
+            {
+                BENCH_PUSH(lc_samples, ((bench_lc_t){.time_us = time_us, .value = value}));
+            }
+            break;
+        }
+        case 'G':
+        {
+            bench_gpio_t levels = {.time_us = time_us};
+            if (sscanf(rest, "%d %d %d", &levels.handle, &levels.rtn, &levels.estop) == 3)
+            {
+                BENCH_PUSH(gpio_changes, levels);
+            }
+            break;
+        }
+        case 'I':
+        {
+            bench_replay_t record = {.time_us = time_us};
+            unsigned int mode, status_word, error_code, limit_switches, confidence, pc[PC_CMD_FRAME_LEN];
+            int current;
+            if (sscanf(rest, "%u %d %d %x %u %x %x %d %d %d %d %x %d %d %u %d %x %x %x %x %x %x %x %x %x %x %x %x %x %x",
+                       &record.cycle, &record.state, &record.level, &record.switches, &mode, &status_word,
+                       &error_code, &record.status.position_inc, &record.status.speed_inc,
+                       &record.status.position_inc_offset, &current, &limit_switches, &record.lc_inc,
+                       &record.lc_age_us, &confidence, &record.force, &pc[0], &pc[1], &pc[2], &pc[3], &pc[4],
+                       &pc[5], &pc[6], &pc[7], &pc[8], &pc[9], &pc[10], &pc[11], &pc[12], &pc[13]) != 30)
+            {
+                fprintf(stderr, "%s:%d: bad input record\n", path, line_no);
+                continue;
+            }
+            record.status.control_mode = (uint8_t)mode;
+            record.status.status_word = (uint16_t)status_word;
+            record.status.error_code = (uint16_t)error_code;
+            record.status.actual_current = (short)current;
+            record.status.motor_ls = (limit_switches & BENCH_LS_MOTOR) != 0;
+            record.status.far_side_ls = (limit_switches & BENCH_LS_FAR) != 0;
+            record.status.centre_ls = (limit_switches & BENCH_LS_CENTRE) != 0;
+            record.status.sample_time_us = time_us;
+            record.lc_confidence = (uint8_t)confidence;
+            for (int i = 0; i < PC_CMD_FRAME_LEN; i++)
+            {
+                record.pc_msg[i] = (uint8_t)pc[i];
+            }
+            BENCH_PUSH(replay, record);
+            break;
+        }
+        case 'O':
+        {
+            unsigned int cycle;
+            bench_replay_out_t out;
+            if (sscanf(rest, "%u %d %d %d %d", &cycle, &out.state, &out.command, &out.position, &out.speed) != 5 ||
+                replay.count == 0 || replay.items[replay.count - 1].cycle != cycle)
+            {
+                fprintf(stderr, "%s:%d: output record without its input record\n", path, line_no);
+                continue;
+            }
+            replay.items[replay.count - 1].expected = out;
+            replay.items[replay.count - 1].has_expected = true;
+            break;
+        }
+        default:
+            fprintf(stderr, "%s:%d: unknown record '%c'\n", path, line_no, line[0]);
+            break;
+        }
+    }
+    fclose(file);
+
+    snprintf(trace_name, sizeof(trace_name), "%s", path);
+    bench_build_cycles();
+    return (int)cycles.count;
+}
+
+static uint32_t bench_random(uint32_t *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+/**
+ * @brief Make up a session for when no recorded trace is given: the handle
+ *        swept back and forth at 0.5 Hz in torque mode with compensation on,
+ *        a command from the PC every 10 ms, some of them split over two UART
+ *        reads, and a noisy load cell at 400 Hz.
+ */
+void bench_trace_synthesize(size_t cycle_count)
+{
+    uint32_t noise = 1;
+    int64_t end_us = (int64_t)cycle_count * BENCH_PERIOD_US;
+
+    bench_clear();
+    BENCH_PUSH(gpio_changes, ((bench_gpio_t){.time_us = 0, .handle = 1, .rtn = 1, .estop = 1}));
+
+    for (int64_t t = 0; t < end_us; t += BENCH_PERIOD_US)
+    {
+        double phase = 2.0 * M_PI * 0.5 * (double)t / 1e6;
+        int32_t position = (int32_t)(400000.0 * sin(phase));
+        int32_t speed = (int32_t)(-120.0 * DRIVE_SPEED_PER_MM_S * cos(phase));
+        int16_t current = (int16_t)(250.0 * cos(phase) + (int)(bench_random(&noise) % 21) - 10);
+        uint16_t status_word = 0x0637;
+        uint16_t error_code = 0;
+        uint8_t data[8] = {0};
+
+        // TPDO1 status word and position, TPDO2 speed and current, TPDO3 error, mode and switches.
+        memcpy(&data[0], &status_word, 2);
+        memcpy(&data[2], &position, 4);
+        bench_add_can(t + 300, 0x180 + NODE_ID, data, 6);
+        memcpy(&data[0], &speed, 4);
+        memcpy(&data[4], &current, 2);
+        bench_add_can(t + 420, 0x280 + NODE_ID, data, 6);
+        memset(data, 0, sizeof(data));
+        memcpy(&data[0], &error_code, 2);
+        data[2] = 4;
+        data[3] = 0x07;
+        bench_add_can(t + 540, 0x380 + NODE_ID, data, 4);
+    }
+
+    for (int64_t t = 0; t < end_us; t += BENCH_PC_PERIOD_US)
+    {
+        int16_t desired_current = (int16_t)(20.0 * sin(2.0 * M_PI * (double)t / 3e6));
+        uint8_t frame[PC_CMD_FRAME_LEN] = {PC_FRAME_HEAD, PC_FRAME_HEAD, 0x80, 0x82};
+        memcpy(&frame[12], &desired_current, 2);
+        if (bench_random(&noise) % 4 == 0)
+        {
+            bench_add_pc(t, frame, 6);
+            bench_add_pc(t + 200, &frame[6], PC_CMD_FRAME_LEN - 6);
+        }
+        else
+        {
+            bench_add_pc(t, frame, PC_CMD_FRAME_LEN);
+        }
+    }
+
+    for (int64_t t = 0; t < end_us; t += BENCH_LC_PERIOD_US)
+    {
+        int32_t value = 20000 + (int32_t)(3000.0 * sin(2.0 * M_PI * 0.5 * (double)t / 1e6)) + (int32_t)(bench_random(&noise) % 41) - 20;
+        BENCH_PUSH(lc_samples, ((bench_lc_t){.time_us = t, .value = value}));
+    }
+
+    snprintf(trace_name, sizeof(trace_name), "synthetic, %zu cycles", cycle_count);
+    bench_build_cycles();
+}
+
+const char *bench_trace_name(void)
+{
+    return trace_name;
+}
+
+size_t bench_cycle_count(void)
+{
+    return cycles.count;
+}
+
+size_t bench_pc_chunk_count(void)
+{
+    return pc_chunks.count;
+}
+
+/**
+ * @brief Indices of the CAN frames of one TPDO, by function code 3, 5 or 7.
+ */
+size_t bench_frames_of_type(uint8_t function_code, const size_t **indices)
+{
+    if (function_code != 3 && function_code != 5 && function_code != 7)
+    {
+        return 0;
+    }
+    *indices = tpdo_index[(function_code - 3) / 2].items;
+    return tpdo_index[(function_code - 3) / 2].count;
+}
+
+const char *bench_state_name(int state)
+{
+    static const char *const names[] = {"powerUp", "enabled", "initialising", "ready",
+                                        "run", "estop", "wifiConfig", "devMatching"};
+    return (state >= 0 && state < bench_state_count()) ? names[state] : "?";
+}
+
+int bench_state_count(void)
+{
+    return devMatching + 1;
+}
+
+/**
+ * @brief Back to the state after startup, with the state machine in run.
+ */
+void bench_reset(void)
+{
+    init_state_machine();
+    cur_state = run;
+    tpro1_flag = tpro2_flag = tpro3_flag = 0;
+    memset(&rx_status, 0, sizeof(rx_status));
+    pc_frame_parser_init(&pc_parser, bench_pc_frame_handler);
+    host_gpio_levels[HANDLE_SW_PIN] = 1;
+    host_gpio_levels[RETURN_SW_PIN] = 1;
+    host_gpio_levels[ESTOP_PIN] = 1;
+}
+
+void bench_rx_frame(size_t index)
+{
+    host_time_us = can_frames.items[index].time_us;
+    processRxMsg(&can_frames.items[index].msg, &rx_status);
+}
+
+/**
+ * @brief Set the inputs of a cycle as the process task does before it runs
+ *        the state machine.
+ */
+void bench_cycle_inputs(size_t index)
+{
+    const bench_cycle_t *cycle = &cycles.items[index];
+
+    host_time_us = cycle->time_us;
+    host_gpio_levels[HANDLE_SW_PIN] = cycle->handle;
+    host_gpio_levels[RETURN_SW_PIN] = cycle->rtn;
+    host_gpio_levels[ESTOP_PIN] = cycle->estop;
+    memcpy(&inputs.motor_data, &cycle->status, sizeof(motor_status_t));
+    memcpy(inputs.pc_msg, cycle->pc_msg, PC_CMD_FRAME_LEN);
+    inputs.inter_force_inc = cycle->lc_raw;
+    inputs.inter_force_age_us = 0;
+    inputs.inter_force_confidence = 100;
+}
+
+/**
+ * @brief One state machine step with the current inputs, forced into state.
+ */
+void bench_fsm(int state)
+{
+    cur_state = (enum state_codes)state;
+    main_fsm_function();
+}
+
+int bench_compensation(size_t index)
+{
+    const bench_cycle_t *cycle = &cycles.items[index];
+    short desired_current = (short)(cycle->pc_msg[12] | (cycle->pc_msg[13] << 8));
+    return Compensation(-cycle->status.speed_inc, cycle->lc_raw, desired_current);
+}
+
+int bench_abnormal_detection(size_t index)
+{
+    const bench_cycle_t *cycle = &cycles.items[index];
+    short desired_current = (short)(cycle->pc_msg[12] | (cycle->pc_msg[13] << 8));
+    host_time_us = cycle->time_us;
+    return abnormal_detection(-cycle->status.speed_inc, desired_current);
+}
+
+int bench_moving_avg(size_t index)
+{
+    return movingAvg(moving_avg_window, 5, -cycles.items[index].status.speed_inc, false);
+}
+
+// The cycle's PC current doubled, in torque mode in run, so that the limits are reached now and then.
+uint16_t bench_safety(size_t index)
+{
+    const bench_cycle_t *cycle = &cycles.items[index];
+    short desired_current = (short)(cycle->pc_msg[12] | (cycle->pc_msg[13] << 8));
+    output_wrapper out = {0};
+
+    host_time_us = cycle->time_us;
+    safety_pc_frame();
+    out.target_motor_paras.control_mode = 4;
+    out.target_motor_paras.desired_torque = (short)(2 * desired_current);
+    out.input_time_us = cycle->time_us;
+    out.state = run;
+    out.actual_position_inc = cycle->status.position_inc;
+    out.actual_speed_inc = cycle->status.speed_inc;
+    return safety_apply(&out, cycle->time_us);
+}
+
+void bench_upward_frame(void)
+{
+    processUpwardUdpMsg();
+}
+
+void bench_parse_pc(size_t index)
+{
+    const bench_chunk_t *chunk = &pc_chunks.items[index];
+    pc_frame_parser_feed(&pc_parser, &pc_bytes.items[chunk->offset], chunk->len);
+}
+
+/**
+ * @brief Everything between the TPDOs and the RPDOs of one cycle: decode the
+ *        drive's frames, hand the status to the process task and run the
+ *        state machine in whatever state it is in.
+ */
+void bench_full_cycle(size_t index)
+{
+    const bench_cycle_t *cycle = &cycles.items[index];
+
+    for (size_t f = cycle->first_frame; f < cycle->first_frame + cycle->frame_count; f++)
+    {
+        bench_rx_frame(f);
+    }
+    bench_cycle_inputs(index);
+    memcpy(&inputs.motor_data, &rx_status, sizeof(motor_status_t));
+    main_fsm_function();
+}
+
+size_t bench_replay_count(void)
+{
+    return replay.count;
+}
+
+uint32_t bench_replay_cycle(size_t index)
+{
+    return replay.items[index].cycle;
+}
+
+/**
+ * @brief State after startup, with the state machine in the state of the
+ *        first replayed cycle.
+ */
+void bench_replay_reset(void)
+{
+    bench_reset();
+    cur_state = (replay.count > 0) ? (enum state_codes)replay.items[0].state : powerUp;
+    host_deadline_level = 0;
+}
+
+/**
+ * @brief Run one recorded cycle through the state machine. The state carries
+ *        over from the previous step unless resync is set, e.g. after a gap
+ *        in the recording.
+ */
+void bench_replay_step(size_t index, bool resync, bench_replay_out_t *out)
+{
+    const bench_replay_t *record = &replay.items[index];
+
+    host_time_us = record->time_us;
+    host_deadline_level = record->level;
+    host_gpio_levels[HANDLE_SW_PIN] = (record->switches & BENCH_SW_HANDLE) != 0;
+    host_gpio_levels[RETURN_SW_PIN] = (record->switches & BENCH_SW_RETURN) != 0;
+    host_gpio_levels[ESTOP_PIN] = (record->switches & BENCH_SW_ESTOP) != 0;
+    flags.rtn_event_triggered = (record->switches & BENCH_SW_RTN_EVENT) != 0;
+    memcpy(&inputs.motor_data, &record->status, sizeof(motor_status_t));
+    memcpy(inputs.pc_msg, record->pc_msg, PC_CMD_FRAME_LEN);
+    inputs.inter_force_inc = record->lc_inc;
+    inputs.inter_force_age_us = record->lc_age_us;
+    inputs.inter_force_confidence = record->lc_confidence;
+    bench_replay_force = record->force;
+    if (resync)
+    {
+        cur_state = (enum state_codes)record->state;
+    }
+
+    main_fsm_function();
+
+    out->state = cur_state;
+    out->command = outputs.target_motor_paras.desired_torque;
+    out->position = linear_position;
+    out->speed = linear_speed;
+}
+
+/**
+ * @brief The outputs recorded on the robot for a replayed cycle.
+ *
+ * @return false if the trace has no O record for it.
+ */
+bool bench_replay_expected(size_t index, bench_replay_out_t *out)
+{
+    if (!replay.items[index].has_expected)
+    {
+        return false;
+    }
+    *out = replay.items[index].expected;
+    return true;
+}
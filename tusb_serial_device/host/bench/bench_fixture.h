@@ -0,0 +1,75 @@
+/*
+ * bench_fixture.h
+ *
+ * Inputs for the host benchmarks, and one entry point per benchmarked
+ * firmware function. The firmware globals live in C (stateMachine.h defines
+ * them in the header), so the C++ benchmark only sees this interface.
+ *
+ * A session trace is a text file with one record per line, times in us:
+ *   C <t> <cob_id hex> <dlc> <b0> .. <b7>   CAN frame from the drive, bytes hex
+ *   P <t> <b0> <b1> ..                      bytes from the PC, as one UART read
+ *   L <t> <raw>                             load cell sample, amplifier counts
+ *   G <t> <handle> <return> <estop>         switch input levels
+ *   I <t> <cycle> <state> <level> <switches hex> <mode> <status_word hex>
+ *     <error hex> <position> <speed> <offset> <current> <limit_switches hex>
+ *     <lc_inc> <lc_age_us> <lc_confidence> <force> <pc_b0> .. <pc_b13>
+ *                                           inputs of one main_fsm_function call
+ *   O <t> <cycle> <state> <command> <position> <speed>
+ *                                           what that call produced
+ *   # ...                                   comment
+ * Records are in time order. A control cycle starts at each TPDO1.
+ *
+ * I and O records come from a session recorded with CONFIG_TR_RECORDER_INPUTS
+ * (tools/session_tool.py trace), fields as in rec_input_record_t. They are
+ * replayed by fw_replay through the bench_replay_ functions, not by fw_bench.
+ */
+
+#ifndef BENCH_FIXTURE_H_
+#define BENCH_FIXTURE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH_SYNTHETIC_CYCLES  2500    // 10 s at the 4 ms default period.
+
+// What one state machine step produced, compared cycle by cycle on replay.
+typedef struct {
+    int state;
+    int command;                // desired_torque
+    int position;               // linear_position
+    int speed;                  // linear_speed
+} bench_replay_out_t;
+
+// Returned by lc_cal_process() in fw_replay: the load cell calibration is replayed as a sensor.
+extern int32_t bench_replay_force;
+
+int bench_trace_load(const char *path);
+void bench_trace_synthesize(size_t cycles);
+const char *bench_trace_name(void);
+
+size_t bench_cycle_count(void);
+size_t bench_pc_chunk_count(void);
+size_t bench_frames_of_type(uint8_t function_code, const size_t **indices);
+const char *bench_state_name(int state);
+int bench_state_count(void);
+
+void bench_reset(void);
+void bench_rx_frame(size_t index);
+void bench_cycle_inputs(size_t cycle);
+void bench_fsm(int state);
+int bench_compensation(size_t cycle);
+int bench_abnormal_detection(size_t cycle);
+int bench_moving_avg(size_t cycle);
+uint16_t bench_safety(size_t cycle);
+void bench_upward_frame(void);
+void bench_parse_pc(size_t chunk);
+void bench_full_cycle(size_t cycle);
+
+size_t bench_replay_count(void);
+uint32_t bench_replay_cycle(size_t index);
+void bench_replay_reset(void);
+void bench_replay_step(size_t index, bool resync, bench_replay_out_t *out);
+bool bench_replay_expected(size_t index, bench_replay_out_t *out);
+
+#endif /* BENCH_FIXTURE_H_ */
@@ -0,0 +1,241 @@
+/*
+ * bench_main.cc
+ *
+ * Host micro-benchmarks of the control path. Each benchmark replays the
+ * inputs of a session trace (bench_fixture.h) through one firmware function,
+ * cycle by cycle, wrapping around at the end of the trace.
+ *
+ *   fw_bench [--trace=session.txt] [benchmark flags]
+ *
+ * Without --trace (or BENCH_TRACE in the environment) a synthetic session is
+ * used. The firmware prints to stdout on some paths; that output goes to
+ * /dev/null so the console report stays readable, but it is still timed.
+ */
+
+#include <benchmark/benchmark.h>
+#include <ext/stdio_filebuf.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+extern "C" {
+#include "bench_fixture.h"
+}
+
+namespace {
+
+const char *const kTpdoNames[] = {"TPDO1", "TPDO2", "TPDO3"};
+
+void BM_processRxMsg(benchmark::State &state)
+{
+    const uint8_t function_code = static_cast<uint8_t>(state.range(0));
+    const size_t *indices = nullptr;
+    const size_t count = bench_frames_of_type(function_code, &indices);
+    if (count == 0)
+    {
+        state.SkipWithError("No frames of this TPDO in the trace");
+        return;
+    }
+
+    bench_reset();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        bench_rx_frame(indices[i]);
+        i = (i + 1 == count) ? 0 : i + 1;
+    }
+    state.SetLabel(kTpdoNames[(function_code - 3) / 2]);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_processRxMsg)->ArgName("function_code")->Arg(3)->Arg(5)->Arg(7);
+
+// Includes loading the cycle's inputs, a copy of about 100 bytes.
+void BM_main_fsm_function(benchmark::State &state)
+{
+    const int fsm_state = static_cast<int>(state.range(0));
+    const size_t cycles = bench_cycle_count();
+
+    bench_reset();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        bench_cycle_inputs(i);
+        bench_fsm(fsm_state);
+        i = (i + 1 == cycles) ? 0 : i + 1;
+    }
+    state.SetLabel(bench_state_name(fsm_state));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_main_fsm_function)->ArgName("state")->DenseRange(0, bench_state_count() - 1);
+
+void BM_Compensation(benchmark::State &state)
+{
+    const size_t cycles = bench_cycle_count();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(bench_compensation(i));
+        i = (i + 1 == cycles) ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Compensation);
+
+void BM_abnormal_detection(benchmark::State &state)
+{
+    const size_t cycles = bench_cycle_count();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(bench_abnormal_detection(i));
+        i = (i + 1 == cycles) ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_abnormal_detection);
+
+void BM_movingAvg(benchmark::State &state)
+{
+    const size_t cycles = bench_cycle_count();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(bench_moving_avg(i));
+        i = (i + 1 == cycles) ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_movingAvg);
+
+void BM_safety_apply(benchmark::State &state)
+{
+    const size_t cycles = bench_cycle_count();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(bench_safety(i));
+        i = (i + 1 == cycles) ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_safety_apply);
+
+// Includes loading the cycle's inputs, as BM_main_fsm_function.
+void BM_processUpwardUdpMsg(benchmark::State &state)
+{
+    const size_t cycles = bench_cycle_count();
+
+    bench_reset();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        bench_cycle_inputs(i);
+        bench_upward_frame();
+        i = (i + 1 == cycles) ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_processUpwardUdpMsg);
+
+void BM_pc_frame_parser_feed(benchmark::State &state)
+{
+    const size_t chunks = bench_pc_chunk_count();
+    if (chunks == 0)
+    {
+        state.SkipWithError("No PC data in the trace");
+        return;
+    }
+
+    bench_reset();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        bench_parse_pc(i);
+        i = (i + 1 == chunks) ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_pc_frame_parser_feed);
+
+// processRxMsg for all TPDOs of a cycle plus main_fsm_function: the share of the cycle budget
+// spent between the last TPDO and the RPDOs, without the queue hops.
+void BM_control_cycle(benchmark::State &state)
+{
+    const size_t cycles = bench_cycle_count();
+
+    bench_reset();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        bench_full_cycle(i);
+        i = (i + 1 == cycles) ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_control_cycle);
+
+// Takes --trace=FILE out of argv before the benchmark library sees it.
+std::string TakeTraceArgument(int *argc, char **argv)
+{
+    const char *env = std::getenv("BENCH_TRACE");
+    std::string trace = (env != nullptr) ? env : "";
+    int out = 1;
+    for (int i = 1; i < *argc; i++)
+    {
+        if (std::strncmp(argv[i], "--trace=", 8) == 0)
+        {
+            trace = argv[i] + 8;
+        }
+        else
+        {
+            argv[out++] = argv[i];
+        }
+    }
+    *argc = out;
+    return trace;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const std::string trace = TakeTraceArgument(&argc, argv);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+
+    if (trace.empty())
+    {
+        bench_trace_synthesize(BENCH_SYNTHETIC_CYCLES);
+    }
+    else if (bench_trace_load(trace.c_str()) <= 0)
+    {
+        std::fprintf(stderr, "No control cycles in %s\n", trace.c_str());
+        return 1;
+    }
+    benchmark::AddCustomContext("trace", bench_trace_name());
+    benchmark::AddCustomContext("cycles", std::to_string(bench_cycle_count()));
+
+    // Keep the report on the real stdout and send the firmware's printf to /dev/null.
+    std::fflush(stdout);
+    __gnu_cxx::stdio_filebuf<char> console_buf(dup(STDOUT_FILENO), std::ios::out);
+    std::ostream console(&console_buf);
+    if (std::freopen("/dev/null", "w", stdout) == nullptr)
+    {
+        std::perror("/dev/null");
+        return 1;
+    }
+
+    benchmark::ConsoleReporter reporter;
+    reporter.SetOutputStream(&console);
+    reporter.SetErrorStream(&std::cerr);
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,246 @@
+/*
+ * fw_replay.c
+ *
+ * Replays the inputs of a recorded session (I records, bench_fixture.h)
+ * through the host build of the state machine, one main_fsm_function call
+ * per recorded cycle, and compares what it produces:
+ *
+ *   fw_replay session.txt                      against the robot's O records
+ *   fw_replay session.txt --csv=a.csv          keep this build's outputs
+ *   fw_replay session.txt --expect=a.csv       A/B: against another build's
+ *
+ * The first mismatch is reported with its cycle; the exit status is 1 if
+ * there was one. --repeat=N runs the session N times and keeps the fastest
+ * time of each cycle, so the timing of two builds can be compared as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench_fixture.h"
+
+typedef struct {
+    bool valid;
+    bench_replay_out_t out;
+    double ns;
+} replay_row_t;
+
+static FILE *console;
+
+// The load cell calibration is not part of the replayed sources; its recorded output is the input.
+int lc_cal_process(int32_t raw, uint8_t confidence, bool at_rest, int64_t now_us)
+{
+    return bench_replay_force;
+}
+
+static double replay_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Rows of a --csv file, by position in the session. Cycle numbers have to match.
+static replay_row_t *replay_load_csv(const char *path, size_t count)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    replay_row_t *rows = calloc(count, sizeof(*rows));
+    char line[256];
+    size_t index = 0;
+    while (rows != NULL && index < count && fgets(line, sizeof(line), file) != NULL)
+    {
+        unsigned int cycle;
+        replay_row_t row = {.valid = true};
+        if (sscanf(line, "%u,%d,%d,%d,%d,%lf", &cycle, &row.out.state, &row.out.command, &row.out.position,
+                   &row.out.speed, &row.ns) != 6)
+        {
+            continue;   // Header
+        }
+        if (cycle != bench_replay_cycle(index))
+        {
+            fprintf(console, "%s: cycle %u where the session has %u, not the same session\n", path, cycle,
+                    bench_replay_cycle(index));
+            free(rows);
+            rows = NULL;
+            break;
+        }
+        rows[index++] = row;
+    }
+    fclose(file);
+    return rows;
+}
+
+static bool replay_compare(uint32_t cycle, const bench_replay_out_t *expected, const bench_replay_out_t *actual,
+                           bool report)
+{
+    static const char *const fields[] = {"state", "command", "position", "speed"};
+    const int expected_values[] = {expected->state, expected->command, expected->position, expected->speed};
+    const int actual_values[] = {actual->state, actual->command, actual->position, actual->speed};
+    bool match = true;
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (expected_values[i] != actual_values[i])
+        {
+            if (report)
+            {
+                fprintf(console, "First mismatch at cycle %u: %s %d, expected %d\n", cycle, fields[i],
+                        actual_values[i], expected_values[i]);
+            }
+            match = false;
+        }
+    }
+    return match;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void replay_timing(const char *name, const double *ns, size_t count)
+{
+    double *sorted = malloc(count * sizeof(*sorted));
+    double sum = 0;
+
+    memcpy(sorted, ns, count * sizeof(*sorted));
+    qsort(sorted, count, sizeof(*sorted), compare_double);
+    for (size_t i = 0; i < count; i++)
+    {
+        sum += sorted[i];
+    }
+    fprintf(console, "%-8s mean %7.1f ns  p50 %7.1f  p99 %7.1f  max %8.1f\n", name, sum / count,
+            sorted[count / 2], sorted[count * 99 / 100], sorted[count - 1]);
+    free(sorted);
+}
+
+int main(int argc, char **argv)
+{
+    const char *trace = NULL, *csv = NULL, *expect = NULL;
+    int repeat = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--csv=", 6) == 0)
+        {
+            csv = argv[i] + 6;
+        }
+        else if (strncmp(argv[i], "--expect=", 9) == 0)
+        {
+            expect = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--repeat=", 9) == 0)
+        {
+            repeat = atoi(argv[i] + 9) > 0 ? atoi(argv[i] + 9) : 1;
+        }
+        else if (argv[i][0] != '-' && trace == NULL)
+        {
+            trace = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: fw_replay TRACE [--csv=OUT] [--expect=CSV] [--repeat=N]\n");
+            return 2;
+        }
+    }
+    if (trace == NULL)
+    {
+        fprintf(stderr, "Usage: fw_replay TRACE [--csv=OUT] [--expect=CSV] [--repeat=N]\n");
+        return 2;
+    }
+    if (bench_trace_load(trace) < 0 || bench_replay_count() == 0)
+    {
+        fprintf(stderr, "No replay records in %s\n", trace);
+        return 1;
+    }
+
+    // Keep the report on the real stdout and send the firmware's printf to /dev/null.
+    fflush(stdout);
+    console = fdopen(dup(STDOUT_FILENO), "w");
+    if (console == NULL || freopen("/dev/null", "w", stdout) == NULL)
+    {
+        perror("/dev/null");
+        return 1;
+    }
+
+    size_t count = bench_replay_count();
+    replay_row_t *rows = calloc(count, sizeof(*rows));
+    double *ns = malloc(count * sizeof(*ns));
+    replay_row_t *other = NULL;
+    if (expect != NULL && (other = replay_load_csv(expect, count)) == NULL)
+    {
+        fprintf(console, "Cannot use %s\n", expect);
+        return 1;
+    }
+
+    size_t gaps = 0;
+    for (int run = 0; run < repeat; run++)
+    {
+        bench_replay_reset();
+        for (size_t i = 0; i < count; i++)
+        {
+            // A cycle missing from the recording: the state machine state is taken from the record.
+            bool resync = i > 0 && bench_replay_cycle(i) != bench_replay_cycle(i - 1) + 1;
+            gaps += (run == 0 && resync);
+
+            double start = replay_now_ns();
+            bench_replay_step(i, resync, &rows[i].out);
+            double elapsed = replay_now_ns() - start;
+            ns[i] = (run == 0 || elapsed < ns[i]) ? elapsed : ns[i];
+        }
+    }
+
+    size_t compared = 0, mismatched = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        bench_replay_out_t expected;
+        bool have = (other != NULL) ? other[i].valid : bench_replay_expected(i, &expected);
+        if (other != NULL && have)
+        {
+            expected = other[i].out;
+        }
+        if (have)
+        {
+            compared++;
+            mismatched += !replay_compare(bench_replay_cycle(i), &expected, &rows[i].out, mismatched == 0);
+        }
+    }
+
+    if (csv != NULL)
+    {
+        FILE *out = fopen(csv, "w");
+        if (out == NULL)
+        {
+            perror(csv);
+            return 1;
+        }
+        fprintf(out, "cycle,state,command,position,speed,ns\n");
+        for (size_t i = 0; i < count; i++)
+        {
+            fprintf(out, "%u,%d,%d,%d,%d,%.1f\n", bench_replay_cycle(i), rows[i].out.state, rows[i].out.command,
+                    rows[i].out.position, rows[i].out.speed, ns[i]);
+        }
+        fclose(out);
+    }
+    fprintf(console, "%s: %zu cycles, %zu gaps in the recording\n", bench_trace_name(), count, gaps);
+    fprintf(console, "%zu compared against %s, %zu mismatched\n", compared,
+            (other != NULL) ? expect : "the recorded outputs", mismatched);
+    replay_timing("this", ns, count);
+    if (other != NULL)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            ns[i] = other[i].ns;
+        }
+        replay_timing(expect, ns, count);
+    }
+
+    return mismatched > 0;
+}
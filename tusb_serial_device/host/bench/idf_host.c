@@ -0,0 +1,166 @@
+/*
+ * idf_host.c
+ *
+ * Stub implementations behind shim/idf_host.h, and stand-ins for the
+ * firmware functions that are not part of the benchmarked sources.
+ */
+
+#include "idf_host.h"
+#include "StateStatusLED.h"
+#include "deadline_monitor.h"
+#include "pc_command.h"
+
+int64_t host_time_us;
+int host_gpio_levels[GPIO_NUM_MAX];
+uint32_t host_queue_sends;
+int host_deadline_level;
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return (code == ESP_OK) ? "ESP_OK" : "ERROR";
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    host_queue_sends++;
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    return pdFAIL;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    return pdPASS;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return host_time_us;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    return host_gpio_levels[gpio_num];
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    host_gpio_levels[gpio_num] = (int)level;
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_size, int tx_size, int queue_size, QueueHandle_t *queue, int flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_rx_full_threshold(uart_port_t port, int threshold)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t symbols)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_get_baudrate(uart_port_t port, uint32_t *baudrate)
+{
+    *baudrate = CONFIG_TR_PC_LINK_BAUD_RATE;
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t wait)
+{
+    return 0;
+}
+
+int uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+    return (int)size;
+}
+
+esp_err_t twai_transmit(const twai_message_t *message, TickType_t wait)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *value)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+/* Firmware functions outside the benchmarked sources. */
+
+void led_state(enum state_codes cur_state)
+{
+}
+
+void wifi_prov_request(void)
+{
+}
+
+bool wifi_prov_busy(void)
+{
+    return false;
+}
+
+deadline_level_t deadline_level(void)
+{
+    return (deadline_level_t)host_deadline_level;
+}
+
+void pc_command_dispatch(const uint8_t *frame, pc_reply_writer_t writer)
+{
+}
+
+// Created by rtos_objects.c on the target.
+QueueHandle_t uart_queue, udp_send_queue, can_send_queue, can_receive_queue, motor_status_queue, can_sdo_rx_queue;
+SemaphoreHandle_t sem_motor_enabled, init_done_sem, timer_start_sem;
+EventGroupHandle_t key_press_event_group;
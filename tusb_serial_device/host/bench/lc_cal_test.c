@@ -0,0 +1,148 @@
+/*
+ * lc_cal_test.c
+ *
+ * Load cell calibration sequences through lc_cal_process(), one call per
+ * control cycle, as the process task makes them. Checks that the automatic
+ * tare never takes a calibration weight for the zero.
+ *
+ *   fw_lc_cal_test            or ctest, from the build directory
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "load_cell_cal.h"
+#include "pc_command.h"
+#include "stateMachine.h"
+
+#define RAW_ZERO        1000
+#define RAW_WEIGHT      1500
+#define WEIGHT_DN       50      // 5 N, under the 10 N an automatic tare may move a known zero.
+
+_Static_assert(WEIGHT_DN < LC_CAL_AUTO_TARE_MAX_DN, "the weight must pass for an automatic tare");
+
+static int failures;
+static int64_t now_us;
+
+#define CHECK_EQ(actual, expected)                                                              \
+    do {                                                                                        \
+        long long a_ = (actual), e_ = (expected);                                               \
+        if (a_ != e_)                                                                           \
+        {                                                                                       \
+            printf("  %s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); \
+            failures++;                                                                         \
+        }                                                                                       \
+    } while (0)
+
+static int run_cycles(int32_t raw, bool at_rest, int64_t duration_us)
+{
+    int force_dn = 0;
+
+    for (int64_t t = 0; t < duration_us; t += CONTROL_PERIOD_US)
+    {
+        now_us += CONTROL_PERIOD_US;
+        force_dn = lc_cal_process(raw, 1, at_rest, now_us);
+    }
+    return force_dn;
+}
+
+static void capture_point(uint8_t point, int32_t raw, int32_t force_dn)
+{
+    uint8_t payload[5] = {point};
+    uint8_t reply[PC_CMD_REPLY_MAX];
+    size_t reply_len = 0;
+
+    memcpy(&payload[1], &force_dn, sizeof(force_dn));
+    CHECK_EQ(lc_cal_cmd_point(payload, sizeof(payload), reply, &reply_len), PC_CMD_OK);
+    run_cycles(raw, true, LC_CAL_AVG_SAMPLES * CONTROL_PERIOD_US);
+}
+
+// No calibration and no zero, as after boot without NVS.
+static void setup(void)
+{
+    uint8_t reply[PC_CMD_REPLY_MAX];
+    size_t reply_len = 0;
+
+    cur_state = enabled;
+    CHECK_EQ(lc_cal_cmd_reset(NULL, 0, reply, &reply_len), PC_CMD_OK);
+    run_cycles(0, false, CONTROL_PERIOD_US);
+}
+
+// Point 1 taken as soon as the weight hangs, then the weight left on with the handle released.
+static void test_point_weight_on(void)
+{
+    lc_calibration_t cal;
+
+    setup();
+    capture_point(0, RAW_ZERO, 0);
+    run_cycles(RAW_ZERO, false, CONTROL_PERIOD_US);
+    capture_point(1, RAW_WEIGHT, WEIGHT_DN);
+
+    lc_cal_get(&cal);
+    CHECK_EQ(lroundf(cal.offset), RAW_ZERO);
+    CHECK_EQ(run_cycles(RAW_WEIGHT, true, 4 * LC_CAL_REST_SETTLE_US), WEIGHT_DN);
+    lc_cal_get(&cal);
+    CHECK_EQ(lroundf(cal.offset), RAW_ZERO);
+}
+
+// The weight hangs at rest for a while before point 1 is asked for.
+static void test_between_points(void)
+{
+    lc_calibration_t cal;
+
+    setup();
+    capture_point(0, RAW_ZERO, 0);
+    run_cycles(RAW_ZERO, false, CONTROL_PERIOD_US);
+    run_cycles(RAW_WEIGHT, true, 4 * LC_CAL_REST_SETTLE_US);
+    lc_cal_get(&cal);
+    CHECK_EQ(lroundf(cal.offset), 0);
+
+    capture_point(1, RAW_WEIGHT, WEIGHT_DN);
+    lc_cal_get(&cal);
+    CHECK_EQ(lroundf(cal.offset), RAW_ZERO);
+    CHECK_EQ(lroundf(cal.scale * 1000), WEIGHT_DN * 1000 / (RAW_WEIGHT - RAW_ZERO));
+}
+
+// Without any points the first rest period is tared, a later one near zero follows it.
+static void test_auto_tare(void)
+{
+    lc_calibration_t cal;
+
+    setup();
+    CHECK_EQ(run_cycles(RAW_ZERO, true, 4 * LC_CAL_REST_SETTLE_US), 0);
+    lc_cal_get(&cal);
+    CHECK_EQ(lroundf(cal.offset), RAW_ZERO);
+
+    run_cycles(RAW_ZERO, false, CONTROL_PERIOD_US);
+    run_cycles(RAW_ZERO + 20, true, 4 * LC_CAL_REST_SETTLE_US);
+    lc_cal_get(&cal);
+    CHECK_EQ(lroundf(cal.offset), RAW_ZERO + 20);
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} lc_cal_test_t;
+
+static const lc_cal_test_t tests[] = {
+    {"point_weight_on", test_point_weight_on},
+    {"between_points",  test_between_points},
+    {"auto_tare",       test_auto_tare},
+};
+
+#define TEST_COUNT      (int)(sizeof(tests) / sizeof(tests[0]))
+
+int main(void)
+{
+    int failed = 0;
+
+    for (int i = 0; i < TEST_COUNT; i++)
+    {
+        int before = failures;
+
+        tests[i].run();
+        printf("%-16s %s\n", tests[i].name, (failures == before) ? "ok" : "FAILED");
+        failed += (failures != before);
+    }
+    printf("%d of %d failed\n", failed, TEST_COUNT);
+    return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,346 @@
+/*
+ * safety_test.c
+ *
+ * One case per safety_cause_t: each drives an output past its limit through
+ * safety_apply() and checks the output that would go on the bus and the
+ * cause bits returned. The limits are the ones of shim/sdkconfig.h.
+ *
+ *   fw_safety_test            or ctest, from the build directory
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "safety.h"
+#include "deadline_monitor.h"
+#include "stateMachine.h"
+
+#define BIT(cause)      (1u << (cause))
+
+// As safety.c: the rise allowed per cycle at the nominal period.
+#define CURRENT_STEP    ((int32_t)((int64_t)SAFETY_CURRENT_SLEW * DEADLINE_PERIOD_US / 1000))
+#define SPEED_STEP      ((int32_t)((int64_t)SAFETY_SPEED_SLEW * DEADLINE_PERIOD_US / 1000))
+
+_Static_assert(CURRENT_STEP < SAFETY_MAX_CURRENT, "the current cases need a slew below the limit");
+_Static_assert(SPEED_STEP < SAFETY_MAX_SPEED, "the speed cases need a slew below the limit");
+
+#define NOW_US          10000000LL
+#define TRAVEL_LOW      1000
+#define TRAVEL_HIGH     100000
+
+static int failures;
+
+#define CHECK_EQ(actual, expected)                                                              \
+    do {                                                                                        \
+        long long a_ = (actual), e_ = (expected);                                               \
+        if (a_ != e_)                                                                           \
+        {                                                                                       \
+            printf("  %s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); \
+            failures++;                                                                         \
+        }                                                                                       \
+    } while (0)
+
+// A fresh output in run, from the PC, with a drive sample of this cycle, at rest mid travel.
+static output_wrapper output(uint8_t mode)
+{
+    output_wrapper out;
+
+    memset(&out, 0, sizeof(out));
+    out.state = run;
+    out.input_time_us = NOW_US;
+    out.actual_position_inc = (TRAVEL_LOW + TRAVEL_HIGH) / 2;
+    out.target_motor_paras.control_mode = mode;
+    out.target_motor_paras.desired_position_inc = out.actual_position_inc;
+    return out;
+}
+
+// Limit switches unknown, a PC frame just in, and the ramps back at rest: the supervisor ramps
+// from rest after a mode change, so one position cycle in between resets them.
+static void setup(void)
+{
+    output_wrapper out = output(DRIVE_MODE_POSITION);
+
+    motor_ls_position = 0;
+    far_ls_position = 0;
+    host_time_us = NOW_US;
+    safety_pc_frame();
+    safety_apply(&out, NOW_US);
+}
+
+static uint16_t apply(output_wrapper *out)
+{
+    return safety_apply(out, NOW_US);
+}
+
+static void test_current(void)
+{
+    output_wrapper out = output(DRIVE_MODE_TORQUE);
+
+    setup();
+    out.target_motor_paras.desired_torque = SAFETY_MAX_CURRENT;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_CURRENT_SLEW));
+    for (int i = 0; i < SAFETY_MAX_CURRENT / CURRENT_STEP; i++)
+    {
+        out = output(DRIVE_MODE_TORQUE);
+        out.target_motor_paras.desired_torque = SAFETY_MAX_CURRENT;
+        apply(&out);
+    }
+
+    out = output(DRIVE_MODE_TORQUE);
+    out.target_motor_paras.desired_torque = SAFETY_MAX_CURRENT + 1000;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_CURRENT));
+    CHECK_EQ(out.target_motor_paras.desired_torque, SAFETY_MAX_CURRENT);
+
+    // RPDO2 carries the current in speed mode too.
+    out = output(DRIVE_MODE_SPEED);
+    out.target_motor_paras.desired_torque = -SAFETY_MAX_CURRENT - 1000;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_CURRENT));
+    CHECK_EQ(out.target_motor_paras.desired_torque, -SAFETY_MAX_CURRENT);
+}
+
+static void test_current_slew(void)
+{
+    output_wrapper out = output(DRIVE_MODE_TORQUE);
+
+    setup();
+    out.target_motor_paras.desired_torque = CURRENT_STEP + 50;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_CURRENT_SLEW));
+    CHECK_EQ(out.target_motor_paras.desired_torque, CURRENT_STEP);
+
+    out = output(DRIVE_MODE_TORQUE);
+    out.target_motor_paras.desired_torque = CURRENT_STEP + 50;
+    CHECK_EQ(apply(&out), 0);
+    CHECK_EQ(out.target_motor_paras.desired_torque, CURRENT_STEP + 50);
+
+    // A sign change ramps from zero; a drop towards zero is never limited.
+    out = output(DRIVE_MODE_TORQUE);
+    out.target_motor_paras.desired_torque = -(CURRENT_STEP + 50);
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_CURRENT_SLEW));
+    CHECK_EQ(out.target_motor_paras.desired_torque, -CURRENT_STEP);
+
+    out = output(DRIVE_MODE_TORQUE);
+    CHECK_EQ(apply(&out), 0);
+    CHECK_EQ(out.target_motor_paras.desired_torque, 0);
+}
+
+static void test_speed(void)
+{
+    output_wrapper out = output(DRIVE_MODE_SPEED);
+
+    // Clamped in speed mode, from a drive already close to the limit so the slew does not bite.
+    setup();
+    out.actual_speed_inc = SAFETY_MAX_SPEED - SPEED_STEP / 2;
+    out.target_motor_paras.desired_speed_inc = SAFETY_MAX_SPEED + 100000;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_SPEED));
+    CHECK_EQ(out.target_motor_paras.desired_speed_inc, SAFETY_MAX_SPEED);
+
+    // In torque mode a current that accelerates beyond the limit is cut, a braking one is not.
+    setup();
+    out = output(DRIVE_MODE_TORQUE);
+    out.actual_speed_inc = SAFETY_MAX_SPEED + 1000;
+    out.target_motor_paras.desired_torque = 100;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_SPEED));
+    CHECK_EQ(out.target_motor_paras.desired_torque, 0);
+
+    out = output(DRIVE_MODE_TORQUE);
+    out.actual_speed_inc = SAFETY_MAX_SPEED + 1000;
+    out.target_motor_paras.desired_torque = -100;
+    CHECK_EQ(apply(&out), 0);
+    CHECK_EQ(out.target_motor_paras.desired_torque, -100);
+}
+
+static void test_speed_slew(void)
+{
+    output_wrapper out = output(DRIVE_MODE_SPEED);
+
+    setup();
+    out.target_motor_paras.desired_speed_inc = -(SPEED_STEP * 2);
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_SPEED_SLEW));
+    CHECK_EQ(out.target_motor_paras.desired_speed_inc, -SPEED_STEP);
+
+    out = output(DRIVE_MODE_SPEED);
+    out.target_motor_paras.desired_speed_inc = -(SPEED_STEP * 2);
+    CHECK_EQ(apply(&out), 0);
+    CHECK_EQ(out.target_motor_paras.desired_speed_inc, -(SPEED_STEP * 2));
+}
+
+static void test_position(void)
+{
+    output_wrapper out = output(DRIVE_MODE_POSITION);
+
+    // Without the limit switch positions the travel is unknown and nothing is clamped.
+    setup();
+    out.target_motor_paras.desired_position_inc = TRAVEL_HIGH * 2;
+    CHECK_EQ(apply(&out), 0);
+    CHECK_EQ(out.target_motor_paras.desired_position_inc, TRAVEL_HIGH * 2);
+
+    // Once both are learned a target is kept between them.
+    setup();
+    motor_ls_position = TRAVEL_HIGH;
+    far_ls_position = TRAVEL_LOW;
+    out = output(DRIVE_MODE_POSITION);
+    out.target_motor_paras.desired_position_inc = TRAVEL_HIGH * 2;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_POSITION));
+    CHECK_EQ(out.target_motor_paras.desired_position_inc, TRAVEL_HIGH);
+
+    out = output(DRIVE_MODE_POSITION);
+    out.target_motor_paras.desired_position_inc = -TRAVEL_HIGH;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_POSITION));
+    CHECK_EQ(out.target_motor_paras.desired_position_inc, TRAVEL_LOW);
+}
+
+static void test_power(void)
+{
+    int32_t speed = 500 * DRIVE_SPEED_PER_MM_S;
+    int32_t limit = (int32_t)((int64_t)SAFETY_MAX_POWER * DRIVE_SPEED_PER_MM_S / speed);
+    output_wrapper out = output(DRIVE_MODE_TORQUE);
+
+    _Static_assert((int64_t)SAFETY_MAX_POWER / 500 < SAFETY_MAX_CURRENT, "500 mm/s must be power limited");
+
+    // Ramp up to just below the limit first, so only the power limit applies.
+    setup();
+    out.actual_speed_inc = speed;
+    out.target_motor_paras.desired_torque = limit - 50;
+    CHECK_EQ(apply(&out), 0);
+
+    out = output(DRIVE_MODE_TORQUE);
+    out.actual_speed_inc = speed;
+    out.target_motor_paras.desired_torque = SAFETY_MAX_CURRENT;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_POWER));
+    CHECK_EQ(out.target_motor_paras.desired_torque, limit);
+
+    // Braking takes energy out and is not power limited.
+    out = output(DRIVE_MODE_TORQUE);
+    out.actual_speed_inc = -speed;
+    out.target_motor_paras.desired_torque = limit;
+    CHECK_EQ(apply(&out), 0);
+    CHECK_EQ(out.target_motor_paras.desired_torque, limit);
+}
+
+static void test_travel(void)
+{
+    output_wrapper out = output(DRIVE_MODE_TORQUE);
+
+    // Below the lower limit switch: a current pushing further out is cut, one back in passes.
+    setup();
+    motor_ls_position = TRAVEL_LOW;
+    far_ls_position = TRAVEL_HIGH;
+    out.actual_position_inc = TRAVEL_LOW - 500;
+    out.target_motor_paras.desired_torque = -50;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_TRAVEL));
+    CHECK_EQ(out.target_motor_paras.desired_torque, 0);
+
+    out = output(DRIVE_MODE_TORQUE);
+    out.actual_position_inc = TRAVEL_LOW - 500;
+    out.target_motor_paras.desired_torque = 50;
+    CHECK_EQ(apply(&out), 0);
+    CHECK_EQ(out.target_motor_paras.desired_torque, 50);
+
+    // Past the upper one in speed mode.
+    out = output(DRIVE_MODE_SPEED);
+    out.actual_position_inc = TRAVEL_HIGH + 500;
+    out.target_motor_paras.desired_speed_inc = 1000;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_TRAVEL));
+    CHECK_EQ(out.target_motor_paras.desired_speed_inc, 0);
+
+    // Outside run the travel is not enforced.
+    out = output(DRIVE_MODE_TORQUE);
+    out.state = enabled;
+    out.actual_position_inc = TRAVEL_LOW - 500;
+    out.target_motor_paras.desired_torque = -50;
+    CHECK_EQ(apply(&out), 0);
+    CHECK_EQ(out.target_motor_paras.desired_torque, -50);
+}
+
+static void test_mode(void)
+{
+    output_wrapper out = output(2);
+
+    setup();
+    out.target_motor_paras.desired_torque = 100;
+    out.target_motor_paras.desired_speed_inc = 1000;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_MODE));
+    CHECK_EQ(out.target_motor_paras.control_mode, DRIVE_MODE_TORQUE);
+    CHECK_EQ(out.target_motor_paras.desired_torque, 0);
+    CHECK_EQ(out.target_motor_paras.desired_speed_inc, 0);
+}
+
+static void test_pc_stale(void)
+{
+    int64_t late = NOW_US + (SAFETY_PC_TIMEOUT_MS + 1) * 1000LL;
+    output_wrapper out = output(DRIVE_MODE_SPEED);
+
+    setup();
+    out.input_time_us = late;
+    out.target_motor_paras.desired_speed_inc = 1000;
+    CHECK_EQ(safety_apply(&out, late), BIT(SAFETY_CAUSE_PC_STALE));
+    CHECK_EQ(out.target_motor_paras.control_mode, DRIVE_MODE_TORQUE);
+    CHECK_EQ(out.target_motor_paras.desired_torque, 0);
+    CHECK_EQ(out.target_motor_paras.desired_speed_inc, 0);
+
+    // Not with the heartbeat fallback in charge, nor outside run.
+    out = output(DRIVE_MODE_TORQUE);
+    out.input_time_us = late;
+    out.fallback = 1;
+    out.target_motor_paras.desired_torque = 100;
+    CHECK_EQ(safety_apply(&out, late), 0);
+    CHECK_EQ(out.target_motor_paras.desired_torque, 100);
+
+    out = output(DRIVE_MODE_TORQUE);
+    out.input_time_us = late;
+    out.state = enabled;
+    out.target_motor_paras.desired_torque = 100;
+    CHECK_EQ(safety_apply(&out, late), 0);
+    CHECK_EQ(out.target_motor_paras.desired_torque, 100);
+}
+
+static void test_drive_stale(void)
+{
+    output_wrapper out = output(DRIVE_MODE_POSITION);
+
+    setup();
+    out.input_time_us = NOW_US - (SAFETY_DRIVE_TIMEOUT_MS + 1) * 1000LL;
+    out.target_motor_paras.desired_position_inc += 1000;
+    CHECK_EQ(apply(&out), BIT(SAFETY_CAUSE_DRIVE_STALE));
+    CHECK_EQ(out.target_motor_paras.control_mode, DRIVE_MODE_TORQUE);
+    CHECK_EQ(out.target_motor_paras.desired_torque, 0);
+
+    out = output(DRIVE_MODE_TORQUE);
+    out.input_time_us = NOW_US - SAFETY_DRIVE_TIMEOUT_MS * 1000LL;
+    out.target_motor_paras.desired_torque = 100;
+    CHECK_EQ(apply(&out), 0);
+    CHECK_EQ(out.target_motor_paras.desired_torque, 100);
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} safety_test_t;
+
+static const safety_test_t tests[SAFETY_CAUSES] = {
+    [SAFETY_CAUSE_CURRENT]      = {"current",      test_current},
+    [SAFETY_CAUSE_CURRENT_SLEW] = {"current_slew", test_current_slew},
+    [SAFETY_CAUSE_SPEED]        = {"speed",        test_speed},
+    [SAFETY_CAUSE_SPEED_SLEW]   = {"speed_slew",   test_speed_slew},
+    [SAFETY_CAUSE_POSITION]     = {"position",     test_position},
+    [SAFETY_CAUSE_POWER]        = {"power",        test_power},
+    [SAFETY_CAUSE_TRAVEL]       = {"travel",       test_travel},
+    [SAFETY_CAUSE_MODE]         = {"mode",         test_mode},
+    [SAFETY_CAUSE_PC_STALE]     = {"pc_stale",     test_pc_stale},
+    [SAFETY_CAUSE_DRIVE_STALE]  = {"drive_stale",  test_drive_stale},
+};
+
+int main(void)
+{
+    int failed = 0;
+
+    for (int i = 0; i < SAFETY_CAUSES; i++)
+    {
+        int before = failures;
+
+        tests[i].run();
+        printf("%-14s %s\n", tests[i].name, (failures == before) ? "ok" : "FAILED");
+        failed += (failures != before);
+    }
+    printf("%d of %d failed\n", failed, SAFETY_CAUSES);
+    return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+/*
+ * idf_host.h
+ *
+ * Just enough of ESP-IDF and FreeRTOS to compile the control path on the
+ * host. Every IDF header the firmware includes is generated by CMake as a
+ * one line forward to this file. Drivers are stubs: CAN and UART writes are
+ * dropped, queues accept everything, GPIO levels and the time are set by
+ * the benchmark fixture.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* esp_err.h */
+typedef int esp_err_t;
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_INVALID_SIZE    0x104
+#define ESP_ERR_NOT_FOUND       0x105
+#define ESP_ERR_TIMEOUT         0x107
+#define ESP_ERR_NVS_BASE        0x1100
+#define ESP_ERR_NVS_NOT_FOUND   (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERROR_CHECK(x)      do { esp_err_t err_rc_ = (x); (void)err_rc_; } while (0)
+const char *esp_err_to_name(esp_err_t code);
+
+/* esp_log.h: compiled out, as with the log level set to none. */
+typedef enum { ESP_LOG_NONE, ESP_LOG_ERROR, ESP_LOG_WARN, ESP_LOG_INFO, ESP_LOG_DEBUG, ESP_LOG_VERBOSE } esp_log_level_t;
+#define ESP_LOGE(tag, ...)      ((void)(tag))
+#define ESP_LOGW(tag, ...)      ((void)(tag))
+#define ESP_LOGI(tag, ...)      ((void)(tag))
+#define ESP_LOGD(tag, ...)      ((void)(tag))
+#define ESP_LOGV(tag, ...)      ((void)(tag))
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buf, len, level) ((void)(tag))
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+
+/* FreeRTOS */
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t EventBits_t;
+typedef void *QueueHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef void *EventGroupHandle_t;
+typedef void *TaskHandle_t;
+typedef int portMUX_TYPE;
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS      (1000 / CONFIG_FREERTOS_HZ)
+#define portTICK_RATE_MS        portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms) * CONFIG_FREERTOS_HZ / 1000)
+#define configMAX_PRIORITIES    25
+#define portNUM_PROCESSORS      2
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux)  ((void)(mux))
+#define BIT0                    0x00000001
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+/* esp_timer.h */
+int64_t esp_timer_get_time(void);
+
+/* driver/gpio.h */
+typedef int gpio_num_t;
+#define GPIO_NUM_3              3
+#define GPIO_NUM_8              8
+#define GPIO_NUM_13             13
+#define GPIO_NUM_21             21
+#define GPIO_NUM_35             35
+#define GPIO_NUM_36             36
+#define GPIO_NUM_46             46
+#define GPIO_NUM_MAX            49
+int gpio_get_level(gpio_num_t gpio_num);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+
+/* driver/uart.h */
+typedef int uart_port_t;
+#define UART_NUM_1              1
+#define UART_NUM_2              2
+#define UART_PIN_NO_CHANGE      (-1)
+typedef enum { UART_DATA_8_BITS = 3 } uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE = 0 } uart_parity_t;
+typedef enum { UART_STOP_BITS_1 = 1 } uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE = 0 } uart_hw_flowcontrol_t;
+typedef enum { UART_SCLK_APB = 0 } uart_sclk_t;
+typedef struct {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+    uart_sclk_t source_clk;
+} uart_config_t;
+typedef enum { UART_DATA, UART_BREAK, UART_BUFFER_FULL, UART_FIFO_OVF, UART_FRAME_ERR, UART_PARITY_ERR } uart_event_type_t;
+typedef struct {
+    uart_event_type_t type;
+    size_t size;
+    bool timeout_flag;
+} uart_event_t;
+esp_err_t uart_driver_install(uart_port_t port, int rx_size, int tx_size, int queue_size, QueueHandle_t *queue, int flags);
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config);
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+esp_err_t uart_set_rx_full_threshold(uart_port_t port, int threshold);
+esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t symbols);
+esp_err_t uart_get_baudrate(uart_port_t port, uint32_t *baudrate);
+esp_err_t uart_flush_input(uart_port_t port);
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t wait);
+int uart_write_bytes(uart_port_t port, const void *src, size_t size);
+
+/* driver/twai.h */
+typedef struct {
+    union {
+        struct {
+            uint32_t extd: 1;
+            uint32_t rtr: 1;
+            uint32_t ss: 1;
+            uint32_t self: 1;
+            uint32_t dlc_non_comp: 1;
+            uint32_t reserved: 27;
+        };
+        uint32_t flags;
+    };
+    uint32_t identifier;
+    uint8_t data_length_code;
+    uint8_t data[8];
+} twai_message_t;
+typedef struct { uint32_t brp; } twai_timing_config_t;
+typedef struct { uint32_t acceptance_code; uint32_t acceptance_mask; bool single_filter; } twai_filter_config_t;
+typedef struct { int mode; int tx_io; int rx_io; } twai_general_config_t;
+#define TWAI_MODE_NORMAL                0
+#define TWAI_TIMING_CONFIG_250KBITS()   {.brp = 16}
+#define TWAI_TIMING_CONFIG_500KBITS()   {.brp = 8}
+#define TWAI_TIMING_CONFIG_1MBITS()     {.brp = 4}
+#define TWAI_FILTER_CONFIG_ACCEPT_ALL() {.acceptance_code = 0, .acceptance_mask = 0xFFFFFFFF, .single_filter = true}
+#define TWAI_GENERAL_CONFIG_DEFAULT(tx, rx, op_mode) {.mode = (op_mode), .tx_io = (tx), .rx_io = (rx)}
+esp_err_t twai_transmit(const twai_message_t *message, TickType_t wait);
+
+/* nvs.h */
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle);
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *value);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+esp_err_t nvs_commit(nvs_handle_t handle);
+void nvs_close(nvs_handle_t handle);
+
+/* Host side controls, set by the benchmark fixture. */
+extern int64_t host_time_us;
+extern int host_gpio_levels[GPIO_NUM_MAX];
+extern uint32_t host_queue_sends;
+extern int host_deadline_level;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,29 @@
+/*
+ * sdkconfig.h
+ *
+ * Host build configuration: the Kconfig defaults of the options the
+ * benchmarked sources use. Keep in sync with main/Kconfig.projbuild.
+ */
+
+#pragma once
+
+#define CONFIG_FREERTOS_HZ                      100
+#define CONFIG_TINYUSB_CDC_RX_BUFSIZE           64
+
+#define CONFIG_TR_PC_LINK_BAUD_RATE             115200
+#define CONFIG_TR_PC_LINK_RX_TIMEOUT_SYMBOLS    2
+#define CONFIG_TR_CONTROL_RATE_HZ               250
+#define CONFIG_TR_CAN_BITRATE                   250000
+#define CONFIG_TR_DEADLINE_ESCALATE_MISSES      8
+#define CONFIG_TR_DEADLINE_RECOVER_CYCLES       1000
+#define CONFIG_TR_DEADLINE_MAX_LEVEL            3
+#define CONFIG_TR_WIFI_PROVISIONING             1
+#define CONFIG_TR_SAFETY_SUPERVISOR             1
+#define CONFIG_TR_SAFETY_MAX_CURRENT            600
+#define CONFIG_TR_SAFETY_CURRENT_SLEW           100
+#define CONFIG_TR_SAFETY_MAX_SPEED              8192000
+#define CONFIG_TR_SAFETY_SPEED_SLEW             409600
+#define CONFIG_TR_SAFETY_POSITION_STEP          0
+#define CONFIG_TR_SAFETY_MAX_POWER              150000
+#define CONFIG_TR_SAFETY_PC_TIMEOUT_MS          200
+#define CONFIG_TR_SAFETY_DRIVE_TIMEOUT_MS       12
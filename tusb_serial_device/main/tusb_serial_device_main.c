@@ -32,6 +32,24 @@
 #include "driver/twai.h"
 #include "esp_check.h"
 #include "can_open_comm.h"
+#include "pc_link.h"
+#include "rs485_bus.h"
+#include "load_cell.h"
+#include "load_cell_cal.h"
+#include "diagnostics.h"
+#include "trace.h"
+#include "deadline_monitor.h"
+#include "heap_guard.h"
+#include "rtos_objects.h"
+#include "boot_profile.h"
+#include "startup.h"
+#include "power_mgmt.h"
+#include "pc_command.h"
+#include "recorder.h"
+#include "safety.h"
+#include "heartbeat.h"
+#include "drive_pdo.h"
+#include "setpoint_fifo.h"
 #include "tinyusb.h"
 #include "tusb_cdc_acm.h"
 #include "sdkconfig.h"
@@ -53,18 +71,10 @@
 // static const char *TAG1 = "UDP_SendTo_PC";
 // static const char *payload = "Message from ESP32 ";
 
-static const int RX_BUF_SIZE = 512;
-
 // static const int UART_MSG_length = 34;
 
-// New board pcb pin 18 for TX, pin 17 for RX.   UART1 for Fpga
-#define TXD_PIN (GPIO_NUM_18)
-#define RXD_PIN (GPIO_NUM_17)
-#define MB_UART_RTS (GPIO_NUM_16)
-
-// Uart 2 for PC
-#define PC_TXD_PIN (GPIO_NUM_36)
-#define PC_RXD_PIN (GPIO_NUM_35)
+// UART1 for the 485 load cell, pins are defined in load_cell.h
+// Uart 2 for PC: pins are defined in pc_link.h
 // #define HANDLE_SW_PIN (GPIO_NUM_12)
 // #define RETURN_SW_PIN (GPIO_NUM_10)
 // #define ESTOP_PIN (GPIO_NUM_21)
@@ -74,10 +84,6 @@ static const int RX_BUF_SIZE = 512;
 #define GPIO_OUTPUT_IO_1 (GPIO_NUM_13)
 #define GPIO_OUTPUT_PIN_SEL ((1ULL << GPIO_OUTPUT_IO_0) | (1ULL << GPIO_OUTPUT_IO_1))
 
-static SemaphoreHandle_t test_sem;
-
-static SemaphoreHandle_t send_485_sem;
-
 // bool uart_message_received= false;
 
 // 初始化串口通信。
@@ -118,46 +124,12 @@ static SemaphoreHandle_t send_485_sem;
 void init(void)
 {
 
-    // UART 1 was used to communicate with FPGA, now used for 485 with load cell.
-    const uart_config_t uart_config = {
-        .baud_rate = 115200,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-        // .flow_ctrl = UART_HW_FLOWCTRL_CTS_RTS,
-        // .rx_flow_ctrl_thresh = 120,
-        .source_clk = UART_SCLK_APB,
-    };
-    // We won't use a buffer for sending data.
-    uart_driver_install(UART_NUM_1, RX_BUF_SIZE * 2, 0, 0, NULL, 0);
-    uart_param_config(UART_NUM_1, &uart_config);
-    uart_set_pin(UART_NUM_1, TXD_PIN, RXD_PIN, MB_UART_RTS, UART_PIN_NO_CHANGE);
-
-    // Echo suppression is performed by the UART peripheral when the bit UART_RS485_CONF_REG.UART_RS485TX_RX_EN is enabled.
-    REG_SET_BIT(0x3FF50044, 3);
-    // For 485 communication:
-
-    // Set UART driver mode to Half Duplex
-    ESP_ERROR_CHECK(uart_set_mode(UART_NUM_1, UART_MODE_RS485_HALF_DUPLEX));
-    // printf("初始化成功");
-
-    // Uart 2 is used to comm with PC.
-    const uart_config_t uart_config_2 = {
-        .baud_rate = 115200,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-        // .flow_ctrl = UART_HW_FLOWCTRL_CTS_RTS,
-        // .rx_flow_ctrl_thresh = 120,
-        .source_clk = UART_SCLK_APB,
-    };
+    // UART 1 was used to communicate with FPGA, now the RS485 sensor bus. Slaves register before the bus task starts.
+    ESP_ERROR_CHECK(rs485_bus_init(RS485_BAUD_RATE));
+    ESP_ERROR_CHECK(load_cell_init());
 
-    // For PC: pin35 for TX pin 36 for RX
-    uart_driver_install(UART_NUM_2, RX_BUF_SIZE * 2, 0, 0, NULL, 0);
-    uart_param_config(UART_NUM_2, &uart_config_2);
-    uart_set_pin(UART_NUM_2, PC_TXD_PIN, PC_RXD_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    // Uart 2 is used to comm with PC. Event driven RX and a TX ring buffer, see pc_link.c
+    ESP_ERROR_CHECK(pc_link_init(PC_LINK_BAUD_RATE));
 
     // 定义to pc 数组的帧头帧尾
     outputs.to_pc[0] = 0x2A;
@@ -165,136 +137,8 @@ void init(void)
     estop_pressed = 0;
 }
 
-//
-int sendData(const char *logName, const char *data)
-{
-
-    // gpio_set_level(GPIO_OUTPUT_IO_0, 1);
-    // const int len = strlen(data);
-
-    const int txBytes = uart_write_bytes(UART_NUM_1, data, 12);
-    // ESP_LOGI(logName, "Wrote %d bytes", txBytes);
-
-    // gpio_set_level(GPIO_OUTPUT_IO_0, 0);
-    return txBytes;
-}
-
-// TX task for Uart 1 (485)
-// After boot up send 485 once.
-static void tx_task(void *arg)
-{
-    uint8_t Tx_buf[12] = {0xFE, 0x1, 0x7, 0x0, 0x1, 0x2, 0x0, 0x1, 0xCF, 0xFC, 0xCC, 0xFF};
-    static const char *TX_TASK_TAG = "TX_TASK";
-    esp_log_level_set(TX_TASK_TAG, ESP_LOG_INFO);
-    int txBytes = 0;
-
-    queue_msg uart_tx_struct;
-    while (1)
-    {
-        // if( xQueueReceive( uart_tx_queue, &uart_tx_struct,( TickType_t ) 10 ) == pdPASS )
-        // {
-        //     // if(uart_tx_struct.q_sender == process)
-        //     // {
-        //         memcpy(Tx_buf, uart_tx_struct.msg_array, 14);
-
-        //         txBytes = uart_write_bytes(UART_NUM_1, Tx_buf, 14);
-        //     // }
-        // }
-        vTaskDelay(1000 / portTICK_PERIOD_MS); // Delay for 1000ms.
-
-        sendData(TX_TASK_TAG, &Tx_buf);
-
-        // const int txBytes = uart_write_bytes(UART_NUM_1, Tx_buf, 12);
-        // vTaskDelay(1000/ portTICK_PERIOD_MS);
-
-        // uart_write_bytes(UART_NUM_1, Tx_buf, 14);
-        xSemaphoreTake(send_485_sem, portMAX_DELAY);
-
-        // printf("485 tx done \n");
-    }
-}
-
-/**
- * @brief 接受传感器的485 信号，处理后以队列的形式发送给上位机。
- * 如果一段时间内没有收到上位机的程序则give 485_sem 让
- *
- *
- */
-static void rx_task(void *arg)
-{
-    // uint8_t effective_message[34] = {};
-    // uint8_t working_message[34] = {};
-    // uint8_t tx_buffer[34]={};
-    // //bool Udp_Tx=false;
-
-    static const char *RX_TASK_TAG = "RX_TASK";
-    esp_log_level_set(RX_TASK_TAG, ESP_LOG_INFO);
-    uint8_t *data = (uint8_t *)malloc(64 + 1);
-    // // uint8_t* data = (uint8_t*) malloc(RX_BUF_SIZE+1);
-    // static const int UART_MSG_length = 34;
-
-    // uint8_t* effective_message = (uint8_t*) malloc(UART_MSG_length +1);
-    // uint8_t* working_message = (uint8_t*) malloc(UART_MSG_length +1);
-
-    int count = 0;
-
-    queue_msg msg_to_send;
-    // msg_to_send.q_sender = robot;
-    msg_to_send.sender_int = 0;
-    bool tag = false;
-    // udp_send_msg udp_to_send;
-
-    // struct robot_info the_message ;
-    // the_message.speed = 0;
-    // the_message.position =2;
-    // the_message.current =1 ;
-
-    // RingbufHandle_t buf_handle;
-    // buf_handle = xRingbufferCreate(1028, RINGBUF_TYPE_NOSPLIT);
-
-    bytes_int_conv int_conv;
-    queue_msg queue_to_send;
-    while (1)
-    {
-        // gpio_set_level(GPIO_OUTPUT_IO_1, 1);
-        const int rxBytes = uart_read_bytes(UART_NUM_1, data, 14, 2000 / portTICK_RATE_MS); //
-
-        if (rxBytes == -1)
-        {
-            // Receive Timed Out.
-            ESP_LOGE(RX_TASK_TAG, "NO 485");
-            xSemaphoreGive(send_485_sem);
-        }
-        else
-        {
-            // ESP_LOGI(RX_TASK_TAG, "485 received");
-            // ESP_LOG_BUFFER_HEXDUMP(RX_TASK_TAG , data, 12, ESP_LOG_INFO);
-            if ((data[0] == 0xFE && data[1] == 1) && data[2] == 0x50)
-            {
-                int_conv.input[3] = data[4];
-                int_conv.input[2] = data[5];
-                int_conv.input[1] = data[6];
-                int_conv.input[0] = data[7];
-
-                // ESP_LOGI(RX_TASK_TAG, "485");
-                // Torque sensor value is
-                queue_to_send.lc_value = int_conv.value;
-                queue_to_send.sender_int = 3; // 3 for LC
-
-                xQueueSend(uart_queue, (void *)&queue_to_send, portMAX_DELAY);
-            }
-            {
-                // ESP_LOGI(RX_TASK_TAG, "485 format wrong");
-            }
-        }
-    }
-    // free(data);
-    // free(effective_message);
-    // free(working_message);
-}
-
 // 处理电脑和机器人发来的数组信息。
-static void uart_process_task(void *arg)
+void uart_process_task(void *arg)
 {
     static const char *TASK_TAG = "ProcessTag";
     int rxBytes = 34;
@@ -318,6 +162,7 @@ static void uart_process_task(void *arg)
     bool compensation_flag = false;
     int remaining_bytes = rxBytes;
     int count = 0;
+    uint32_t telemetry_count = 0;
     // int Temp_F=0;
 
     // static const int UART_MSG_length = 34;
@@ -355,12 +200,37 @@ static void uart_process_task(void *arg)
                 // printf("received_struct.sender_int == 0  ");
                 memcpy(&inputs.motor_data, &received_struct.motor_status, sizeof(motor_status_t));
 
+                // Force at the same instant as the motor data, not whenever the last LC sample came in.
+                lc_aligned_force_t aligned_force;
+                load_cell_force_at(inputs.motor_data.sample_time_us, &aligned_force);
+                inputs.inter_force_inc = aligned_force.value;
+                inputs.inter_force_age_us = aligned_force.age_us;
+                inputs.inter_force_confidence = aligned_force.confidence;
+
                 // ESP_LOG_BUFFER_HEXDUMP(TASK_TAG, &received_struct.motor_status.position_inc, 4, ESP_LOG_INFO);
 
+                // A setpoint stream from the PC replaces the setpoint of the last command frame.
+                setpoint_fifo_apply(cur_state, inputs.pc_msg, esp_timer_get_time());
+
                 // printf("开始执行fsm");
                 main_fsm_function();
+                boot_profile_mark(BOOT_MARK_FIRST_CYCLE);
+                power_mgmt_update(cur_state);
+                // A frozen PC leaves its last command in inputs.pc_msg: a local controller takes over.
+                outputs.fallback = heartbeat_update(cur_state, esp_timer_get_time());
+
+                if (deadline_level() == DEADLINE_LEVEL_SAFE)
+                {
+                    // Cycles keep overrunning: hold the motor at zero torque until reset from the PC.
+                    set_control_mode(PC_MODE_CURRENT);
+                    setCurrent(0);
+                }
 
-                if (gap < 5000000 && gap > -5000000)
+                // Degraded: keep the cycle time by sending only a few of the frames to the PC.
+                bool send_telemetry = deadline_level() < DEADLINE_LEVEL_NO_TELEMETRY ||
+                                      (telemetry_count++ % DEADLINE_TELEMETRY_DECIMATION) == 0;
+
+                if (gap < 5000000 && gap > -5000000 && send_telemetry)
 
                 {
                     memcpy(udp_to_send_struct.udp_send_array, outputs.to_pc, sizeof(outputs.to_pc));
@@ -378,8 +248,14 @@ static void uart_process_task(void *arg)
                 // Todo: here replace the TX message with RPDO calls.
                 // memcpy(tx_msg.msg_array, outputs.to_robot, 14);
                 // Send the CAN info to RPDO queue.
+                outputs.input_time_us = inputs.motor_data.sample_time_us;
+                outputs.state = cur_state;
+                outputs.actual_position_inc = received_struct.motor_status.position_inc;
+                // The FSM's averaged speed without the glitches, back in the drive's sign.
+                outputs.actual_speed_inc = -inputs.motor_data.speed_inc;
                 if (xQueueSend(can_send_queue, (void *)&outputs, 1000 / portTICK_RATE_MS) == pdPASS)
                 {
+                    TRACE_EVENT(TRACE_EV_RPDO_QUEUED, outputs.target_motor_paras.control_mode);
                 }
                 else
                     ESP_LOGE(TASK_TAG, "RPDO Q send failed");
@@ -389,6 +265,9 @@ static void uart_process_task(void *arg)
             {
                 if (received_struct.udp_recv_array[0] == 0xAB && received_struct.udp_recv_array[1] == 0xAB)
                 {
+                    power_mgmt_pc_frame();
+                    safety_pc_frame();
+                    heartbeat_pc_frame(esp_timer_get_time());
                     // memcpy(recv_udp_msg, received_struct.udp_recv_array, 14);
                     memcpy(inputs.pc_msg, received_struct.udp_recv_array, 14);
                     //
@@ -403,17 +282,11 @@ static void uart_process_task(void *arg)
                     ESP_LOGI(TASK_TAG, "RTN event");
                 }
             }
-
-            else if (received_struct.sender_int == 3) // Get interforce reading from Queue
-            {
-                // ESP_LOGI(TASK_TAG, "LC data");
-                inputs.inter_force_inc = received_struct.lc_value;
-                // ESP_LOGI(TASK_TAG, "LC %d", inputs.inter_force_inc);
-            }
         }
         else // TODO: If Queue receive timed out, notifiy the PC for the possible reason: ESTOP or Driver ERRor or other error
         {
             ESP_LOGI(TASK_TAG, "No events received. ");
+            power_mgmt_update(cur_state);
         }
         //
     }
@@ -518,39 +391,62 @@ const char *RX_TASK_TAG = "PC_RX_TASK";
 //     unsigned char buf[MAX_MSG_SIZE];
 // } packet;
 
+// Service frames over USB, so session downloads do not have to fit the 1 Mbit/s UART.
+// Control frames still come over the PC link UART.
+static pc_frame_parser_t usb_parser;
+
+/**
+ * @brief Write to the USB CDC port, waiting for room in the TinyUSB TX
+ *        buffer. Replies from the TinyUSB task and session downloads from the
+ *        recorder task share the port, hence the mutex.
+ */
+static int usb_link_write(const uint8_t *data, size_t len)
+{
+    size_t sent = 0;
+
+    xSemaphoreTake(usb_tx_mutex, portMAX_DELAY);
+    while (sent < len)
+    {
+        size_t queued = tinyusb_cdcacm_write_queue(TINYUSB_CDC_ACM_0, data + sent, len - sent);
+        sent += queued;
+        // Buffer full: send it. The flush polls once per tick, which bounds a download at
+        // about CONFIG_TINYUSB_CDC_TX_BUFSIZE bytes per 10 ms.
+        if (queued == 0 && tinyusb_cdcacm_write_flush(TINYUSB_CDC_ACM_0, pdMS_TO_TICKS(100)) != ESP_OK)
+        {
+            break;
+        }
+    }
+    tinyusb_cdcacm_write_flush(TINYUSB_CDC_ACM_0, 0);
+    xSemaphoreGive(usb_tx_mutex);
+    return (int)sent;
+}
+
+static void usb_frame_handler(const uint8_t *frame, size_t len)
+{
+    if (frame[1] == PC_SERVICE_HEAD)
+    {
+        pc_command_dispatch(frame, usb_link_write);
+    }
+}
+
 // static void pc_rx_task(int itf, cdcacm_event_t *event)
+// Runs on every USB packet, so the buffer is static: the malloc that was here was never freed.
+// Only the TinyUSB task calls it.
 void pc_rx_task(int itf, cdcacm_event_t *event)
 {
-    uint8_t *buf = (uint8_t *)malloc(RX_BUF_SIZE + 1);
-    esp_log_level_set(RX_TASK_TAG, ESP_LOG_INFO);
+    static uint8_t buf[CONFIG_TINYUSB_CDC_RX_BUFSIZE];
 
-    //  int count = 0;
-    queue_msg pc_rx_to_recv;
-    // pc_rx_to_recv.q_sender = PC;
-    pc_rx_to_recv.sender_int = 1;
     size_t rx_size = 0;
   /* read */
-    esp_err_t ret = tinyusb_cdcacm_read(itf, buf, CONFIG_TINYUSB_CDC_RX_BUFSIZE, &rx_size);
+    esp_err_t ret = tinyusb_cdcacm_read(itf, buf, sizeof(buf), &rx_size);
     if (ret == ESP_OK)
     {
-        buf[rx_size] = '\0';
-        ESP_LOGI(TAG, "Got data (%d bytes): %s", rx_size, buf);
+        pc_frame_parser_feed(&usb_parser, buf, rx_size);
     }
     else
     {
         ESP_LOGE(TAG, "Read error11");
     }
-
-    // size_t rx_size = 0;
-    //     uint8_t* buf = (uint8_t*) malloc(RX_BUF_SIZE+1);
-    tinyusb_cdcacm_write_queue(itf, buf,34);
-    tinyusb_cdcacm_write_flush(itf, 0);
-
-   
-       
-    //  fflush(stdout);
-    // free(buf);
-    // vTaskDelete(NULL);
 }
 
 // static void pc_rx_task(void *arg)
@@ -667,11 +563,12 @@ void pc_rx_task(int itf, cdcacm_event_t *event)
 /*
  * This task is used to time the press the duration of the return key press.
  * If the duration of the return button press is greater than 5 seconds, trigger reset events.
- *
+ * Started with the Wi-Fi tasks at the lowest priority; the enabled state then requests provisioning.
  */
-static void rtn_button_timer_task(void *pvParameters)
+void rtn_button_timer_task(void *pvParameters)
 {
     int rtn_sw_status;
+    int rtn_button_press_seconds = 0;
     queue_msg msg_to_send;
     // msg_to_send.q_sender = robot;
 
@@ -701,6 +598,7 @@ static void rtn_button_timer_task(void *pvParameters)
         {
             // xEventGroupClearBits(key_press_event_group,  RTN_PRESS_EVENT_BIT);
 
+            rtn_button_press_seconds = 0; // Only a continuous press counts.
             msg_to_send.process_flag = 0;
         }
         xQueueSend(uart_queue, (void *)&msg_to_send, portMAX_DELAY);
@@ -714,7 +612,7 @@ static void rtn_button_timer_task(void *pvParameters)
  *
  *
  */
-static void canRPDOSendTask(void *pvParameters)
+void canRPDOSendTask(void *pvParameters)
 {
     output_wrapper output_info;
     uint8_t control_mode_pre = 0;
@@ -747,11 +645,14 @@ static void canRPDOSendTask(void *pvParameters)
     {
         if (xQueueReceive(can_send_queue, &output_info, portMAX_DELAY) == pdPASS)
         {
+            // Last stage before the bus: limits, ramps and stale inputs, see safety.h.
+            safety_apply(&output_info, esp_timer_get_time());
+
             // if((control_mode_pre != output_info.target_motor_paras.control_mode) ||
             //     output_info.target_motor_paras.control_mode ==1)
             // {
             rpdo1_arr[0] = output_info.target_motor_paras.control_mode;
-            op_mode = (output_info.target_motor_paras.control_mode == 1) ? 0x103F : 0xF;
+            op_mode = (output_info.target_motor_paras.control_mode == DRIVE_MODE_POSITION) ? 0x103F : 0xF;
             memcpy(&rpdo1_arr[1], &op_mode, sizeof(uint16_t));
 
             memcpy(&rpdo1_arr[3], &output_info.target_motor_paras.desired_position_inc, sizeof(int));
@@ -759,6 +660,7 @@ static void canRPDOSendTask(void *pvParameters)
             // ESP_LOG_BUFFER_HEXDUMP("RPDO1" , rpdo1_arr, 7, ESP_LOG_INFO);
 
             sendGenCan(0x200 + NODE_ID, 7, rpdo1_arr);
+            TRACE_EVENT(TRACE_EV_RPDO_SENT, 0x200 + NODE_ID);
             // }
 
             control_mode_pre = output_info.target_motor_paras.control_mode;
@@ -772,26 +674,42 @@ static void canRPDOSendTask(void *pvParameters)
                 // ESP_LOG_BUFFER_HEXDUMP("RPDO2" , rpdo2_arr, 7, ESP_LOG_INFO);
 
                 sendGenCan(0x300 + NODE_ID, 7, rpdo2_arr);
+                TRACE_EVENT(TRACE_EV_RPDO_SENT, 0x300 + NODE_ID);
 
                 // ESP_LOGI("RPDO","speed target id %d", output_info.target_motor_paras.desired_speed_inc);
             }
+
+            deadline_cycle_output(output_info.input_time_us, esp_timer_get_time());
         }
     }
 }
 
 /*
  * This function is used to implement the timed task for getting information Can info from the
- * driver at 4ms interval.
+ * driver at CONTROL_PERIOD_US interval.
  *
+ * The period comes from a periodic esp_timer: at the 100 Hz tick a vTaskDelay(4 ms) is 0 ticks,
+ * so the SYNC used to go out as fast as the task got the CPU. The deadline monitor may double the
+ * period when cycles overrun.
  */
-static void timed_task_(void *arg)
+static TaskHandle_t timed_task_handle;
+
+static void sync_timer_callback(void *arg)
+{
+    xTaskNotifyGive(timed_task_handle);
+}
+
+void timed_task_(void *arg)
 {
+    esp_timer_handle_t sync_timer;
+    const esp_timer_create_args_t sync_timer_args = {
+        .callback = sync_timer_callback,
+        .name = "sync",
+    };
 
-    TickType_t xLastWakeTime;
-    //  const TickType_t xFrequency = 1000/ portTICK_PERIOD_MS;
+    timed_task_handle = xTaskGetCurrentTaskHandle();
+    ESP_ERROR_CHECK(esp_timer_create(&sync_timer_args, &sync_timer));
 
-    // Initialise the xLastWakeTime variable with the current time.
-    xLastWakeTime = xTaskGetTickCount();
     while (1)
     {
         /* code */
@@ -799,18 +717,24 @@ static void timed_task_(void *arg)
         xSemaphoreTake(timer_start_sem, portMAX_DELAY); // Wait for motor init process to finish before starting the timer
         printf("Starting timer \n");
         uint8_t *temp = {0};
+        uint32_t period_us = deadline_sync_period_us();
+        ESP_ERROR_CHECK(esp_timer_start_periodic(sync_timer, period_us));
         for (;;)
         {
             // Wait for the next cycle.
-            // xSemaphoreGive(test_sem);
-            // xSemaphoreGive(send_485_sem);
-            // ESP_LOGI("TimerTAG", "Tick");
-
-            vTaskDelay(4 / portTICK_PERIOD_MS);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-            // vTaskDelay(500/ portTICK_PERIOD_MS );
             sendGenCan(0x80, 0, temp);
-            // Perform action here.
+            TRACE_EVENT(TRACE_EV_SYNC_SENT, 0);
+            deadline_cycle_start(esp_timer_get_time());
+
+            if (deadline_sync_period_us() != period_us)
+            {
+                period_us = deadline_sync_period_us();
+                esp_timer_stop(sync_timer);
+                ESP_ERROR_CHECK(esp_timer_start_periodic(sync_timer, period_us));
+                ESP_LOGW(TAG, "SYNC period %u us", period_us);
+            }
         }
     }
 }
@@ -872,7 +796,7 @@ static void timed_task_(void *arg)
  *
  *
  */
-static void driver_init_task(void *arg)
+void driver_init_task(void *arg)
 {
     // Received rx_
     twai_message_t rx_msg;
@@ -897,6 +821,12 @@ static void driver_init_task(void *arg)
         //******************************* Clear Error *****************************/
         sendSDO(1, 0x2B, 0x6040, 0, 0x80);
 
+        //******************************* PDO timing for the control rate *****************************/
+        if (!drive_pdo_configure(NODE_ID))
+        {
+            printf("Drive PDOs not set as intended \n"); // Runs on with what the drive has.
+        }
+
         /****************************** Set control mode ***********************/
         sendSDO(1, 0x23, 0x60FF, 0, 0x0); // Set target speed to 0
         sendSDO(1, 0x2F, 0x6060, 0, 0x3); // Set control mode to speed control.
@@ -921,6 +851,8 @@ static void driver_init_task(void *arg)
         if (motor_enabled_flag == true)
         {
             printf("Motor enable done");
+            boot_profile_mark(BOOT_MARK_MOTOR_ENABLED);
+            boot_profile_log();
             xSemaphoreGive(timer_start_sem);
             xSemaphoreGive(init_done_sem); // Let the main FSM proceed from powerup to enabled.
 
@@ -934,7 +866,7 @@ static void driver_init_task(void *arg)
 }
 
 // CAn rx thread.
-static void twai_receive_task(void *arg)
+void twai_receive_task(void *arg)
 {
     static twai_message_t rx_msg;
     static motor_status_t motor_status;
@@ -991,11 +923,53 @@ void tinyusb_cdc_line_state_changed_callback(int itf, cdcacm_event_t *event)
 //     ESP_LOGD(TAG, "De-initialized");
 //     return ESP_OK;
 // }
-void app_main(void)
+/*
+ * Startup steps, run by startup_run() on both cores. Each step waits only for the steps in its
+ * .after mask, so the drive bring-up starts as soon as TWAI is up and its SDO sequence overlaps
+ * the LED, USB and NVS steps. See the "Boot time" section of the README.
+ */
+enum {
+    STEP_TWAI,
+    STEP_DRIVE,
+    STEP_NVS,
+    STEP_USB,
+    STEP_LED,
+    STEP_PC_IO,
+    STEP_GPIO,
+    STEP_NETIF,
+    STEP_FSM,
+};
+
+static esp_err_t startup_twai(void)
+{
+    twai_general_config_t general_config = g_config;
+#ifdef CONFIG_TWAI_ISR_IN_IRAM
+    // Keep receiving while the flash cache is off.
+    general_config.intr_flags |= ESP_INTR_FLAG_IRAM;
+#endif
+    // Install TWAI driver
+    ESP_ERROR_CHECK(twai_driver_install(&general_config, &t_config, &f_config));
+    ESP_LOGI(EXAMPLE_TAG, "Driver installed");
+
+    //开始运行twai
+    esp_err_t err = twai_start();
+    if (err == ESP_OK)
+    {
+        printf("Driver started\n");
+    }
+    return err; // Todo: Further work needed. LED or error code.
+}
+
+// The SDO enable sequence needs the TWAI receive task for the SDO responses.
+static esp_err_t startup_drive(void)
 {
+    rtos_task_start(RTOS_TASK_twai_rx);
+    rtos_task_start(RTOS_TASK_driver_init);
+    return ESP_OK;
+}
 
-  
-   
+static esp_err_t startup_nvs(void)
+{
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
     {
@@ -1005,34 +979,52 @@ void app_main(void)
         err = nvs_flash_init();
     }
     ESP_ERROR_CHECK(err);
-    // ESP_ERROR_CHECK(nvs_flash_init());
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    return ESP_OK;
+}
 
-    // Install TWAI driver
-    ESP_ERROR_CHECK(twai_driver_install(&g_config, &t_config, &f_config));
-    ESP_LOGI(EXAMPLE_TAG, "Driver installed");
+static esp_err_t startup_usb(void)
+{
+    ESP_LOGI(TAG, "USB initialization");
+    pc_frame_parser_init(&usb_parser, usb_frame_handler);
+    tinyusb_config_t tusb_cfg = {}; // the configuration using default values
+    ESP_ERROR_CHECK(tinyusb_driver_install(&tusb_cfg));
 
-    //开始运行twai
-    if (twai_start() == ESP_OK)
-    {
-        printf("Driver started\n");
-    }
-    else
-    {
-        printf("Failed to start driver\n"); // Todo: Further work needed. LED or error code.
-        return;
-    }
+    tinyusb_config_cdcacm_t amc_cfg = {
+        .usb_dev = TINYUSB_USBDEV_0,
+        .cdc_port = TINYUSB_CDC_ACM_0,
+        .rx_unread_buf_sz = 128,
+        .callback_rx = &pc_rx_task, // the first way to register a callback
+        .callback_rx_wanted_char = NULL,
+        .callback_line_state_changed = NULL,
+        .callback_line_coding_changed = NULL};
 
-    // printf("系统开始执行…………………………………………………………");
-    key_press_event_group = xEventGroupCreate();
+    ESP_ERROR_CHECK(tusb_cdc_acm_init(&amc_cfg));
+    /* the second way to register a callback */
+    ESP_ERROR_CHECK(tinyusb_cdcacm_register_callback(
+        TINYUSB_CDC_ACM_0,
+        CDC_EVENT_LINE_STATE_CHANGED,
+        &tinyusb_cdc_line_state_changed_callback));
+    ESP_LOGI(TAG, "USB initialization DONE");
+    // Before the recorder task starts. No-op unless CONFIG_TR_RECORDER.
+    recorder_init(usb_link_write);
+    return ESP_OK;
+}
 
-    // wifi_init_sta();
-//   tinyusb_cdc_init(itf,*cfg);
-    init();     // For Uart
+// Blocks up to 100 ms in the strip clear.
+static esp_err_t startup_led(void)
+{
     led_init(); // For onboard LED.
-    // udp_client();
+    return ESP_OK;
+}
 
+static esp_err_t startup_pc_io(void)
+{
+    init(); // RS485 bus, load cell and PC link UARTs
+    return ESP_OK;
+}
+
+static esp_err_t startup_gpio(void)
+{
     // zero-initialize the config structure.
     gpio_config_t io_conf = {};
     // disable interrupt
@@ -1056,95 +1048,64 @@ void app_main(void)
         .pull_up_en = 1,                 // 上拉
     };
     gpio_config(&io_conf2);
+    return ESP_OK;
+}
 
-    ESP_LOGI(TAG, "USB initialization");
-    tinyusb_config_t tusb_cfg = {}; // the configuration using default values
-    ESP_ERROR_CHECK(tinyusb_driver_install(&tusb_cfg));
-
-    tinyusb_config_cdcacm_t amc_cfg = {
-        .usb_dev = TINYUSB_USBDEV_0,
-        .cdc_port = TINYUSB_CDC_ACM_0,
-        .rx_unread_buf_sz = 128,
-        .callback_rx = &pc_rx_task, // the first way to register a callback
-        .callback_rx_wanted_char = NULL,
-        .callback_line_state_changed = NULL,
-        .callback_line_coding_changed = NULL};
-
-    ESP_ERROR_CHECK(tusb_cdc_acm_init(&amc_cfg));
-    /* the second way to register a callback */
-    ESP_ERROR_CHECK(tinyusb_cdcacm_register_callback(
-        TINYUSB_CDC_ACM_0,
-        CDC_EVENT_LINE_STATE_CHANGED,
-        &tinyusb_cdc_line_state_changed_callback));
-    ESP_LOGI(TAG, "USB initialization DONE");
-
-    //创建队列queue
-    uart_queue = xQueueCreate(10, sizeof(queue_msg));
-    udp_send_queue = xQueueCreate(10, sizeof(udp_send_msg));
-    // uart_tx_queue = xQueueCreate(10, sizeof(queue_msg));
-    can_send_queue = xQueueCreate(10, sizeof(output_wrapper));
-    can_receive_queue = xQueueCreate(10, sizeof(twai_message_t));
-
-    motor_status_queue = xQueueCreate(10, sizeof(motor_status_t));
-
-    can_sdo_rx_queue = xQueueCreate(10, sizeof(sdo_msg_t));
-
-    test_sem = xSemaphoreCreateBinary();
-    send_485_sem = xSemaphoreCreateBinary();
-    sem_motor_enabled = xSemaphoreCreateMutex();
-    init_done_sem = xSemaphoreCreateBinary();
-    timer_start_sem = xSemaphoreCreateBinary();
+// Only smart config uses the netif and the default event loop.
+static esp_err_t startup_netif(void)
+{
+#ifdef CONFIG_TR_WIFI_PROVISIONING
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+#endif
+    return ESP_OK;
+}
 
-    static const char *TAG = "debugging";
+static esp_err_t startup_fsm(void)
+{
     // printf("初始化状态机……");
     init_state_machine();
     // printf("初始化状态机成功");
+    lc_cal_init();
 
     tpro1_flag = 0;
+    return ESP_OK;
+}
 
-    // Use CANOpen SDO commands to init motor dirver.
-    xTaskCreate(driver_init_task, "init motor driver", 8192, (void *)AF_INET, configMAX_PRIORITIES - 7, NULL);
+// In the order they are taken: the long running ones first.
+static const startup_step_t startup_steps[] = {
+    [STEP_TWAI]   = {"twai",   startup_twai,   0},
+    [STEP_DRIVE]  = {"drive",  startup_drive,  STARTUP_AFTER(STEP_TWAI)},
+    [STEP_NVS]    = {"nvs",    startup_nvs,    0},
+    [STEP_USB]    = {"usb",    startup_usb,    0},
+    [STEP_LED]    = {"led",    startup_led,    0},
+    [STEP_PC_IO]  = {"pc_io",  startup_pc_io,  0},
+    [STEP_GPIO]   = {"gpio",   startup_gpio,   0},
+    [STEP_NETIF]  = {"netif",  startup_netif,  0},
+    [STEP_FSM]    = {"fsm",    startup_fsm,    STARTUP_AFTER(STEP_NVS)},
+};
 
-    if (uart_queue == NULL)
-    {
-        // Queue cannot be created.
-        printf("UART_Queue Creation Failed");
-    }
-
-    if (udp_send_queue == NULL)
+void app_main(void)
+{
+    boot_profile_init();
+    // Before any traced task exists. No-op unless CONFIG_TR_TRACE_ENABLE.
+    trace_init();
+    deadline_monitor_init();
+    // Queues and semaphores from static storage, before any driver callback can use them.
+    rtos_objects_init();
+    // Locks held from here, released by the state machine. No-op unless CONFIG_TR_POWER_MGMT.
+    power_mgmt_init();
+
+    if (startup_run(startup_steps, sizeof(startup_steps) / sizeof(startup_steps[0])) != ESP_OK)
     {
-        // Queue cannot be created.
-        printf("UDP_Send_Queue Creation Failed");
+        printf("Startup failed\n"); // Todo: Further work needed. LED or error code.
+        return;
     }
 
-    // /* This helper function configures Wi-Fi or Ethernet, as selected in menuconfig.
-    //  * Read "Establishing Wi-Fi or Ethernet Connection" section in
-    //  * examples/protocols/README.md for more information about this function.
-    //  */
-
-    // //WiFi连接
-    // ESP_ERROR_CHECK(example_connect());
-
-    //创建线程，设置优先级
-    xTaskCreate(rx_task, "uart_rx_task", 2048 * 2, NULL, configMAX_PRIORITIES, NULL);
-    // xTaskCreatePinnedToCore(rx_task, "uart_rx_task", 2048*2, NULL, configMAX_PRIORITIES, NULL, 0);
-
-    // xTaskCreate(udp_Esp_to_Pc, "udp_Esp_to_Pc", 8192, NULL, configMAX_PRIORITIES-2, NULL);
-    // xTaskCreatePinnedToCore(udp_Esp_to_Pc, "udp_Esp_to_Pc", 8192, NULL, configMAX_PRIORITIES-2, NULL, 0);
-
-    xTaskCreate(tx_task, "uart_tx_task", 1024 * 2, NULL, configMAX_PRIORITIES - 4, NULL);
-    // xTaskCreatePinnedToCore(tx_task, "uart_tx_task", 1024*2, NULL, configMAX_PRIORITIES-4, NULL, 1);
-
-    xTaskCreate(uart_process_task, "uart_process_task", 4096 * 2, NULL, configMAX_PRIORITIES - 3, NULL); // 主线程。
-    // xTaskCreatePinnedToCore(uart_process_task, "uart_process_task", 2024*2, NULL, configMAX_PRIORITIES-3, NULL, 1);
-
-    // xTaskCreate(udp_server_task, "udp_server_task", 4096, (void*)AF_INET, configMAX_PRIORITIES-1, NULL);
-    // xTaskCreatePinnedToCore(udp_server_task, "udp_server", 4096, (void*)AF_INET, configMAX_PRIORITIES-1, NULL, 1);
-    // xTaskCreate(pc_rx_task, "pc_rx_task", 4096 * 4, (void *)AF_INET, configMAX_PRIORITIES - 1, NULL);
-
-    xTaskCreate(timed_task_, "timed_2ms_task", 2048, (void *)AF_INET, configMAX_PRIORITIES - 8, NULL);
-    //  xTaskCreate(rtn_button_timer_task, "rtn_button_timer_task", 1024, NULL, 1, NULL);// Set to have the lowest priority.
-    xTaskCreate(twai_receive_task, "twai_recv_task", 4096, (void *)AF_INET, configMAX_PRIORITIES - 9, NULL);
-
-    xTaskCreate(canRPDOSendTask, "rpdo_send_task", 4096, (void *)AF_INET, configMAX_PRIORITIES - 5, NULL);
+    // Last: from here on nothing should allocate. No-op unless CONFIG_TR_HEAP_GUARD.
+    heap_guard_start();
+    // The RS485 bus, the process task, the PC link, SYNC and RPDOs, then diagnostics; the drive
+    // bring-up tasks run already. Stacks and priorities are in rtos_objects.h.
+    rtos_tasks_start();
+    boot_profile_mark(BOOT_MARK_TASKS_STARTED);
 }
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""Fail when a control path function is linked into flash.
+
+Runs after the link when TR_CONTROL_IN_IRAM is set (see the top level
+CMakeLists.txt), or by hand:
+
+    python tools/check_iram.py build/tusb_serial_device.elf --nm xtensa-esp32s3-elf-nm
+
+Reads the symbol table, so static functions are checked as well. A function
+that is not in the table was inlined into its caller, which is checked itself.
+"""
+
+import argparse
+import subprocess
+import sys
+
+# Functions that run every control cycle, or in the TWAI interrupt.
+HOT_PATH = (
+    # TWAI driver
+    'twai_intr_handler_main',
+    'twai_receive',
+    'twai_transmit',
+    # CAN receive and decode
+    'twai_receive_task',
+    'processRxMsg',
+    'load_cell_force_at',
+    # State machine and compensation
+    'uart_process_task',
+    'main_fsm_function',
+    'run_state',
+    'Compensation',
+    'abnormal_detection',
+    'movingAvg',
+    'processUpwardUdpMsg',
+    'heartbeat_update',
+    'setpoint_fifo_apply',
+    # Session recorder, copies the cycle record
+    'recorder_push',
+    # RPDO encode and SYNC
+    'canRPDOSendTask',
+    'safety_apply',
+    'sendGenCan',
+    'deadline_cycle_start',
+    'deadline_cycle_output',
+    'timed_task_',
+    'sync_timer_callback',
+)
+
+# Instruction addresses fetched through the flash cache (IROM).
+FLASH_RANGES = (
+    (0x400C2000, 0x40C00000),   # ESP32
+    (0x42000000, 0x44000000),   # ESP32-S2/S3/C3
+)
+
+
+def in_flash(address):
+    return any(start <= address < end for start, end in FLASH_RANGES)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('elf', help='build/<project>.elf')
+    parser.add_argument('--nm', default='nm', help='nm of the target toolchain')
+    args = parser.parse_args()
+
+    output = subprocess.run([args.nm, '--defined-only', args.elf], check=True,
+                            stdout=subprocess.PIPE, universal_newlines=True).stdout
+
+    addresses = {}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[1] in 'tT':
+            addresses.setdefault(fields[2], int(fields[0], 16))
+
+    in_flash_functions = [name for name in HOT_PATH if name in addresses and in_flash(addresses[name])]
+    missing = [name for name in HOT_PATH if name not in addresses]
+
+    for name in missing:
+        print('check_iram: %s not in the symbol table (inlined)' % name)
+    if in_flash_functions:
+        for name in in_flash_functions:
+            print('check_iram: %s is in flash at 0x%08x' % (name, addresses[name]), file=sys.stderr)
+        print('check_iram: add them to a linker.lf mapping', file=sys.stderr)
+        return 1
+    print('check_iram: %d control path functions in IRAM' % (len(HOT_PATH) - len(missing)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""RAM use per subsystem, from the linker map of the firmware.
+
+Runs after every link (see the top level CMakeLists.txt), or by hand:
+
+    python tools/ram_report.py build/tusb_serial_device.map \
+        --objects components/StateMachine/rtos_objects.h
+
+Every input section placed in internal RAM is counted as data, bss or IRAM
+code. Sections of our own sources go to the subsystem of their file. The
+storage of the queues, semaphores and tasks in rtos_objects.c goes to the
+subsystem given for it in the tables of rtos_objects.h. Everything else is
+grouped by IDF component library.
+
+With --budget KB the script fails, and with it the build, when the total is
+over the budget.
+"""
+
+import argparse
+import collections
+import os
+import re
+import sys
+
+# Output sections in internal RAM, and the column they are counted in.
+RAM_SECTIONS = {
+    '.dram0.data': 'data',
+    '.dram0.bss': 'bss',
+    '.noinit': 'bss',
+    '.iram0.vectors': 'iram',
+    '.iram0.text': 'iram',
+    '.iram0.data': 'iram',
+    '.iram0.bss': 'iram',
+}
+
+# Our sources by object file.
+OBJECT_SUBSYSTEMS = {
+    'tusb_serial_device_main.c.obj': 'main',
+    'stateMachine.c.obj': 'control',
+    'deadline_monitor.c.obj': 'control',
+    'can_open_comm.c.obj': 'can',
+    'drive_pdo.c.obj': 'can',
+    'pc_link.c.obj': 'pc_link',
+    'pc_command.c.obj': 'pc_link',
+    'heartbeat.c.obj': 'pc_link',
+    'setpoint_fifo.c.obj': 'pc_link',
+    'time_sync.c.obj': 'pc_link',
+    'rs485_bus.c.obj': 'rs485',
+    'load_cell.c.obj': 'load_cell',
+    'load_cell_cal.c.obj': 'load_cell',
+    'diagnostics.c.obj': 'diagnostics',
+    'trace.c.obj': 'trace',
+    'heap_guard.c.obj': 'heap_guard',
+    'boot_profile.c.obj': 'startup',
+    'startup.c.obj': 'startup',
+    'power_mgmt.c.obj': 'control',
+    'safety.c.obj': 'control',
+    'StateStatusLED.c.obj': 'led',
+    'led_strip_rmt_ws2812.c.obj': 'led',
+    'wifiConnection.c.obj': 'wifi',
+    'recorder.c.obj': 'recorder',
+}
+
+RTOS_OBJECTS_FILE = 'rtos_objects.c.obj'
+RTOS_SYMBOL_SUFFIXES = ('', '_storage', '_buffer', '_stack', '_tcb')
+
+# Input section: name, address, size, file. Long names put the rest on the next line.
+INPUT_SECTION = re.compile(r'^ (\S+)?\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S.*)$')
+OUTPUT_SECTION = re.compile(r'^(\.\S+)')
+TABLE_ROW = re.compile(r'X\(\s*(\w+)\s*,(?:.*,)?\s*(\w+)\s*\)')
+
+
+def rtos_symbol_subsystems(header):
+    """Symbol name -> subsystem, from the X(...) rows of rtos_objects.h."""
+    symbols = {}
+    with open(header) as f:
+        for line in f:
+            match = TABLE_ROW.search(line)
+            if match:
+                for suffix in RTOS_SYMBOL_SUFFIXES:
+                    symbols[match.group(1) + suffix] = match.group(2)
+    return symbols
+
+
+def subsystem_of(section, source, rtos_symbols):
+    archive, _, member = source.partition('(')
+    member = member.rstrip(')')
+    if member == RTOS_OBJECTS_FILE:
+        symbol = section.split('.')[-1]
+        return rtos_symbols.get(symbol, 'rtos_objects')
+    if member in OBJECT_SUBSYSTEMS:
+        return OBJECT_SUBSYSTEMS[member]
+    if member:
+        # esp-idf/freertos/libfreertos.a -> idf:freertos
+        return 'idf:' + os.path.basename(archive)[3:-2] if archive.endswith('.a') else member
+    return 'other'
+
+
+def parse_map(path, rtos_symbols):
+    totals = collections.defaultdict(lambda: collections.Counter())
+    column = None
+    pending = None
+
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if line.startswith('Cross Reference Table'):
+                break
+
+            output = OUTPUT_SECTION.match(line)
+            if output:
+                column = RAM_SECTIONS.get(output.group(1))
+                pending = None
+                continue
+            if column is None or not line.startswith(' '):
+                continue
+
+            match = INPUT_SECTION.match(line)
+            if match and (match.group(1) or pending):
+                section = match.group(1) or pending
+                size = int(match.group(3), 16)
+                if size > 0 and not section.startswith('*'):
+                    totals[subsystem_of(section, match.group(4), rtos_symbols)][column] += size
+                pending = None
+            elif re.match(r'^ [.\w]\S*$', line) or line.strip() == 'COMMON':
+                pending = line.strip()
+    return totals
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('map', help='linker map, build/<project>.map')
+    parser.add_argument('--objects', help='rtos_objects.h, for the queue and task storage')
+    parser.add_argument('--budget', type=float, help='fail when the total is over this many KB')
+    args = parser.parse_args()
+
+    rtos_symbols = rtos_symbol_subsystems(args.objects) if args.objects else {}
+    totals = parse_map(args.map, rtos_symbols)
+
+    rows = sorted(totals.items(), key=lambda item: -sum(item[1].values()))
+    print('RAM per subsystem (bytes)')
+    print('%-24s %8s %8s %8s %8s' % ('subsystem', 'data', 'bss', 'iram', 'total'))
+    grand = collections.Counter()
+    for name, counts in rows:
+        grand.update(counts)
+        print('%-24s %8d %8d %8d %8d' % (name, counts['data'], counts['bss'], counts['iram'], sum(counts.values())))
+    total = sum(grand.values())
+    print('%-24s %8d %8d %8d %8d' % ('total', grand['data'], grand['bss'], grand['iram'], total))
+
+    if args.budget is not None and total > args.budget * 1024:
+        print('RAM budget of %.0f KB exceeded by %d bytes' % (args.budget, total - args.budget * 1024), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+"""List, download and convert the sessions recorded on the robot.
+
+    tools/session_tool.py list /dev/ttyACM0                   # newest first
+    tools/session_tool.py status /dev/ttyACM0
+    tools/session_tool.py download /dev/ttyACM0 12 -o s12.bin
+    tools/session_tool.py decode s12.bin -o s12.csv           # or s12.parquet
+    tools/session_tool.py trace s12.bin -o s12.txt            # for host/bench/fw_replay
+
+Talks to the USB CDC port of the robot (not the PC link UART) with the
+service commands REC_LIST, REC_STATUS and REC_READ. A download is the raw
+blocks of the session as stored in flash, each a 32 byte header and its
+records, closed by an end header; decode checks the CRC of every block and
+writes one row per recorded cycle. Parquet needs pandas and pyarrow.
+
+A session recorded with TR_RECORDER_INPUTS holds the inputs of every
+main_fsm_function call. trace writes them as I and O records of the bench
+trace format (host/bench/bench_fixture.h) for fw_replay.
+
+Downloads only run while the robot is idle (powerUp, enabled): the recorder
+has to stay off the flash during a session. Layouts are in recorder.h.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+import zlib
+
+SERVICE_HEAD = 0xCD
+FRAME_HEAD = 0xAB
+REPLY_HEAD = 0x2A
+
+CMD_REC_LIST = 0x27
+CMD_REC_READ = 0x28
+CMD_REC_STATUS = 0x29
+
+STATUS_NAMES = ('ok', 'unknown command', 'bad length', 'bad argument', 'busy', 'storage error')
+
+BLOCK_MAGIC = 0x31434552
+END_MAGIC = 0x444e4552
+TYPE_CYCLE = 1
+TYPE_INPUT = 2
+
+# rec_block_header_t, rec_record_t, rec_session_info_t, rec_status_t
+HEADER = struct.Struct('<IIHHBBHIIII')
+RECORD = struct.Struct('<IBBiihhh')
+INPUT_RECORD = struct.Struct('<IIBBBBHHiiihBBiii14sBBhii')
+SESSION_INFO = struct.Struct('<HHIIIIB')
+STATUS = struct.Struct('<HHBBHIIHH')
+
+STATES = ('powerUp', 'enabled', 'initialising', 'ready', 'run', 'estop', 'wifiConfig', 'devMatching')
+COLUMNS = ('record', 'time_us', 'state', 'level', 'position', 'speed', 'current', 'force', 'command')
+INPUT_FIELDS = ('cycle', 'time_us', 'state', 'level', 'switches', 'control_mode', 'status_word', 'error_code',
+                'position_inc', 'speed_inc', 'position_inc_offset', 'current', 'limit_switches', 'lc_confidence',
+                'lc_inc', 'lc_age_us', 'force', 'pc_msg', 'state_out', 'reserved', 'command', 'position_out',
+                'speed_out')
+INPUT_COLUMNS = tuple(name for name in INPUT_FIELDS if name != 'reserved')
+
+
+def service_frame(cmd, payload=b''):
+    body = bytes([cmd, len(payload)]) + payload
+    chk = 0
+    for b in body:
+        chk ^= b
+    return bytes([FRAME_HEAD, SERVICE_HEAD]) + body + bytes([chk])
+
+
+def read_exact(port, count):
+    data = port.read(count)
+    if len(data) != count:
+        raise SystemExit('session_tool: timeout, %d of %d bytes' % (len(data), count))
+    return data
+
+
+def command(port, cmd, payload=b''):
+    """Send a service command, return the reply payload after the status byte."""
+    port.write(service_frame(cmd, payload))
+    # Skip anything before the reply, e.g. the rest of an aborted download.
+    window = b''
+    while window != bytes([REPLY_HEAD, SERVICE_HEAD, cmd]):
+        window = (window + read_exact(port, 1))[-3:]
+    length = read_exact(port, 1)[0]
+    payload = read_exact(port, length)
+    chk = read_exact(port, 1)[0]
+    expected = cmd ^ length
+    for b in payload:
+        expected ^= b
+    if chk != expected:
+        raise SystemExit('session_tool: reply checksum error')
+    if payload[0] != 0:
+        name = STATUS_NAMES[payload[0]] if payload[0] < len(STATUS_NAMES) else str(payload[0])
+        raise CommandError(name)
+    return payload[1:]
+
+
+class CommandError(Exception):
+    pass
+
+
+def open_port(name):
+    try:
+        import serial
+    except ImportError:
+        raise SystemExit('session_tool: needs pyserial (pip install pyserial)')
+    return serial.Serial(name, 115200, timeout=2)
+
+
+def session_info(data):
+    session, blocks, records, first_seq, start_ms, duration_ms, truncated = SESSION_INFO.unpack(data)
+    return {'session': session, 'blocks': blocks, 'records': records, 'first_seq': first_seq,
+            'start_ms': start_ms, 'duration_ms': duration_ms, 'truncated': bool(truncated)}
+
+
+def cmd_list(args):
+    port = open_port(args.port)
+    print('session  records  duration_s  start_s  blocks')
+    for index in range(256):
+        try:
+            info = session_info(command(port, CMD_REC_LIST, bytes([index])))
+        except CommandError:
+            break
+        print('%7d  %7d  %10.1f  %7.1f  %6d%s' % (
+            info['session'], info['records'], info['duration_ms'] / 1000.0, info['start_ms'] / 1000.0,
+            info['blocks'], '  truncated' if info['truncated'] else ''))
+
+
+def cmd_status(args):
+    port = open_port(args.port)
+    fields = ('blocks', 'erased', 'sessions', 'recording', 'session', 'dropped', 'write_errors',
+              'max_write_us', 'max_erase_us')
+    for name, value in zip(fields, STATUS.unpack(command(port, CMD_REC_STATUS))):
+        print('%-13s %d' % (name, value))
+
+
+def cmd_download(args):
+    port = open_port(args.port)
+    try:
+        info = session_info(command(port, CMD_REC_READ, struct.pack('<H', args.session)))
+    except CommandError as e:
+        raise SystemExit('session_tool: session %d: %s' % (args.session, e))
+
+    received = 0
+    with open(args.output, 'wb') as out:
+        while True:
+            raw = read_exact(port, HEADER.size)
+            out.write(raw)
+            magic, seq, session, count, _, record_size = HEADER.unpack(raw)[:6]
+            if magic == END_MAGIC:
+                break
+            if magic != BLOCK_MAGIC:
+                raise SystemExit('session_tool: lost the block stream after %d blocks' % received)
+            out.write(read_exact(port, count * record_size))
+            received += 1
+            sys.stderr.write('\r%d/%d blocks' % (received, info['blocks']))
+    sys.stderr.write('\n')
+    if received != info['blocks']:
+        print('session_tool: %d of %d blocks, the robot left idle or a block was erased'
+              % (received, info['blocks']), file=sys.stderr)
+
+
+def decode_blocks(data):
+    """Yield the records of a download as (type, dict), skipping blocks with a bad CRC."""
+    offset = 0
+    wrap = 0
+    last_time = None
+    while offset + HEADER.size <= len(data):
+        raw = data[offset:offset + HEADER.size]
+        fields = HEADER.unpack(raw)
+        magic, seq, session, count, rtype, record_size, block_in_session, first_record, period_us, start_ms, crc = fields
+        offset += HEADER.size
+        if magic == END_MAGIC:
+            return
+        if magic != BLOCK_MAGIC:
+            raise SystemExit('session_tool: no block header at byte %d' % (offset - HEADER.size))
+        body = data[offset:offset + count * record_size]
+        offset += count * record_size
+        if zlib.crc32(body, zlib.crc32(raw[:HEADER.size - 4])) != crc:
+            print('session_tool: block %d CRC error, skipped' % seq, file=sys.stderr)
+            continue
+        if rtype == TYPE_INPUT and record_size == INPUT_RECORD.size:
+            for i in range(count):
+                row = dict(zip(INPUT_FIELDS, INPUT_RECORD.unpack_from(body, i * INPUT_RECORD.size)))
+                del row['reserved']
+                yield TYPE_INPUT, row
+            continue
+        if rtype != TYPE_CYCLE or record_size != RECORD.size:
+            continue
+        for i in range(count):
+            time_us, state, level, position, speed, current, force, cmd = RECORD.unpack_from(body, i * RECORD.size)
+            # time_us is 32 bit, it wraps after 71 minutes.
+            if last_time is not None and time_us < last_time:
+                wrap += 1 << 32
+            last_time = time_us
+            yield TYPE_CYCLE, {'record': first_record + i, 'time_us': time_us + wrap,
+                               'state': STATES[state] if state < len(STATES) else state, 'level': level,
+                               'position': position, 'speed': speed, 'current': current, 'force': force,
+                               'command': cmd}
+
+
+def cmd_decode(args):
+    with open(args.input, 'rb') as f:
+        records = list(decode_blocks(f.read()))
+    columns = INPUT_COLUMNS if records and records[0][0] == TYPE_INPUT else COLUMNS
+    rows = [row for _, row in records]
+    for row in rows:
+        if 'pc_msg' in row:
+            row['pc_msg'] = row['pc_msg'].hex()
+    if args.output.endswith('.parquet'):
+        try:
+            import pandas
+        except ImportError:
+            raise SystemExit('session_tool: Parquet needs pandas and pyarrow')
+        pandas.DataFrame(rows, columns=columns).to_parquet(args.output, index=False)
+    else:
+        with open(args.output, 'w', newline='') as f:
+            writer = csv.DictWriter(f, fieldnames=columns)
+            writer.writeheader()
+            writer.writerows(rows)
+    print('%d records' % len(rows))
+
+
+def cmd_trace(args):
+    with open(args.input, 'rb') as f:
+        rows = [row for rtype, row in decode_blocks(f.read()) if rtype == TYPE_INPUT]
+    if not rows:
+        raise SystemExit('session_tool: no input records, record with TR_RECORDER_INPUTS')
+    with open(args.output, 'w') as out:
+        out.write('# %s, %d cycles, replay with host/bench/fw_replay\n' % (args.input, len(rows)))
+        for r in rows:
+            out.write('I %d %d %d %d %x %d %x %x %d %d %d %d %x %d %d %d %d %s\n' % (
+                r['time_us'], r['cycle'], r['state'], r['level'], r['switches'], r['control_mode'],
+                r['status_word'], r['error_code'], r['position_inc'], r['speed_inc'], r['position_inc_offset'],
+                r['current'], r['limit_switches'], r['lc_inc'], r['lc_age_us'], r['lc_confidence'], r['force'],
+                ' '.join('%02x' % b for b in r['pc_msg'])))
+            out.write('O %d %d %d %d %d %d\n' % (
+                r['time_us'], r['cycle'], r['state_out'], r['command'], r['position_out'], r['speed_out']))
+    gaps = sum(1 for a, b in zip(rows, rows[1:]) if b['cycle'] != a['cycle'] + 1)
+    print('%d cycles, %d gaps' % (len(rows), gaps))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest='command', required=True)
+    p = sub.add_parser('list', help='sessions on the robot')
+    p.add_argument('port', help='USB CDC port, e.g. /dev/ttyACM0')
+    p.set_defaults(fn=cmd_list)
+    p = sub.add_parser('status', help='recorder counters')
+    p.add_argument('port')
+    p.set_defaults(fn=cmd_status)
+    p = sub.add_parser('download', help='raw blocks of a session')
+    p.add_argument('port')
+    p.add_argument('session', type=int)
+    p.add_argument('-o', '--output', default='session.bin')
+    p.set_defaults(fn=cmd_download)
+    p = sub.add_parser('decode', help='download to CSV or Parquet')
+    p.add_argument('input')
+    p.add_argument('-o', '--output', default='session.csv', help='.csv or .parquet')
+    p.set_defaults(fn=cmd_decode)
+    p = sub.add_parser('trace', help='input session to a replay trace')
+    p.add_argument('input')
+    p.add_argument('-o', '--output', default='session.txt')
+    p.set_defaults(fn=cmd_trace)
+    args = parser.parse_args()
+    return args.fn(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
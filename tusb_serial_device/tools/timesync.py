@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+"""Map the robot's clock to the PC's clock.
+
+    tools/timesync.py /dev/ttyACM0                      # offset, drift and round trip
+    tools/timesync.py /dev/ttyACM0 --frames 1000        # and the arrival delay of robot frames
+    tools/timesync.py /dev/ttyUSB0 --baud 921600        # over the UART2 PC link
+    tools/timesync.py --simulate                        # a simulated robot, checks the fit
+
+As a library, on an open pyserial port:
+
+    from timesync import ClockSync
+    sync = ClockSync.measure(port)              # 32 exchanges, about half a second
+    host_ns = sync.device_to_host(device_us)    # time.monotonic_ns() of a robot time
+    sync.update(port)                           # now and then, follows the drift
+
+Each exchange sends PC_CMD_TIME_SYNC with the PC time t1 and notes the time
+t4 the reply is in; the robot answers with the esp_timer times t2 and t3 at
+which it handled the request. As in NTP the offset is
+((t2 - t1) + (t3 - t4)) / 2, exact when both directions take as long, and
+off by at most half the round trip. USB polling and the OS make most round
+trips long, so only the quarter of the exchanges with the shortest round
+trips is kept, and a straight line through their offsets over PC time gives
+the offset and the drift of the robot's crystal.
+
+Every robot frame carries the esp_timer time of its drive sample in bytes
+20..27 (int64, us); device_to_host() of it is when the sample was taken,
+whatever the frame then spent in USB or UART buffers.
+"""
+
+import argparse
+import random
+import statistics
+import struct
+import time
+from collections import deque
+
+from session_tool import REPLY_HEAD, SERVICE_HEAD, CommandError, command
+
+CMD_TIME_SYNC = 0x2F
+
+# time_sync_reply_t
+REPLY = struct.Struct('<Qqq')
+
+UP_FRAME_LEN = 34
+UP_FRAME_END = 0x26
+UP_FRAME_TIME = struct.Struct('<q')     # Bytes 20..27.
+UP_FRAME_TIME_OFFSET = 20
+
+DRIFT_MIN_SPAN_NS = 2e9
+
+
+class ClockSync:
+    """Offset and drift of the robot's esp_timer against time.monotonic_ns()."""
+
+    def __init__(self, window=256, keep=0.25, clock=time.monotonic_ns):
+        self.samples = deque(maxlen=window)     # (PC time, offset, round trip), ns
+        self.keep = keep
+        self.clock = clock
+        self.offset_ns = None                   # Robot minus PC time at PC time ref_ns.
+        self.ref_ns = 0
+        self.drift = 0.0                        # 1e-6 is 1 ppm, robot clock fast.
+        self.error_ns = None                    # Half the longest round trip kept.
+
+    def add(self, t1_ns, t2_us, t3_us, t4_ns):
+        """One exchange: PC send and receive times, robot receive and send times."""
+        rtt = (t4_ns - t1_ns) - (t3_us - t2_us) * 1000
+        offset = ((t2_us * 1000 - t1_ns) + (t3_us * 1000 - t4_ns)) / 2
+        self.samples.append(((t1_ns + t4_ns) / 2, offset, rtt))
+
+    def fit(self):
+        if not self.samples:
+            raise ValueError('no exchanges')
+        ordered = sorted(self.samples, key=lambda s: s[2])
+        used = ordered[:max(2, int(len(ordered) * self.keep))]
+        hosts = [s[0] for s in used]
+        offsets = [s[1] for s in used]
+
+        self.ref_ns = statistics.fmean(hosts)
+        self.offset_ns = statistics.fmean(offsets)
+        spread = sum((h - self.ref_ns) ** 2 for h in hosts)
+        # Over a short burst the offsets scatter more than the crystal drifts: the drift is only
+        # fitted once the kept exchanges span DRIFT_MIN_SPAN_NS, and left as it was before.
+        if len(used) >= 4 and max(hosts) - min(hosts) > DRIFT_MIN_SPAN_NS:
+            self.drift = sum((h - self.ref_ns) * (o - self.offset_ns) for h, o in zip(hosts, offsets)) / spread
+        self.error_ns = max(s[2] for s in used) / 2
+        return self
+
+    def device_to_host(self, device_us):
+        """PC time.monotonic_ns() at which the robot's esp_timer read device_us."""
+        if self.offset_ns is None:
+            raise ValueError('not synchronised')
+        # robot = pc + offset + drift * (pc - ref)
+        return (device_us * 1000 - self.offset_ns + self.drift * self.ref_ns) / (1 + self.drift)
+
+    def host_to_device(self, host_ns):
+        """Robot esp_timer time, in us, at PC time.monotonic_ns() host_ns."""
+        if self.offset_ns is None:
+            raise ValueError('not synchronised')
+        return (host_ns + self.offset_ns + self.drift * (host_ns - self.ref_ns)) / 1000
+
+    def exchange(self, port):
+        """One PC_CMD_TIME_SYNC round trip. False if the reply was not for this request."""
+        t1 = self.clock()
+        reply = command(port, CMD_TIME_SYNC, struct.pack('<Q', t1))
+        t4 = self.clock()
+        echo, t2, t3 = REPLY.unpack(reply[:REPLY.size])
+        if echo != t1:
+            return False
+        self.add(t1, t2, t3, t4)
+        return True
+
+    def update(self, port, count=8, interval=0.01):
+        """A few more exchanges, then fit again."""
+        for _ in range(count):
+            self.exchange(port)
+            time.sleep(interval)
+        return self.fit()
+
+    @classmethod
+    def measure(cls, port, count=32, interval=0.01, **kwargs):
+        sync = cls(**kwargs)
+        return sync.update(port, count, interval)
+
+
+def up_frames(port, count, clock=time.monotonic_ns):
+    """Yield (arrival time, robot sample time in us) of the next count robot frames."""
+    window = b''
+    received = 0
+    while received < count:
+        data = port.read(1)
+        if not data:
+            raise SystemExit('timesync: no robot frames')
+        window = (window + data)[-UP_FRAME_LEN:]
+        if (len(window) == UP_FRAME_LEN and window[0] == REPLY_HEAD and window[1] != SERVICE_HEAD
+                and window[-1] == UP_FRAME_END):
+            arrival = clock()
+            device_us = UP_FRAME_TIME.unpack_from(window, UP_FRAME_TIME_OFFSET)[0]
+            window = b''
+            received += 1
+            yield arrival, device_us
+
+
+class SimulatedRobot:
+    """Answers PC_CMD_TIME_SYNC like the robot, with its own clock and a jittery link."""
+
+    def __init__(self, offset_s, drift_ppm, delay_ms, jitter_ms):
+        self.offset_ns = offset_s * 1e9
+        self.drift = drift_ppm * 1e-6
+        self.delay = delay_ms / 1000.0
+        self.jitter = jitter_ms / 1000.0
+        self.pending = b''
+
+    def now_us(self):
+        host = time.monotonic_ns()
+        return int((host * (1 + self.drift) + self.offset_ns) / 1000)
+
+    def link(self):
+        # USB polling and scheduling: mostly short, with a long tail.
+        time.sleep(self.delay + random.expovariate(1 / self.jitter) if self.jitter > 0 else self.delay)
+
+    def write(self, frame):
+        cmd, length = frame[2], frame[3]
+        self.link()
+        t2 = self.now_us()
+        payload = bytes([1])
+        if cmd == CMD_TIME_SYNC and length == 8:
+            payload = bytes([0]) + REPLY.pack(struct.unpack_from('<Q', frame, 4)[0], t2, t2 + 20)
+        body = bytes([cmd, len(payload)]) + payload
+        chk = 0
+        for b in body:
+            chk ^= b
+        self.link()
+        self.pending += bytes([REPLY_HEAD, SERVICE_HEAD]) + body + bytes([chk])
+
+    def read(self, count):
+        data, self.pending = self.pending[:count], self.pending[count:]
+        return data
+
+
+def open_port(name, baud):
+    try:
+        import serial
+    except ImportError:
+        raise SystemExit('timesync: needs pyserial (pip install pyserial)')
+    return serial.Serial(name, baud, timeout=2)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('port', nargs='?', help='USB CDC port, or the PC link UART')
+    parser.add_argument('--baud', type=int, default=115200, help='TR_PC_LINK_BAUD_RATE on the UART')
+    parser.add_argument('--count', type=int, default=64, help='exchanges')
+    parser.add_argument('--interval', type=float, default=0.02, help='seconds between exchanges')
+    parser.add_argument('--frames', type=int, default=0, help='then time this many robot frames')
+    parser.add_argument('--simulate', action='store_true', help='exchange with a simulated robot')
+    parser.add_argument('--sim-drift', type=float, default=30.0, help='ppm, simulated robot')
+    parser.add_argument('--sim-delay', type=float, default=0.1, help='ms each way, simulated link')
+    parser.add_argument('--sim-jitter', type=float, default=1.0, help='ms mean extra delay, simulated link')
+    args = parser.parse_args()
+
+    if args.simulate:
+        port = SimulatedRobot(random.uniform(-1000, 1000), args.sim_drift, args.sim_delay, args.sim_jitter)
+    elif args.port:
+        port = open_port(args.port, args.baud)
+    else:
+        parser.error('a port or --simulate')
+
+    try:
+        sync = ClockSync.measure(port, args.count, args.interval)
+    except CommandError as e:
+        raise SystemExit('timesync: %s, the firmware has no PC_CMD_TIME_SYNC' % e)
+    rtts = sorted(s[2] for s in sync.samples)
+    print('exchanges   %d' % len(sync.samples))
+    print('round trip  min %.3f ms, median %.3f ms, max %.3f ms' % (
+        rtts[0] / 1e6, statistics.median(rtts) / 1e6, rtts[-1] / 1e6))
+    print('offset      %.6f s (robot minus PC)' % (sync.offset_ns / 1e9))
+    print('drift       %+.1f ppm' % (sync.drift * 1e6))
+    print('error       < %.3f ms' % (sync.error_ns / 1e6))
+
+    if args.simulate:
+        host = time.monotonic_ns()
+        print('actual      %.3f ms off' % ((sync.device_to_host(port.now_us()) - host) / 1e6))
+    elif args.frames > 0:
+        delays = [(arrival - sync.device_to_host(device_us)) / 1e6 for arrival, device_us in up_frames(port, args.frames)]
+        delays.sort()
+        print('frame delay min %.3f ms, median %.3f ms, 99 %% %.3f ms, max %.3f ms' % (
+            delays[0], statistics.median(delays), delays[int(0.99 * (len(delays) - 1))], delays[-1]))
+
+
+if __name__ == '__main__':
+    main()
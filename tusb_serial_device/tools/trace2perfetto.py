@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""Convert a frozen event trace from the console log into Chrome trace JSON.
+
+The firmware prints the trace rings (components/StateMachine/trace.c) as
+
+    TRACE begin mhz=160 depth=1024 trigger=2
+    T <core> <ccount hex> <event id> <arg hex>
+    ...
+    TRACE end
+
+Save the `idf.py monitor` output to a file and run
+
+    tools/trace2perfetto.py monitor.log -o trace.json
+
+then open trace.json in https://ui.perfetto.dev or chrome://tracing. Each
+core is a track; state machine runs are slices, everything else is an instant
+event. Times are esp_timer microseconds, recovered from the TRACE_EV_CLOCK
+events each core records from its tick interrupt.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+# Must match trace_event_id_t in trace.h.
+EV_CLOCK = 1
+EV_SYNC_SENT = 2
+EV_TPDO_RX = 3
+EV_FSM_BEGIN = 4
+EV_FSM_END = 5
+EV_RPDO_QUEUED = 6
+EV_RPDO_SENT = 7
+EV_LC_SAMPLE = 8
+EV_PC_FRAME = 9
+EV_TRIGGER = 10
+EV_SAFETY = 11
+
+EVENT_NAMES = {
+    EV_SYNC_SENT: "SYNC sent",
+    EV_TPDO_RX: "TPDO rx",
+    EV_RPDO_QUEUED: "RPDO queued",
+    EV_RPDO_SENT: "RPDO sent",
+    EV_LC_SAMPLE: "load cell sample",
+    EV_PC_FRAME: "PC frame",
+    EV_TRIGGER: "TRIGGER",
+    EV_SAFETY: "safety limit",
+}
+
+STATE_NAMES = ["powerUp", "enabled", "initialising", "ready", "run", "estop", "wifiConfig", "devMatching"]
+TRIGGER_NAMES = {1: "manual", 2: "estop", 3: "deadline"}
+
+BEGIN_RE = re.compile(r"TRACE begin mhz=(\d+) depth=(\d+) trigger=(\d+)")
+EVENT_RE = re.compile(r"^T (\d+) ([0-9a-fA-F]{8}) (\d+) ([0-9a-fA-F]{8})\s*$")
+
+
+def read_dumps(lines):
+    """Yield (mhz, trigger, [(core, ccount, id, arg)]) for every dump in the log."""
+    dump = None
+    for line in lines:
+        line = line.strip()
+        m = BEGIN_RE.search(line)
+        if m:
+            dump = (int(m.group(1)), int(m.group(3)), [])
+            continue
+        if dump is None:
+            continue
+        if line.startswith("TRACE end"):
+            yield dump
+            dump = None
+            continue
+        m = EVENT_RE.match(line)
+        if m:
+            dump[2].append((int(m.group(1)), int(m.group(2), 16), int(m.group(3)), int(m.group(4), 16)))
+
+
+def signed32(value):
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def core_times(events, mhz):
+    """Map the events of one core, in ring order, to esp_timer microseconds.
+
+    Each event is placed relative to the nearest TRACE_EV_CLOCK before it, or
+    the first one after it for the events at the start of the ring. The clock
+    events come every tick, far inside the 2^32 cycle wrap.
+    """
+    clocks = []
+    unwrapped = None
+    for index, (_, ccount, event_id, arg) in enumerate(events):
+        if event_id != EV_CLOCK:
+            continue
+        if unwrapped is None:
+            unwrapped = arg
+        else:
+            unwrapped += (arg - unwrapped) & 0xFFFFFFFF
+        clocks.append((index, ccount, unwrapped))
+
+    if not clocks:
+        return None
+
+    times = []
+    next_clock = 0
+    for index, (_, ccount, _, _) in enumerate(events):
+        while next_clock + 1 < len(clocks) and clocks[next_clock + 1][0] <= index:
+            next_clock += 1
+        _, ref_ccount, ref_us = clocks[next_clock]
+        times.append(ref_us + signed32(ccount - ref_ccount) / mhz)
+    return times
+
+
+def convert(dump):
+    mhz, trigger, events = dump
+    trace = []
+    cores = sorted({core for core, _, _, _ in events})
+
+    for core in cores:
+        core_events = [e for e in events if e[0] == core]
+        times = core_times(core_events, mhz)
+        if times is None:
+            print(f"core {core}: no clock events, skipped", file=sys.stderr)
+            continue
+
+        trace.append({"ph": "M", "pid": 1, "tid": core, "name": "thread_name", "args": {"name": f"core {core}"}})
+        open_fsm = False
+        for (_, _, event_id, arg), ts in zip(core_events, times):
+            if event_id == EV_CLOCK:
+                continue
+            if event_id == EV_FSM_BEGIN:
+                state = STATE_NAMES[arg] if arg < len(STATE_NAMES) else str(arg)
+                trace.append({"ph": "B", "pid": 1, "tid": core, "ts": ts, "name": "main_fsm_function",
+                              "args": {"state": state}})
+                open_fsm = True
+            elif event_id == EV_FSM_END:
+                if open_fsm:
+                    state = STATE_NAMES[arg] if arg < len(STATE_NAMES) else str(arg)
+                    trace.append({"ph": "E", "pid": 1, "tid": core, "ts": ts, "args": {"next_state": state}})
+                    open_fsm = False
+            else:
+                args = {"arg": hex(arg)}
+                if event_id == EV_TRIGGER:
+                    args = {"reason": TRIGGER_NAMES.get(arg, str(arg))}
+                elif event_id == EV_LC_SAMPLE:
+                    args = {"value": signed32(arg)}
+                trace.append({"ph": "i", "s": "t", "pid": 1, "tid": core, "ts": ts,
+                              "name": EVENT_NAMES.get(event_id, f"event {event_id}"), "args": args})
+
+    trace.append({"ph": "M", "pid": 1, "name": "process_name",
+                  "args": {"name": f"robot (trigger: {TRIGGER_NAMES.get(trigger, trigger)})"}})
+    return {"traceEvents": trace, "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", help="console log with a TRACE dump")
+    parser.add_argument("-o", "--output", default="trace.json")
+    parser.add_argument("-n", "--dump", type=int, default=-1,
+                        help="which dump to convert when the log has several (default: last)")
+    args = parser.parse_args()
+
+    with open(args.log, errors="replace") as f:
+        dumps = list(read_dumps(f))
+    if not dumps:
+        sys.exit("no TRACE dump found")
+
+    result = convert(dumps[args.dump])
+    with open(args.output, "w") as f:
+        json.dump(result, f)
+    print(f"{len(result['traceEvents'])} events written to {args.output}")
+
+
+if __name__ == "__main__":
+    main()
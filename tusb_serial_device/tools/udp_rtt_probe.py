@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""UDP round trip time and jitter to the robot's echo port.
+
+    tools/udp_rtt_probe.py 192.168.1.50                   # robot, TR_WIFI_ECHO_PORT
+    tools/udp_rtt_probe.py --loopback                     # local echo, checks the tool
+    tools/udp_rtt_probe.py --loopback --sim-jitter 30     # host simulated link
+
+Sends --count datagrams of --size bytes every --interval seconds, the control
+frame rate by default, and prints the round trip statistics. Jitter is the
+mean difference between consecutive round trips (RFC 3550). Compare a run with
+the default Wi-Fi configuration against one with the control link profile.
+
+With --loopback an echo server is started on 127.0.0.1. --sim-delay and
+--sim-jitter add a random extra delay there. Modem power save holds frames
+until the next beacon, which --sim-jitter 100 roughly resembles.
+"""
+
+import argparse
+import random
+import socket
+import statistics
+import struct
+import sys
+import threading
+import time
+
+HEADER = struct.Struct('<IQ')   # sequence, send time in ns
+
+
+def echo_server(sock, delay_ms, jitter_ms):
+    while True:
+        data, addr = sock.recvfrom(2048)
+        extra = delay_ms + random.uniform(0, jitter_ms)
+        if extra > 0:
+            threading.Timer(extra / 1000.0, sock.sendto, (data, addr)).start()
+        else:
+            sock.sendto(data, addr)
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('host', nargs='?', help='robot address')
+    parser.add_argument('--port', type=int, default=54322, help='echo port (TR_WIFI_ECHO_PORT)')
+    parser.add_argument('--count', type=int, default=1000)
+    parser.add_argument('--interval', type=float, default=0.004, help='seconds between datagrams')
+    parser.add_argument('--size', type=int, default=34, help='datagram size, an up frame by default')
+    parser.add_argument('--timeout', type=float, default=0.5, help='seconds before a datagram counts as lost')
+    parser.add_argument('--loopback', action='store_true', help='echo from a local server')
+    parser.add_argument('--sim-delay', type=float, default=0.0, help='ms added by the local server')
+    parser.add_argument('--sim-jitter', type=float, default=0.0, help='ms of random delay added by the local server')
+    parser.add_argument('--csv', help='write sequence,rtt_ms per datagram to this file')
+    args = parser.parse_args()
+
+    if args.loopback:
+        server = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        server.bind(('127.0.0.1', 0))
+        threading.Thread(target=echo_server, args=(server, args.sim_delay, args.sim_jitter), daemon=True).start()
+        target = server.getsockname()
+    elif args.host:
+        target = (args.host, args.port)
+    else:
+        parser.error('give the robot address or --loopback')
+
+    size = max(args.size, HEADER.size)
+    padding = bytes(size - HEADER.size)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(0.001)
+
+    sent = {}
+    rtts = {}
+    next_send = time.perf_counter()
+    seq = 0
+    deadline = None
+    while True:
+        now = time.perf_counter()
+        if seq < args.count and now >= next_send:
+            sent[seq] = time.perf_counter_ns()
+            sock.sendto(HEADER.pack(seq, sent[seq]) + padding, target)
+            seq += 1
+            next_send += args.interval
+            if seq == args.count:
+                deadline = now + args.timeout
+        if deadline is not None and (now >= deadline or len(rtts) == args.count):
+            break
+        try:
+            data = sock.recv(2048)
+        except socket.timeout:
+            continue
+        received_ns = time.perf_counter_ns()
+        if len(data) >= HEADER.size:
+            rx_seq, tx_ns = HEADER.unpack_from(data)
+            if rx_seq in sent and sent[rx_seq] == tx_ns and rx_seq not in rtts:
+                rtts[rx_seq] = (received_ns - tx_ns) / 1e6
+
+    if not rtts:
+        print('No replies from %s:%d' % target, file=sys.stderr)
+        return 1
+
+    in_order = [rtts[s] for s in sorted(rtts)]
+    jitter = statistics.mean(abs(b - a) for a, b in zip(in_order, in_order[1:])) if len(in_order) > 1 else 0.0
+    print('%s:%d  %d sent, %d lost' % (target[0], target[1], args.count, args.count - len(rtts)))
+    print('rtt ms  min %.3f  mean %.3f  p50 %.3f  p99 %.3f  max %.3f' % (
+        min(in_order), statistics.mean(in_order), percentile(in_order, 0.5),
+        percentile(in_order, 0.99), max(in_order)))
+    print('jitter ms  %.3f  (stdev %.3f)' % (jitter, statistics.pstdev(in_order)))
+
+    if args.csv:
+        with open(args.csv, 'w') as f:
+            f.write('sequence,rtt_ms\n')
+            for s in sorted(rtts):
+                f.write('%d,%.4f\n' % (s, rtts[s]))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())